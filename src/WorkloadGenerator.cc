@@ -8,10 +8,9 @@
 
 
 WorkloadGenerator::WorkloadGenerator(unsigned nsets, unsigned ngets, unsigned ndels,
-                                     unsigned num_warmups, std::string host, std::string port)
+                                     unsigned num_warmups)
 
-  : cache_(Cache(host, port)),
-    nsets_(nsets), ngets_(ngets), ndels_(ndels), num_warmups_(num_warmups), 
+  : nsets_(nsets), ngets_(ngets), ndels_(ndels), num_warmups_(num_warmups), 
     keys_(std::vector<key_type>()), 
     vals_(std::vector<Cache::val_type>()), 
     sizes_(std::vector<Cache::size_type>()), 
@@ -156,12 +155,12 @@ Cache::size_type WorkloadGenerator::get_size(unsigned i) const
 
 // performance metrics are more representitive
 // if the cache is already warm
-void WorkloadGenerator::WarmCache()
+void WorkloadGenerator::WarmCache(Cache& cache)
 {
-  cache_.reset();
+  cache.reset();
   for (unsigned i = 0; i < num_warmups_; i++)
   {
-    cache_.set(get_key(i), get_val(i), sizes_.at(i));
+    cache.set(get_key(i), get_val(i), sizes_.at(i));
   }
 }
 
@@ -169,6 +168,12 @@ void WorkloadGenerator::WarmCache()
 // request. More recently added keys are more 
 // likely to be chosen, to mimic temporal locality
 // of actual workload
+unsigned WorkloadGenerator::get_index(unsigned max)
+{
+  std::geometric_distribution<int> dist(0.001);
+  unsigned idx = std::min(unsigned(dist(gen_)) + 1, max);
+  return max - idx;
+}
 
 unsigned WorkloadGenerator::get_total() const
 {
@@ -12,7 +12,6 @@
 
 class WorkloadGenerator {
   private:
-    Cache cache_;
     const unsigned nsets_; 
     const unsigned ngets_;
     const unsigned ndels_;
@@ -35,11 +34,15 @@ class WorkloadGenerator {
   public:
  
     WorkloadGenerator(unsigned nsets, unsigned ngets, unsigned ndels,
-                      unsigned num_warmups, std::string host, std::string port);
+                      unsigned num_warmups);
 
     ~WorkloadGenerator();
 
-    void WarmCache();
+    // fill a cache (networked or in-process) with the warmup keys
+    void WarmCache(Cache& cache);
+
+    // pick the index of the key for a get, among the first max keys set
+    unsigned get_index(unsigned max);
 
     // these functions allow limited extrnal access (read only) to private data
     key_type get_key(unsigned i) const;
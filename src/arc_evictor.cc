@@ -0,0 +1,208 @@
+/*
+ * Implementation of an ARC_Evictor according to the declarations in arc_evictor.hh
+ * This follows Megiddo and Modha's ARC, with the cache size c taken as the
+ * most items tracked at once, since the evictor doesn't know how many items
+ * the cache's memory will hold. The resident lists are made of
+ * the items' hooks, like in Intrusive_LRU_Evictor; a hook's meta_ tells
+ * which one it is in.
+ */
+
+#include "arc_evictor.hh"
+#include <algorithm>
+
+static const uint32_t IN_T2 = 1;
+
+bool
+ARC_Evictor::Ghost_List::remove(uint32_t hash)
+{
+  auto it = index_.find(hash);
+  if (it == index_.end()) return false;
+  order_.erase(it->second);
+  index_.erase(it);
+  return true;
+}
+
+void
+ARC_Evictor::Ghost_List::push(uint32_t hash)
+{
+  remove(hash);
+  order_.push_front(hash);
+  index_[hash] = order_.begin();
+}
+
+void
+ARC_Evictor::Ghost_List::pop_oldest()
+{
+  index_.erase(order_.back());
+  order_.pop_back();
+}
+
+ARC_Evictor::ARC_Evictor()
+{
+  t1_.prev_ = t1_.next_ = &t1_;
+  t2_.prev_ = t2_.next_ = &t2_;
+}
+
+// append a hook at the most recent end of a resident list
+void
+ARC_Evictor::push(Evictor_Hook& list, Evictor_Hook& hook)
+{
+  hook.prev_ = list.prev_;
+  hook.next_ = &list;
+  list.prev_->next_ = &hook;
+  list.prev_ = &hook;
+  if (&list == &t2_)
+  {
+    hook.meta_ = IN_T2;
+    t2_size_++;
+  }
+  else
+  {
+    hook.meta_ = 0;
+    t1_size_++;
+  }
+}
+
+void
+ARC_Evictor::unlink(Evictor_Hook& hook)
+{
+  hook.prev_->next_ = hook.next_;
+  hook.next_->prev_ = hook.prev_;
+  hook.prev_ = hook.next_ = nullptr;
+  if (hook.meta_ == IN_T2) t2_size_--;
+  else t1_size_--;
+}
+
+// Keep |T1| + |B1| and |T2| + |B2| within c each, so that the ghost lists
+// never hold more hashes than the cache holds items.
+void
+ARC_Evictor::trim_ghosts()
+{
+  c_ = std::max(c_, t1_size_ + t2_size_);
+  while (b1_.size() > 0 && t1_size_ + b1_.size() > c_) b1_.pop_oldest();
+  while (b2_.size() > 0 && t2_size_ + b2_.size() > c_) b2_.pop_oldest();
+}
+
+// The target size of T1 once a key with this hash comes back: larger after
+// a hit in B1, smaller after one in B2, each time by the ratio of the
+// ghost lists' sizes (at least 1).
+std::size_t
+ARC_Evictor::adapted_target(uint32_t hash) const
+{
+  const std::size_t c = std::max(c_, t1_size_ + t2_size_ + 1);
+  if (b1_.size() > 0 && b1_.index_.count(hash))
+  {
+    return std::min(c, p_ + std::max<std::size_t>(b2_.size() / b1_.size(), 1));
+  }
+  if (b2_.size() > 0 && b2_.index_.count(hash))
+  {
+    const std::size_t delta = std::max<std::size_t>(b1_.size() / b2_.size(), 1);
+    return p_ > delta ? p_ - delta : 0;
+  }
+  return p_;
+}
+
+// ARC's REPLACE: whether the next victim comes from T1 rather than T2.
+// While making room for a key in B2, T1 also gives one up when it is at
+// its target, which the B2 hit is about to lower.
+bool
+ARC_Evictor::replace_from_t1() const
+{
+  if (t1_size_ == 0) return false;
+  if (t2_size_ == 0) return true;
+  if (!incoming_) return t1_size_ > p_;
+  const std::size_t p = adapted_target(incoming_hash_);
+  const bool in_b2 = b2_.size() > 0 && b2_.index_.count(incoming_hash_);
+  return t1_size_ > p || (in_b2 && t1_size_ == p);
+}
+
+void
+ARC_Evictor::touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size)
+{
+  if (hook.next_ == nullptr)
+  {
+    insert_item(hook, key, size);
+    return;
+  }
+  unlink(hook);
+  push(t2_, hook);
+}
+
+void
+ARC_Evictor::insert_item(Evictor_Hook& hook, const key_type& key, std::size_t)
+{
+  if (hook.next_ != nullptr) unlink(hook);
+  const uint32_t hash = key_hash(key);
+  hook.key_hash_ = hash;
+  incoming_ = false;
+  // a key evicted too early from T1 lets T1 grow, and one from T2 lets T2 grow
+  p_ = adapted_target(hash);
+  if (b1_.remove(hash) || b2_.remove(hash)) push(t2_, hook);
+  else push(t1_, hook);
+  trim_ghosts();
+}
+
+bool
+ARC_Evictor::admit(const key_type& key)
+{
+  incoming_hash_ = key_hash(key);
+  incoming_ = true;
+  return true;
+}
+
+// Deletes and overwrites aren't evictions, so the hash isn't remembered:
+// a B2 entry for a deleted key would shrink T1 for no reason.
+void
+ARC_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (hook.next_ != nullptr) unlink(hook);
+}
+
+Evictor_Hook*
+ARC_Evictor::evict_item()
+{
+  if (t1_size_ + t2_size_ == 0) return nullptr;
+  const bool from_t1 = replace_from_t1();
+  Evictor_Hook* hook = from_t1 ? t1_.next_ : t2_.next_;
+  unlink(*hook);
+  if (from_t1) b1_.push(hook->key_hash_);
+  else b2_.push(hook->key_hash_);
+  trim_ghosts();
+  return hook;
+}
+
+// oldest hook of a resident list that accept takes
+static Evictor_Hook*
+find_in(Evictor_Hook& list, const Evictor_Filter& accept)
+{
+  for (Evictor_Hook* hook = list.next_; hook != &list; hook = hook->next_)
+  {
+    if (accept(*hook)) return hook;
+  }
+  return nullptr;
+}
+
+Evictor_Hook*
+ARC_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  const bool t1_first = replace_from_t1();
+  Evictor_Hook* hook = find_in(t1_first ? t1_ : t2_, accept);
+  if (hook == nullptr) hook = find_in(t1_first ? t2_ : t1_, accept);
+  if (hook == nullptr) return nullptr;
+  const bool from_t1 = hook->meta_ != IN_T2;
+  unlink(*hook);
+  if (from_t1) b1_.push(hook->key_hash_);
+  else b2_.push(hook->key_hash_);
+  trim_ghosts();
+  return hook;
+}
+
+// a list node holds two pointers and the hash, and a map entry the next
+// pointer and the pair, plus about one bucket
+std::size_t
+ARC_Evictor::item_overhead(std::size_t) const
+{
+  const std::size_t list_node = 2 * sizeof(void*) + sizeof(uint32_t);
+  const std::size_t map_entry = sizeof(void*) + sizeof(decltype(Ghost_List::index_)::value_type) + sizeof(void*);
+  return 2 * (list_node + map_entry);
+}
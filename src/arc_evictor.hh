@@ -0,0 +1,92 @@
+/*
+ * Declarations for an ARC (Adaptive Replacement Cache) evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * Items seen once sit in the recency list T1, items seen again in the
+ * frequency list T2. Keys evicted from either list are remembered, by hash
+ * only, in the ghost lists B1 and B2. A new key found in B1 means T1 was
+ * too short, one found in B2 that T2 was; the target size p of T1 moves
+ * accordingly, so the evictor shifts between favouring recency (as LRU
+ * does) and favouring frequency (which resists scans) as the load changes.
+ * Like Intrusive_LRU_Evictor, it only works through the item calls of the
+ * interface.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+class ARC_Evictor : public Evictor {
+  private:
+    // LRU list of key hashes, searchable by hash
+    struct Ghost_List {
+      std::list<uint32_t> order_;     // most recent first
+      std::unordered_map<uint32_t, std::list<uint32_t>::iterator> index_;
+
+      bool remove(uint32_t hash);
+      void push(uint32_t hash);
+      void pop_oldest();
+      std::size_t size() const { return order_.size(); }
+    };
+
+    // sentinels of the circular resident lists, least recent first
+    Evictor_Hook t1_;
+    Evictor_Hook t2_;
+    std::size_t t1_size_ = 0;
+    std::size_t t2_size_ = 0;
+    Ghost_List b1_;
+    Ghost_List b2_;
+    std::size_t p_ = 0;               // target size of T1
+    std::size_t c_ = 0;               // most items tracked at once, standing in for the cache size
+
+    // hash of the key the cache is evicting for, as told by admit, until
+    // its item is inserted
+    uint32_t incoming_hash_ = 0;
+    bool incoming_ = false;
+
+    void push(Evictor_Hook& list, Evictor_Hook& hook);
+    void unlink(Evictor_Hook& hook);
+    void trim_ghosts();
+    std::size_t adapted_target(uint32_t hash) const;
+    bool replace_from_t1() const;
+  public:
+    ARC_Evictor();
+    ~ARC_Evictor() = default;
+    ARC_Evictor(const ARC_Evictor&) = delete;
+    ARC_Evictor& operator=(const ARC_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // moves a tracked item to the front of T2, or adds a new one like insert_item
+    void touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size) override;
+
+    // adds a new item to T1, or to T2 if its key is in a ghost list,
+    // adapting p to the ghost hit
+    void insert_item(Evictor_Hook& hook, const key_type& key, std::size_t) override;
+
+    // notes the key that the next evictions make room for, so that they
+    // can tell a ghost hit in B2; always admits it
+    bool admit(const key_type& key) override;
+
+    // unlinks an item, if it is linked
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // evicts the oldest item of T1 if T1 is over its target size, or at it
+    // while making room for a key in B2, otherwise the oldest of T2, and
+    // remembers its hash in the matching ghost list
+    Evictor_Hook* evict_item() override;
+
+    // the same, taking the oldest accepted item of the list chosen, or of
+    // the other list if the chosen one has none
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    // two ghost entries, each a list node and a map entry, as B1 and B2
+    // together may hold up to twice c hashes
+    std::size_t item_overhead(std::size_t) const override;
+
+    // current target size of T1, in items
+    std::size_t target() const { return p_; }
+};
@@ -90,7 +90,6 @@ get_bl(std::string request, unsigned get_val_counter, unsigned del_val_counter,
     ky = wg.get_key(set_val_counter-1);
     sz = wg.get_size(set_val_counter-1);
     vl = wg.get_val(set_val_counter-1);
-    std::scoped_lock guard(mutx);
     start = std::chrono::steady_clock::now();
     cache.set(ky, vl, sz);
     end = std::chrono::steady_clock::now();
@@ -110,7 +109,6 @@ get_bl(std::string request, unsigned get_val_counter, unsigned del_val_counter,
   else
   {
     ky = wg.get_key(del_val_counter-1);
-    std::scoped_lock guard(mutx);
     start = std::chrono::steady_clock::now();
     cache.del(ky);
     end = std::chrono::steady_clock::now();
@@ -202,18 +200,57 @@ void doit(unsigned t)
   std::cout << "THREADS: " << nthreads << std::endl;
 
 
-  WorkloadGenerator wg(nsets, ngets, ndels, warmups, server, port);
-  //wg.WarmCache();
-  //auto hr = get_hit_rate(wg, Cache(server, port));
+  WorkloadGenerator wg(nsets, ngets, ndels, warmups);
+  Cache cache(server, port);
+  //wg.WarmCache(cache);
+  //auto hr = get_hit_rate(wg, cache);
   //std::cout << "hit rate: " << hr << std::endl;
-  wg.WarmCache();
+  wg.WarmCache(cache);
   std::pair<double, double> res = threaded_performance(nthreads, nreq, wg, server, port);
   std::cout << "95 percentile: " << res.first << std::endl;
   std::cout << "mean throughput: " << res.second << std::endl;
 }
 
-int main()
+// Throughput of gets of large values from one client, which is where any
+// copy of the value on its way out of the server shows. The server needs a
+// maxmem of a few MiB to hold them all.
+void large_values(std::string server, std::string port)
+{
+  const unsigned ngets = 2000;
+  Cache cache(server, port);
+  std::cout << "LARGE VALUES" << std::endl;
+  for (Cache::size_type size : {1 << 10, 1 << 14, 1 << 17, 1 << 19})
+  {
+    const std::string val(size, 'v');
+    const key_type key = "large" + std::to_string(size);
+    if (!cache.set(key, val.data(), size))
+    {
+      std::cout << size << " bytes: not stored" << std::endl;
+      continue;
+    }
+    Cache::size_type sz = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < ngets; ++i)
+    {
+      auto x = cache.get(key, sz);
+      assert(x != nullptr && sz == size);
+      delete[] x;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    double time = std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1,1>>>(end - start).count();
+    std::cout << size << " bytes: " << ngets / time << " gets/s, "
+              << ngets * double(size) / time / (1 << 20) << " MiB/s" << std::endl;
+  }
+}
+
+// With "large" as argument, only measure gets of large values
+int main(int argc, char** argv)
 {
+  if (argc > 1 && std::string(argv[1]) == "large")
+  {
+    large_values("127.0.0.1", "65413");
+    return 0;
+  }
   for (unsigned i = 2; i < 9; ++i)
   {
     doit(i);
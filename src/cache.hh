@@ -5,10 +5,14 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "evictor.hh"
+#include "slab_allocator.hh"
 
 class Cache {
  private:
@@ -20,11 +24,91 @@ class Cache {
  public:
   using byte_type = char;
   using val_type = const byte_type*;   // Values for K-V pairs
-  using size_type = uint32_t;         // Internal indexing to K-V elements
+  using size_type = uint64_t;         // Sizes of values and of the cache's memory
 
   // A function that takes a key and returns an index to the internal data
   using hash_func = std::function<std::size_t(key_type)>;
 
+  // Time to live of a value; zero means it never expires
+  using ttl_type = std::chrono::milliseconds;
+
+  // Longest time to live: a longer one is cut down to it
+  static constexpr ttl_type MAX_TTL = std::chrono::hours(24 * 30);
+
+  // A function that creates a fresh evictor, called once per shard
+  using evictor_factory = std::function<Evictor*()>;
+
+  // Counters kept by each shard of the store, to check that keys (and load)
+  // are spread evenly between the shards.
+  struct shard_stats {
+    uint64_t items = 0;      // number of keys stored in the shard
+    uint64_t bytes = 0;      // memory used by the shard's values
+    uint64_t memory = 0;     // memory charged to the shard's budget (see space_used)
+    uint64_t hits = 0;       // gets that found their key
+    uint64_t misses = 0;     // gets that didn't
+    uint64_t sets = 0;       // successful insertions
+    uint64_t evictions = 0;  // keys removed by the shard's evictor
+    uint64_t rejections = 0; // sets refused by the evictor's admission policy
+    uint64_t expired = 0;    // keys removed because their TTL ran out
+    uint64_t expired_bytes = 0;  // memory reclaimed from those keys' values
+  };
+
+  // Usage of one slab size class (chunk size, used/free chunks, wasted bytes)
+  using slab_class_stats = Slab_Class_Stats;
+
+  // A reference to a value returned by get, which keeps the value's bytes
+  // alive until the handle is destroyed or reset, even if the key is deleted,
+  // overwritten or evicted meanwhile. Handles can be moved but not copied,
+  // and must not outlive the cache they came from.
+  class handle {
+   public:
+    handle() = default;
+    handle(handle&& other) noexcept { *this = std::move(other); }
+    handle& operator=(handle&& other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(owner_, other.owner_);
+        std::swap(pin_, other.pin_);
+        std::swap(release_, other.release_);
+      }
+      return *this;
+    }
+    handle(const handle&) = delete;
+    handle& operator=(const handle&) = delete;
+    ~handle() { reset(); }
+
+    val_type data() const { return data_; }
+    size_type size() const { return size_; }
+    explicit operator bool() const { return data_ != nullptr; }
+
+    // Let go of the value early
+    void reset()
+    {
+      if (release_ != nullptr) release_(owner_, pin_);
+      data_ = nullptr;
+      size_ = 0;
+      owner_ = pin_ = nullptr;
+      release_ = nullptr;
+    }
+
+   private:
+    friend class Impl;
+    using release_func = void (*)(void* owner, void* pin);
+
+    handle(val_type data, size_type size, void* owner, void* pin, release_func release)
+      : data_(data), size_(size), owner_(owner), pin_(pin), release_(release) {}
+
+    val_type data_ = nullptr;
+    size_type size_ = 0;
+    void* owner_ = nullptr;
+    void* pin_ = nullptr;
+    release_func release_ = nullptr;
+  };
+
   // There are two possible constructors, one for a cache object (library),
   // that initializes the actual cache store, and another for a client
   // that simply accesses the Cache store over the network. The two
@@ -32,15 +116,37 @@ class Cache {
 
 
   // Create a new cache object with the following parameters:
-  // maxmem: The maximum allowance for storage used by values.
-  // max_load_factor: Maximum allowed ratio between buckets and table rows.
+  // maxmem: The maximum allowance for memory used by the stored items: their
+  // keys and values, item headers, index entries and whatever the evictor
+  // keeps for each of them.
+  // max_load_factor: Maximum allowed ratio between items and index slots
+  // (capped at 7/8).
   // evictor: Eviction policy implementation (if nullptr, no evictions occur
   // and new insertions fail after maxmem has been exceeded).
   // hasher: Hash function to use on the keys. Defaults to C++'s std::hash.
+  // slab_growth_factor: Ratio between the chunk sizes of consecutive slab
+  // classes that values are stored in. Smaller factors waste less memory
+  // per value but need more classes.
+  // expected_items: Number of keys to size the index for up front, so that
+  // filling the cache up to that many keys never resizes it.
   Cache(size_type maxmem,
         float max_load_factor = 0.75,
         Evictor* evictor = nullptr,
-        hash_func hasher = std::hash<key_type>());
+        hash_func hasher = std::hash<key_type>(),
+        float slab_growth_factor = 1.25,
+        size_type expected_items = 0);
+
+  // Create a new cache object split into nshards independently locked
+  // shards. Keys are routed to a shard by hash. Each shard gets an equal
+  // part of maxmem and its own evictor from make_evictor (if nullptr, no
+  // evictions occur). The other parameters are the same as above.
+  Cache(size_type maxmem,
+        evictor_factory make_evictor,
+        unsigned nshards,
+        float max_load_factor = 0.75,
+        hash_func hasher = std::hash<key_type>(),
+        float slab_growth_factor = 1.25,
+        size_type expected_items = 0);
 
   // Create a new Cache networked client with a given host and port.
   Cache(std::string host, std::string port);
@@ -56,21 +162,56 @@ class Cache {
   // Both the key and the value are to be deep-copied (not just pointer copied).
   // If maxmem capacity is exceeded, enough values will be removed
   // from the cache to accomodate the new value. If unable, the new value
-  // isn't inserted to the cache.
-  void set(key_type key, val_type val, size_type size);
+  // isn't inserted to the cache. Values larger than a slab page (1 MiB)
+  // are never inserted. The evictor may also reject a new value rather
+  // than evict others for it (see Evictor::admit).
+  // If ttl is positive, the value expires once ttl has passed: gets stop
+  // finding it, and it is removed on its next get or within a fraction of a
+  // second by a background thread, whichever comes first. A ttl longer
+  // than MAX_TTL counts as MAX_TTL.
+  // Returns whether the value was inserted.
+  bool set(key_type key, val_type val, size_type size, ttl_type ttl = ttl_type::zero());
 
   // Retrieve a pointer to the value associated with key in the cache,
   // or nullptr if not found.
   // Sets the actual size of the returned value (in bytes) in val_size.
+  // The pointer is only valid until the key is next set, deleted or evicted;
+  // use the overload below when other threads may change the cache.
   val_type get(key_type key, size_type& val_size) const;
 
+  // Retrieve a handle to the value associated with key in the cache, or an
+  // empty handle if not found. The value stays valid as long as the handle.
+  handle get(key_type key) const;
+
+  // Retrieve handles to the values of many keys at once, one per key in the
+  // same order, empty for keys not found. Cheaper than a get per key: the
+  // library takes each shard's lock once for all of its keys, and the
+  // client asks the server in a single request.
+  std::vector<handle> get_many(const std::vector<key_type>& keys) const;
+
+  // Whether key is in the cache, as a get would find it, but without
+  // counting a hit or miss or telling the evictor of the access, for
+  // callers that only check a key before setting it.
+  bool contains(key_type key) const;
+
   // Delete an object from the cache, if it's still there
   bool del(key_type key);
 
-  // Compute the total amount of memory used up by all cache values (not keys)
+  // Compute the total amount of memory used up by all cache items, as counted
+  // against maxmem: keys and values along with the memory the cache and its
+  // evictor spend on each item.
   size_type space_used() const;
 
+  // Compute the total amount of memory used up by all cache values alone
+  size_type value_space_used() const;
+
   // Delete all data from the cache
   void reset();
+
+  // Report the counters of every shard, in shard order
+  std::vector<shard_stats> stats() const;
+
+  // Report the usage of every slab class holding values, smallest first
+  std::vector<slab_class_stats> slab_stats() const;
 };
 
@@ -26,6 +26,7 @@
 #include <functional>
 #include <thread>
 #include <vector>
+#include <limits>
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -48,12 +49,19 @@ class Cache::Impl
     ~Impl();
     Impl(const Impl&) = delete;
     Impl& operator=(const Impl&) = delete;
-    void set(key_type key, Cache::val_type val, Cache::size_type size);
-    std::pair<Cache::val_type, Cache::size_type> parse_get(const std::string jstring) const;
+    bool set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl);
     Cache::val_type get(key_type key, Cache::size_type& val_size) const;
+    Cache::handle get(key_type key) const;
+    std::vector<Cache::handle> get_many(const std::vector<key_type>& keys) const;
+    static Cache::handle owning_handle(Cache::val_type val, Cache::size_type size);
+    bool contains(key_type key) const;
     bool del(key_type key);
+    Cache::size_type head_number(const char* field) const;
     Cache::size_type space_used() const;
+    Cache::size_type value_space_used() const;
     void reset();
+    std::vector<Cache::shard_stats> stats() const;
+    std::vector<Cache::slab_class_stats> slab_stats() const;
 };
 
 Cache::Impl::Impl(std::string host, std::string port)
@@ -81,17 +89,26 @@ Cache::~Cache(){}
   // If maxmem capacity is exceeded, enough values will be removed
   // from the cache to accomodate the new value. If unable, the new value
   // isn't inserted to the cache and no values are removed.
-void 
-Cache::Impl::set(key_type key, Cache::val_type val, Cache::size_type size)
+  // A positive ttl is sent along in seconds, for the server to expire the value.
+  // Returns whether the server stored the value.
+bool
+Cache::Impl::set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl)
 {
   auto const results = resolver_.resolve(host_, port_);
   stream_.connect(results);
 
-  // Set up an HTTP PUT request message and send
-  std::string target = "/" + key + "/" + val;
+  // Set up an HTTP PUT request message and send, with the value's bytes
+  // as its body
+  std::string target = "/" + key;
 
   http::request<http::string_body> req{http::verb::put, target, 11};
-  req.set("Size", size);
+  req.set(http::field::content_type, "application/octet-stream");
+  req.body().assign(val, size);
+  req.prepare_payload();
+  if (ttl > Cache::ttl_type::zero())
+  {
+    req.set("TTL", std::to_string(std::chrono::duration<double>(ttl).count()));
+  }
   req.keep_alive(true);
   http::write(stream_, req);
 
@@ -100,23 +117,9 @@ Cache::Impl::set(key_type key, Cache::val_type val, Cache::size_type size)
   http::response<http::string_body> res = {}; 
   http::read(stream_, buffer, res);
 
+  return res["Set-Bool"] == "true";
 }
 
-// parse the json string to get the val and size
-std::pair<Cache::val_type, Cache::size_type> 
-Cache::Impl::parse_get(const std::string jstring) const
-{
-  std::string strval = jstring.substr(jstring.rfind(":")+3);
-  strval.pop_back();
-  strval.pop_back();
-  Cache::size_type size = strval.length()+1;
-  const auto sval = strval.c_str();
-  auto val = new char[size];
-  std::copy(sval, sval+size, val);
-  return std::make_pair(val, size);
-}
-
-
   // Retrieve a pointer to the value associated with key in the cache,
   // or nullptr if not found.
   // Sets the actual size of the returned value (in bytes) in val_size.
@@ -138,21 +141,125 @@ Cache::Impl::get(key_type key, Cache::size_type& val_size) const
   http::response<http::string_body> res = {};
   http::read(stream_, buffer, res);
 
-  // parse the jstring to get the value
-  // now get the size
   if (res.result() == http::status::not_found)
   {
     assert(res.body() ==  "Key not in cache\n");
     return nullptr;
   }
-  auto jstring = res.body();
-  auto val_and_size_pair = parse_get(jstring);
-  val_size = val_and_size_pair.second;
-  Cache::val_type val = val_and_size_pair.first;
+  // the body is the value's raw bytes
+  val_size = res.body().size();
+  auto val = new Cache::byte_type[val_size];
+  std::copy(res.body().begin(), res.body().end(), val);
   return val;
 }
 
 
+  // Retrieve a handle to the value associated with key in the cache, or an
+  // empty handle if not found. The handle owns the copy received from the
+  // server and frees it when released.
+Cache::handle
+Cache::Impl::get(key_type key) const
+{
+  Cache::size_type size = 0;
+  Cache::val_type val = get(key, size);
+  if (val == nullptr) return Cache::handle();
+  return owning_handle(val, size);
+}
+
+  // A handle that owns a value allocated with new[], and frees it when
+  // released
+Cache::handle
+Cache::Impl::owning_handle(Cache::val_type val, Cache::size_type size)
+{
+  return Cache::handle(val, size, nullptr, const_cast<Cache::byte_type*>(val),
+                       [](void*, void* pin) { delete[] static_cast<Cache::byte_type*>(pin); });
+}
+
+// Length prefixes of the key list and values of a multi-get, and the prefix
+// of a value not found
+static const std::size_t LENGTH_SIZE = 4;
+static const uint32_t MISSING = 0xFFFFFFFF;
+
+static void
+append_length(std::string& out, uint32_t len)
+{
+  for (int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>(len >> shift & 0xFF);
+}
+
+static uint32_t
+read_length(const char* data)
+{
+  uint32_t len = 0;
+  for (std::size_t i = 0; i < LENGTH_SIZE; i++) len = len << 8 | static_cast<unsigned char>(data[i]);
+  return len;
+}
+
+  // Retrieve handles to the values of many keys, one per key in the same
+  // order, empty for keys not found. The keys are sent in one POST to
+  // /mget, each after its length as 4 bytes, big endian. The response holds
+  // each key's value, in order, after its length in the same form, or just
+  // the length 0xFFFFFFFF for a key not found.
+std::vector<Cache::handle>
+Cache::Impl::get_many(const std::vector<key_type>& keys) const
+{
+  auto const results = resolver_.resolve(host_, port_);
+  stream_.connect(results);
+
+  http::request<http::string_body> req{http::verb::post, "/mget", 11};
+  req.set(http::field::content_type, "application/octet-stream");
+  for (const auto& key : keys)
+  {
+    append_length(req.body(), key.size());
+    req.body() += key;
+  }
+  req.prepare_payload();
+  req.keep_alive(true);
+  http::write(stream_, req);
+
+  // the values may add up to more than a parser takes by default
+  beast::flat_buffer buffer;
+  http::response_parser<http::string_body> parser;
+  parser.body_limit(std::numeric_limits<std::uint64_t>::max());
+  http::read(stream_, buffer, parser);
+  const std::string& body = parser.get().body();
+
+  std::vector<Cache::handle> values(keys.size());
+  std::size_t pos = 0;
+  for (auto& value : values)
+  {
+    if (body.size() - pos < LENGTH_SIZE) break;
+    const uint32_t len = read_length(body.data() + pos);
+    pos += LENGTH_SIZE;
+    if (len == MISSING) continue;
+    if (body.size() - pos < len) break;
+    auto val = new Cache::byte_type[len];
+    std::copy(body.begin() + pos, body.begin() + pos + len, val);
+    value = owning_handle(val, len);
+    pos += len;
+  }
+  return values;
+}
+
+  // Whether key is in the cache, asked with a HEAD request for the key,
+  // which the server answers without counting a hit or miss
+bool
+Cache::Impl::contains(key_type key) const
+{
+  auto const results = resolver_.resolve(host_, port_);
+  stream_.connect(results);
+
+  std::string target = "/" + key;
+  http::request<http::string_body> req{http::verb::head, target, 11};
+  req.keep_alive(true);
+  http::write(stream_, req);
+
+  beast::flat_buffer buffer;
+  http::response<http::empty_body> res;
+  http::read(stream_, buffer, res);
+
+  return res.result() == http::status::ok;
+}
+
   // Delete an object from the cache, if it's still there
 bool 
 Cache::Impl::del(key_type key)
@@ -179,14 +286,14 @@ Cache::Impl::del(key_type key)
   return delBool;
 }
 
-  // Compute the total amount of memory used up by all cache values (not keys)
-Cache::size_type 
-Cache::Impl::space_used() const
+  // Ask the server for one of the memory figures of its stats response
+Cache::size_type
+Cache::Impl::head_number(const char* field) const
 {
   auto const results = resolver_.resolve(host_, port_);
   stream_.connect(results);
 
-  // Set up an HTTP GET request message and send
+  // Set up an HTTP HEAD request message and send
   std::string target = "/";
   http::request<http::string_body> req{http::verb::head, target, 11};
   req.keep_alive(true);
@@ -197,11 +304,22 @@ Cache::Impl::space_used() const
   http::response<http::empty_body> res;
   http::read(stream_, buffer, res);
 
-  // get the space used
-  auto strInt = res.at("Space-Used").to_string();
-  auto used = std::stoi(strInt);
+  return std::stoull(res.at(field).to_string());
+}
 
-  return used;
+  // Compute the total amount of memory used up by all cache items, as
+  // counted against the server's maxmem
+Cache::size_type
+Cache::Impl::space_used() const
+{
+  return head_number("Space-Used");
+}
+
+  // Compute the total amount of memory used up by all cache values alone
+Cache::size_type
+Cache::Impl::value_space_used() const
+{
+  return head_number("Value-Space-Used");
 }
 
   // Delete all data from the cache
@@ -225,10 +343,104 @@ Cache::Impl::reset()
   assert(res.result() == http::status::ok);
 }
 
+// split a comma separated list of counters from a stats header
+static std::vector<uint64_t>
+parse_counters(const std::string& field)
+{
+  std::vector<uint64_t> res;
+  std::size_t start = 0;
+  while (start < field.size())
+  {
+    auto end = field.find(",", start);
+    if (end == std::string::npos) end = field.size();
+    res.push_back(std::stoull(field.substr(start, end - start)));
+    start = end + 1;
+  }
+  return res;
+}
+
+  // Report the counters of every shard, in shard order
+std::vector<Cache::shard_stats>
+Cache::Impl::stats() const
+{
+  auto const results = resolver_.resolve(host_, port_);
+  stream_.connect(results);
+
+  // the shard counters come back as headers of a HEAD request
+  std::string target = "/";
+  http::request<http::string_body> req{http::verb::head, target, 11};
+  req.keep_alive(true);
+  http::write(stream_, req);
+
+  beast::flat_buffer buffer;
+  http::response<http::empty_body> res;
+  http::read(stream_, buffer, res);
+
+  const unsigned nshards = std::stoul(res.at("Shard-Count").to_string());
+  std::vector<Cache::shard_stats> stats(nshards);
+  const auto items = parse_counters(res.at("Shard-Items").to_string());
+  const auto bytes = parse_counters(res.at("Shard-Bytes").to_string());
+  const auto memory = parse_counters(res.at("Shard-Memory").to_string());
+  const auto hits = parse_counters(res.at("Shard-Hits").to_string());
+  const auto misses = parse_counters(res.at("Shard-Misses").to_string());
+  const auto sets = parse_counters(res.at("Shard-Sets").to_string());
+  const auto evictions = parse_counters(res.at("Shard-Evictions").to_string());
+  const auto rejections = parse_counters(res.at("Shard-Rejections").to_string());
+  const auto expired = parse_counters(res.at("Shard-Expired").to_string());
+  const auto expired_bytes = parse_counters(res.at("Shard-Expired-Bytes").to_string());
+  for (unsigned i = 0; i < nshards; i++)
+  {
+    stats[i].items = items.at(i);
+    stats[i].bytes = bytes.at(i);
+    stats[i].memory = memory.at(i);
+    stats[i].hits = hits.at(i);
+    stats[i].misses = misses.at(i);
+    stats[i].sets = sets.at(i);
+    stats[i].evictions = evictions.at(i);
+    stats[i].rejections = rejections.at(i);
+    stats[i].expired = expired.at(i);
+    stats[i].expired_bytes = expired_bytes.at(i);
+  }
+  return stats;
+}
+
+  // Report the usage of every slab class holding values, smallest first
+std::vector<Cache::slab_class_stats>
+Cache::Impl::slab_stats() const
+{
+  auto const results = resolver_.resolve(host_, port_);
+  stream_.connect(results);
+
+  std::string target = "/";
+  http::request<http::string_body> req{http::verb::head, target, 11};
+  req.keep_alive(true);
+  http::write(stream_, req);
+
+  beast::flat_buffer buffer;
+  http::response<http::empty_body> res;
+  http::read(stream_, buffer, res);
+
+  const auto chunk_sizes = parse_counters(res.at("Slab-Chunk-Sizes").to_string());
+  const auto pages = parse_counters(res.at("Slab-Pages").to_string());
+  const auto used = parse_counters(res.at("Slab-Used-Chunks").to_string());
+  const auto free = parse_counters(res.at("Slab-Free-Chunks").to_string());
+  const auto wasted = parse_counters(res.at("Slab-Wasted-Bytes").to_string());
+  std::vector<Cache::slab_class_stats> stats(chunk_sizes.size());
+  for (unsigned i = 0; i < stats.size(); i++)
+  {
+    stats[i].chunk_size = chunk_sizes[i];
+    stats[i].pages = pages.at(i);
+    stats[i].used_chunks = used.at(i);
+    stats[i].free_chunks = free.at(i);
+    stats[i].wasted_bytes = wasted.at(i);
+  }
+  return stats;
+}
+
 /* here are the cache methods, all they do is call the corresponding Impl methods */
-void Cache::set(key_type key, Cache::val_type val, Cache::size_type size)
+bool Cache::set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl)
 {
-  return pImpl_->set(key, val, size);
+  return pImpl_->set(key, val, size, ttl);
 }
 
 Cache::val_type Cache::get(key_type key, Cache::size_type& val_size) const
@@ -236,6 +448,21 @@ Cache::val_type Cache::get(key_type key, Cache::size_type& val_size) const
   return pImpl_->get(key, val_size);
 }
 
+Cache::handle Cache::get(key_type key) const
+{
+  return pImpl_->get(key);
+}
+
+std::vector<Cache::handle> Cache::get_many(const std::vector<key_type>& keys) const
+{
+  return pImpl_->get_many(keys);
+}
+
+bool Cache::contains(key_type key) const
+{
+  return pImpl_->contains(key);
+}
+
 bool Cache::del(key_type key)
 {
   return pImpl_->del(key);
@@ -246,7 +473,22 @@ Cache::size_type Cache::space_used() const
   return pImpl_->space_used();
 }
 
+Cache::size_type Cache::value_space_used() const
+{
+  return pImpl_->value_space_used();
+}
+
 void Cache::reset()
 {
   return pImpl_->reset();
 }
+
+std::vector<Cache::shard_stats> Cache::stats() const
+{
+  return pImpl_->stats();
+}
+
+std::vector<Cache::slab_class_stats> Cache::slab_stats() const
+{
+  return pImpl_->slab_stats();
+}
@@ -0,0 +1,74 @@
+/*
+ * Layout of an item stored in the cache.
+ * Each item lives in a single slab chunk: this header, then the key bytes,
+ * then the value bytes. An entry therefore costs one allocation however long
+ * its key is, and the index only needs to keep a pointer to it.
+ *
+ * Items are reference counted. The index holds one reference while the item
+ * is linked, and every Cache::handle handed out by a get holds another, so
+ * an item unlinked by a delete or an eviction is only freed once the last
+ * reader is done with it.
+ *
+ * Items with a TTL are also linked into their shard's timing wheel, through
+ * the wheel_* fields, and the shard's evictor may keep its own links in the
+ * hook at the start of the item.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <string_view>
+#include <type_traits>
+#include "evictor.hh"
+
+struct Item {
+  Evictor_Hook hook_;      // first, so that the item can be found from its hook
+  uint64_t hash_;      // full hash of the key, kept for resizes and quick compares
+  uint32_t key_len_;
+  uint32_t val_size_;
+  std::atomic<uint32_t> refcount_;
+  uint32_t wheel_slot_;    // slot of the timing wheel holding the item, if any
+  uint64_t expires_;       // expiry time in ms of the cache's clock, 0 for never
+  Item* wheel_prev_;
+  Item* wheel_next_;
+
+  static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+  // Items are built in place at the start of a chunk, with one reference
+  // held by whoever links them into the index.
+  Item(uint64_t hash, uint32_t key_len, uint32_t val_size, uint64_t expires = 0)
+    : hash_(hash), key_len_(key_len), val_size_(val_size), refcount_(1),
+      wheel_slot_(NO_SLOT), expires_(expires), wheel_prev_(nullptr), wheel_next_(nullptr) {}
+
+  // Bytes needed to store an item with the given key and value sizes
+  static std::size_t size_for(std::size_t key_len, std::size_t val_size)
+  {
+    return sizeof(Item) + key_len + val_size;
+  }
+
+  std::size_t total_size() const { return size_for(key_len_, val_size_); }
+
+  char* key_data() { return reinterpret_cast<char*>(this + 1); }
+  const char* key_data() const { return reinterpret_cast<const char*>(this + 1); }
+  std::string_view key() const { return std::string_view(key_data(), key_len_); }
+
+  char* value() { return key_data() + key_len_; }
+  const char* value() const { return key_data() + key_len_; }
+
+  // The item whose hook an evictor handed back
+  static Item* from_hook(Evictor_Hook* hook) { return reinterpret_cast<Item*>(hook); }
+  static const Item* from_hook(const Evictor_Hook* hook) { return reinterpret_cast<const Item*>(hook); }
+
+  bool expired(uint64_t now) const { return expires_ != 0 && expires_ <= now; }
+
+  bool matches(std::string_view key, uint64_t hash) const
+  {
+    return hash_ == hash && key_len_ == key.size()
+      && std::memcmp(key_data(), key.data(), key_len_) == 0;
+  }
+};
+
+static_assert(std::is_standard_layout<Item>::value && offsetof(Item, hook_) == 0,
+              "Item::from_hook needs the hook at the start of the item");
@@ -1,64 +1,232 @@
 /*
  * Implementaion for promised interface in cache.hh
  * Uses the pImpl idiom to hide details from the user.
+ * The store is split into shards, each guarded by its own lock, so that
+ * threads working on different keys rarely wait for each other.
+ * Items (key and value together) live in chunks of a slab allocator shared
+ * by all shards, and each shard finds them through an open-addressing index.
+ * Each item is charged to its shard's budget for its whole footprint: the
+ * slab chunk holding it (header, key and value, rounded up to the chunk
+ * size), its index entry and what the evictor keeps for it. As the arena
+ * is as large as the budgets together, the budget runs out before the
+ * slabs do, and the evictor picks the victims, as long as the values keep
+ * the same sizes.
+ * Items with a TTL also sit in their shard's timing wheel, which a
+ * background thread advances to remove them once they expire. The same
+ * thread moves part of any index resize along on each tick, so that a
+ * shard that only serves gets doesn't keep probing two tables.
+ * Gets don't touch the evictor themselves (unless it takes concurrent
+ * touches): they record the touch in the shard's touch buffer, which is
+ * drained into the evictor when a ring fills up, and before anything that
+ * may remove items, so that the buffer never points to a removed item.
  */
 #include <utility>
+#include <algorithm>
 #include <memory>
 #include <cassert>
 #include <string.h>
 #include <iostream>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
 #include "cache.hh"
+#include "cache_item.hh"
+#include "hash_index.hh"
+#include "timing_wheel.hh"
+#include "touch_buffer.hh"
 #include "fifo_evictor.hh"
 
-class Cache::Impl 
+// Attempts a set makes at getting a slab chunk once the value's class is
+// full: a chunk freed for it can still be pinned by a handle, or be taken
+// by a set in another shard
+static const unsigned SLAB_TRIES = 8;
+
+// Groups of an index being resized that the expirer moves on each tick:
+// enough to finish a resize of millions of slots in seconds, while
+// holding the shard's lock for no more than tens of microseconds
+static const std::size_t EXPIRER_REHASH_GROUPS = 1024;
+
+class Cache::Impl
 {
   private:
+    // One independently locked part of the store, with its own table,
+    // memory budget and evictor. Gets only take the lock shared, and buffer
+    // their touches unless the evictor handles concurrent touches itself;
+    // draining the buffer under the shared lock is serialized by
+    // evict_mutx_.
+    struct Shard
+    {
+      const Cache::size_type maxmem_;
+      int64_t remmem_;
+      uint64_t value_bytes_ = 0;
+      Evictor* evictor_;
+      const bool lock_touches_;
+      Hash_Index tbl_;
+      Timing_Wheel wheel_;
+      Touch_Buffer touches_;
+      mutable std::shared_mutex mutx_;
+      std::mutex evict_mutx_;
+      mutable std::atomic<uint64_t> hits_{0};
+      mutable std::atomic<uint64_t> misses_{0};
+      uint64_t sets_ = 0;
+      uint64_t evictions_ = 0;
+      uint64_t rejections_ = 0;
+      uint64_t expired_ = 0;
+      uint64_t expired_bytes_ = 0;
+      const Slab_Allocator& slabs_;
+      std::vector<uint64_t> class_items_;   // items whose chunk is of each slab class
+
+      Shard(Cache::size_type maxmem, float max_load_factor, Evictor* evictor, Cache::size_type expected_items,
+            const Slab_Allocator& slabs)
+        : maxmem_(maxmem), remmem_(maxmem), evictor_(evictor),
+          lock_touches_(evictor != nullptr && !evictor->concurrent_touch()), tbl_(max_load_factor),
+          slabs_(slabs), class_items_(slabs.class_count(), 0)
+      {
+        tbl_.reserve(expected_items);
+        if (evictor_ == nullptr) return;
+        evictor_->set_sampler([this](uint64_t rnd) -> Evictor_Hook* {
+          Item* item = tbl_.sample(rnd);
+          return item == nullptr ? nullptr : &item->hook_;
+        });
+      }
+
+      // memory charged to the budget for an item with these key and value
+      // sizes (whose size_for must be at most slabs_.max_size())
+      std::size_t footprint(std::size_t key_len, std::size_t val_size) const
+      {
+        return slabs_.chunk_size(Item::size_for(key_len, val_size)) + Hash_Index::ENTRY_SIZE
+          + (evictor_ ? evictor_->item_overhead(key_len) : 0);
+      }
+
+      std::size_t footprint(const Item& item) const { return footprint(item.key_len_, item.val_size_); }
+    };
+
     const Cache::size_type maxmem_;
-    int64_t remmem_;
     const float max_load_factor_;
-    Evictor* evictor_;
     const Cache::hash_func hasher_;
-    std::unordered_map<key_type, std::pair<Cache::val_type, Cache::size_type>, Cache::hash_func> tbl_;
-    std::mutex mutx_;
+    Slab_Allocator slabs_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    // the clock that TTLs are measured on, and the thread expiring items
+    const std::chrono::steady_clock::time_point start_;
+    std::thread expirer_;
+    std::mutex expirer_mutx_;
+    std::condition_variable expirer_cv_;
+    bool stopping_ = false;
+
+    uint64_t hash_of(const key_type& key) const;
+    std::size_t shard_index(uint64_t hash) const;
+    Shard& shard_for(uint64_t hash) const;
+    uint64_t now_ms() const;
+    void run_expirer();
+    bool del_locked(Shard& shard, std::string_view key, uint64_t hash);
+    bool evict_one(Shard& shard);
+    bool evict_from_class(Shard& shard, std::size_t item_size);
+    bool make_room(Shard& shard, std::size_t bytes);
+    static void drain_touches(Shard& shard);
+    void expire_locked(Shard& shard, Item* item);
+    const Item* find(key_type key, bool pin) const;
+    const Item* find_locked(Shard& shard, const key_type& key, uint64_t hash, uint64_t now, bool pin, bool& expired) const;
+    void remove_expired(Shard& shard, const key_type& key, uint64_t hash) const;
+    Cache::handle pinned_handle(const Item* item) const;
+    void unref(Item* item);
+    static void release_handle(void* owner, void* pin);
   public:
 
     Impl(Cache::size_type maxmem,
         float max_load_factor = 0.75,
         Evictor* evictor = nullptr,
-        Cache::hash_func hasher = std::hash<key_type>());
+        Cache::hash_func hasher = std::hash<key_type>(),
+        float slab_growth_factor = 1.25,
+        Cache::size_type expected_items = 0);
+    Impl(Cache::size_type maxmem,
+        Cache::evictor_factory make_evictor,
+        unsigned nshards,
+        float max_load_factor = 0.75,
+        Cache::hash_func hasher = std::hash<key_type>(),
+        float slab_growth_factor = 1.25,
+        Cache::size_type expected_items = 0);
     ~Impl();
     Impl(const Impl&) = delete;
     Impl& operator=(const Impl&) = delete;
-    void set(key_type key, Cache::val_type val, Cache::size_type size);
+    bool set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl);
     Cache::val_type get(key_type key, Cache::size_type& val_size) const;
+    Cache::handle get(key_type key) const;
+    std::vector<Cache::handle> get_many(const std::vector<key_type>& keys) const;
+    bool contains(key_type key) const;
     bool del(key_type key);
     Cache::size_type space_used() const;
+    Cache::size_type value_space_used() const;
     void reset();
+    std::vector<Cache::shard_stats> stats() const;
+    std::vector<Cache::slab_class_stats> slab_stats() const;
 };
 
 Cache::Impl::Impl(Cache::size_type maxmem,
         float max_load_factor,
         Evictor* evictor,
-        Cache::hash_func hasher)
-        : maxmem_(maxmem), remmem_(maxmem), max_load_factor_(max_load_factor), 
-          evictor_(evictor), hasher_(hasher), tbl_(5, hasher_), mutx_(std::mutex())
+        Cache::hash_func hasher,
+        float slab_growth_factor,
+        Cache::size_type expected_items)
+        : maxmem_(maxmem), max_load_factor_(max_load_factor), hasher_(hasher),
+          slabs_(maxmem, slab_growth_factor), start_(std::chrono::steady_clock::now())
 {
-  tbl_.max_load_factor(max_load_factor_);
+  shards_.emplace_back(new Shard(maxmem_, max_load_factor_, evictor, expected_items, slabs_));
+  expirer_ = std::thread(&Cache::Impl::run_expirer, this);
+}
+
+Cache::Impl::Impl(Cache::size_type maxmem,
+        Cache::evictor_factory make_evictor,
+        unsigned nshards,
+        float max_load_factor,
+        Cache::hash_func hasher,
+        float slab_growth_factor,
+        Cache::size_type expected_items)
+        : maxmem_(maxmem), max_load_factor_(max_load_factor), hasher_(hasher),
+          slabs_(maxmem, slab_growth_factor), start_(std::chrono::steady_clock::now())
+{
+  assert(nshards > 0);
+  // split maxmem evenly, giving the remainder to the first shards
+  for (unsigned i = 0; i < nshards; i++)
+  {
+    Cache::size_type budget = maxmem_ / nshards + (i < maxmem_ % nshards ? 1 : 0);
+    Evictor* evictor = make_evictor ? make_evictor() : nullptr;
+    shards_.emplace_back(new Shard(budget, max_load_factor_, evictor, expected_items / nshards + 1,
+                                   slabs_));
+  }
+  expirer_ = std::thread(&Cache::Impl::run_expirer, this);
 }
 
   // Create a new cache object with the following parameters:
-  // maxmem: The maximum allowance for storage used by values.
-  // max_load_factor: Maximum allowed ratio between buckets and table rows.
+  // maxmem: The maximum allowance for memory used by items, overhead included.
+  // max_load_factor: Maximum allowed ratio between items and index slots
+  // (capped at 7/8).
   // evictor: Eviction policy implementation (if nullptr, no evictions occur
   // and new insertions fail after maxmem has been exceeded).
   // hasher: Hash function to use on the keys. Defaults to C++'s std::hash.
+  // slab_growth_factor: Ratio between the chunk sizes of consecutive slab classes.
+  // expected_items: Number of keys to size the index for up front.
 Cache::Cache(Cache::size_type maxmem,
         float max_load_factor,
         Evictor* evictor,
-        Cache::hash_func hasher)
-        : pImpl_(new Cache::Impl(maxmem, max_load_factor, evictor, hasher))
+        Cache::hash_func hasher,
+        float slab_growth_factor,
+        Cache::size_type expected_items)
+        : pImpl_(new Cache::Impl(maxmem, max_load_factor, evictor, hasher, slab_growth_factor, expected_items))
+{}
+
+  // Create a new cache object split into nshards shards, each with an equal
+  // part of maxmem and its own evictor built by make_evictor.
+Cache::Cache(Cache::size_type maxmem,
+        Cache::evictor_factory make_evictor,
+        unsigned nshards,
+        float max_load_factor,
+        Cache::hash_func hasher,
+        float slab_growth_factor,
+        Cache::size_type expected_items)
+        : pImpl_(new Cache::Impl(maxmem, make_evictor, nshards, max_load_factor, hasher, slab_growth_factor, expected_items))
 {}
 
   // Constructor for networked cache client, only defined in cache_client.cc
@@ -69,114 +237,536 @@ Cache::Cache(Cache::size_type maxmem,
 
 Cache::Impl::~Impl()
 {
-  for (auto it = tbl_.begin(); it != tbl_.end(); it++)
   {
-    delete[] it->second.first;
+    std::scoped_lock guard(expirer_mutx_);
+    stopping_ = true;
   }
-  if (evictor_ != nullptr){
-    delete evictor_;
+  expirer_cv_.notify_one();
+  expirer_.join();
+  // items go away with the slab arena
+  for (auto& shard : shards_)
+  {
+    if (shard->evictor_ != nullptr){
+      delete shard->evictor_;
+    }
   }
 }
 
 Cache::~Cache(){}
 
 
+  // Hash a key with the user's hash function, then mix the bits so that
+  // both the shard (high bits) and the index (low bits) get good ones even
+  // from a weak hasher.
+uint64_t
+Cache::Impl::hash_of(const key_type& key) const
+{
+  uint64_t h = hasher_(key);
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+  // Pick the shard responsible for a key hash
+std::size_t
+Cache::Impl::shard_index(uint64_t hash) const
+{
+  return (hash >> 32) % shards_.size();
+}
+
+Cache::Impl::Shard&
+Cache::Impl::shard_for(uint64_t hash) const
+{
+  return *shards_[shard_index(hash)];
+}
+
+  // Milliseconds since the cache was created, never 0 (which means "no
+  // expiry" in an item)
+uint64_t
+Cache::Impl::now_ms() const
+{
+  auto elapsed = std::chrono::steady_clock::now() - start_;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() + 1;
+}
+
+  // Body of the expiry thread: every wheel tick, move each shard's wheel up
+  // to the current time and remove the items that came due, and move a
+  // resize of its index along.
+void
+Cache::Impl::run_expirer()
+{
+  std::unique_lock guard(expirer_mutx_);
+  while (!expirer_cv_.wait_for(guard, std::chrono::milliseconds(Timing_Wheel::TICK_MS),
+                               [this] { return stopping_; }))
+  {
+    const uint64_t now = now_ms();
+    for (auto& shard : shards_)
+    {
+      std::unique_lock shard_guard(shard->mutx_);
+      drain_touches(*shard);
+      shard->wheel_.advance(now, [&](Item* item) { expire_locked(*shard, item); });
+      if (shard->tbl_.rehashing()) shard->tbl_.rehash_step(EXPIRER_REHASH_GROUPS);
+    }
+  }
+}
+
+
   // Add a <key, value> pair to the cache.
   // If key already exists, it will overwrite the old value.
   // Both the key and the value are deep-copied.
   // If maxmem capacity is exceeded, enough values will be removed
   // from the cache to accomodate the new value. If unable, the new value
   // isn't inserted to the cache and no values are removed.
-void 
-Cache::Impl::set(key_type key, Cache::val_type val, Cache::size_type size)
+  // If the value's slab class has no free chunk left, an empty page moves
+  // over from another class, or else the evictor's first victim of that
+  // class is evicted; the chunk is taken before anything is evicted for
+  // the budget. Values evicted for a chunk are only lost to a failed set
+  // if they were pinned by handles, or their chunks went to other sets.
+  // Before evicting anything, the evictor gets to reject the new key.
+  // A positive ttl schedules the value on the shard's timing wheel, at
+  // most MAX_TTL ahead.
+  // Returns whether the value was inserted.
+bool
+Cache::Impl::set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl)
 {
   assert(key != ""); /* key cant be empty string */
-  del(key); // prevents unnecessary eviction in the case of an overwrite.
-  if (size > maxmem_) return; 
-  if (remmem_ - size < 0)
+  const uint64_t hash = hash_of(key);
+  Shard& shard = shard_for(hash);
+  const std::size_t item_size = Item::size_for(key.size(), size);
+  const std::size_t charge = shard.footprint(key.size(), size);
+
+  std::unique_lock guard(shard.mutx_);
+  drain_touches(shard);
+  del_locked(shard, key, hash); // prevents unnecessary eviction in the case of an overwrite.
+  if (size > shard.maxmem_ || charge > shard.maxmem_ || item_size > slabs_.max_size()) return false;
+  const bool fits = shard.remmem_ >= int64_t(charge);
+  if (!fits && shard.evictor_ == nullptr) return false;
+  bool admitted = false;
+  auto admit = [&]() {
+    if (!admitted && !shard.evictor_->admit(key))
+    {
+      shard.rejections_++;
+      return false;
+    }
+    return admitted = true;
+  };
+  // the chunk comes first, so that nothing is evicted for the budget of a
+  // set that can't get one
+  void* chunk = slabs_.allocate(item_size);
+  for (unsigned tries = 0; chunk == nullptr && tries < SLAB_TRIES; tries++)
+  {
+    if (!slabs_.reassign_page(item_size)
+        && (!shard.evictor_ || !admit() || !evict_from_class(shard, item_size))) return false;
+    chunk = slabs_.allocate(item_size);
+  }
+  if (chunk == nullptr) return false;
+  if (shard.remmem_ < int64_t(charge) && (!admit() || !make_room(shard, charge)))
+  {
+    slabs_.free(chunk, item_size);
+    return false;
+  }
+  const uint64_t expires = ttl > Cache::ttl_type::zero() ? now_ms() + std::min(ttl, Cache::MAX_TTL).count() : 0;
+  Item* item = new (chunk) Item(hash, key.size(), size, expires);
+  std::copy(key.begin(), key.end(), item->key_data());
+  std::copy(val, val+size, item->value()); /*assumes user includes space for 0 termination if passing a string */
+  shard.tbl_.insert(item);
+  shard.class_items_[slabs_.class_index(item_size)]++;
+  if (expires != 0) shard.wheel_.schedule(item);
+  shard.remmem_ -= charge;
+  shard.value_bytes_ += size;
+  shard.sets_++;
+  if (shard.evictor_) shard.evictor_->insert_item(item->hook_, key, charge);
+  return true;
+}
+
+
+  // Look up a key, counting the hit or miss and touching the evictor.
+  // If pin is set, a found item comes back with an extra reference that the
+  // caller must drop with unref.
+  // An expired item counts as a miss, and is removed on the spot rather
+  // than left for the expiry thread.
+const Item*
+Cache::Impl::find(key_type key, bool pin) const
+{
+  const uint64_t hash = hash_of(key);
+  Shard& shard = shard_for(hash);
+  std::shared_lock guard(shard.mutx_);
+  bool expired = false;
+  const Item* item = find_locked(shard, key, hash, now_ms(), pin, expired);
+  if (expired)
+  {
+    guard.unlock();
+    remove_expired(shard, key, hash);
+  }
+  return item;
+}
+
+  // The lookup of find, in a shard whose lock the caller holds shared. An
+  // expired item comes back as nullptr with expired set, for the caller to
+  // remove once it has let go of the lock.
+const Item*
+Cache::Impl::find_locked(Shard& shard, const key_type& key, uint64_t hash, uint64_t now, bool pin, bool& expired) const
+{
+  Item* item = shard.tbl_.find(key, hash);
+  if (item == nullptr || item->expired(now))
   {
-    if (evictor_ == nullptr) return;
-    else
+    shard.misses_.fetch_add(1, std::memory_order_relaxed);
+    expired = item != nullptr;
+    return nullptr;
+  }
+  // the index's own reference keeps the item alive while the lock is held
+  if (pin) item->refcount_.fetch_add(1, std::memory_order_relaxed);
+  shard.hits_.fetch_add(1, std::memory_order_relaxed);
+  if (shard.lock_touches_)
+  {
+    // a full ring is drained by whoever finds it full, if the evictor is
+    // free; otherwise the touch is dropped
+    if (!shard.touches_.record(item))
     {
-      key_type evictKey;
-      while (remmem_ - size < 0)
+      std::unique_lock evict_guard(shard.evict_mutx_, std::try_to_lock);
+      if (evict_guard.owns_lock())
       {
-        evictKey = evictor_->evict();
-        if (evictKey != "") del(evictKey); 
+        drain_touches(shard);
+        shard.touches_.record(item);
       }
     }
   }
-  Cache::byte_type* theVal = new Cache::byte_type[size]; /*assumes user includes space for 0 termination if passing a string */
-  std::copy(val,val+size, theVal);
-  auto pr = std::make_pair(theVal,size);
+  else if (shard.evictor_)
   {
-    std::scoped_lock guard(mutx_);
-    tbl_[key] = pr;
-    remmem_ -= size;
+    shard.evictor_->touch_item(item->hook_, key, shard.footprint(*item));
   }
-  if (!evictor_) return;
-  evictor_->touch_key(key);
-  return;
+  return item;
 }
 
+  // Remove a key found expired, unless it was set again in between.
+  // Removing needs the shard's lock exclusively.
+void
+Cache::Impl::remove_expired(Shard& shard, const key_type& key, uint64_t hash) const
+{
+  std::unique_lock guard(shard.mutx_);
+  drain_touches(shard);
+  Item* item = shard.tbl_.find(key, hash);
+  if (item != nullptr && item->expired(now_ms()))
+  {
+    const_cast<Cache::Impl*>(this)->expire_locked(shard, item);
+  }
+}
+
+  // Drop a reference to an item, freeing its chunk if it was the last one
+void
+Cache::Impl::unref(Item* item)
+{
+  if (item->refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    slabs_.free(item, item->total_size());
+  }
+}
+
+  // Release function of the handles given out by get
+void
+Cache::Impl::release_handle(void* owner, void* pin)
+{
+  static_cast<Cache::Impl*>(owner)->unref(static_cast<Item*>(pin));
+}
 
   // Retrieve a pointer to the value associated with key in the cache,
   // or nullptr if not found.
   // Sets the actual size of the returned value (in bytes) in val_size.
+  // The pointer is only valid until the key is next set, deleted or evicted.
 Cache::val_type
 Cache::Impl::get(key_type key, Cache::size_type& val_size) const
 {
-  auto val = tbl_.find(key);
-  if (val == tbl_.end()) return nullptr;
-  if (evictor_) evictor_->touch_key(key);
-  val_size = val->second.second;
-  return val->second.first;
+  const Item* item = find(key, false);
+  if (item == nullptr) return nullptr;
+  val_size = item->val_size_;
+  return item->value();
 }
 
+  // Retrieve a handle to the value associated with key in the cache, or an
+  // empty handle if not found. The item can't be freed before the handle.
+Cache::handle
+Cache::Impl::get(key_type key) const
+{
+  const Item* item = find(key, true);
+  if (item == nullptr) return Cache::handle();
+  return pinned_handle(item);
+}
 
-  // Delete an object from the cache, if it's still there
-bool 
-Cache::Impl::del(key_type key)
+  // Retrieve handles to the values of many keys at once, in the order of the
+  // keys. The keys are looked up shard by shard: each shard's lock is taken
+  // once for all of its keys, and their index slots are prefetched before
+  // the first of them is looked up.
+std::vector<Cache::handle>
+Cache::Impl::get_many(const std::vector<key_type>& keys) const
+{
+  std::vector<Cache::handle> values(keys.size());
+  std::vector<uint64_t> hashes(keys.size());
+  std::vector<std::size_t> order(keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++)
+  {
+    hashes[i] = hash_of(keys[i]);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [this, &hashes](std::size_t a, std::size_t b) {
+    return shard_index(hashes[a]) < shard_index(hashes[b]);
+  });
+
+  std::vector<std::size_t> expired;
+  for (std::size_t begin = 0, end = 0; begin < order.size(); begin = end)
+  {
+    const std::size_t index = shard_index(hashes[order[begin]]);
+    while (end < order.size() && shard_index(hashes[order[end]]) == index) end++;
+    Shard& shard = *shards_[index];
+    {
+      std::shared_lock guard(shard.mutx_);
+      for (std::size_t i = begin; i < end; i++) shard.tbl_.prefetch(hashes[order[i]]);
+      const uint64_t now = now_ms();
+      for (std::size_t i = begin; i < end; i++)
+      {
+        const std::size_t k = order[i];
+        bool is_expired = false;
+        const Item* item = find_locked(shard, keys[k], hashes[k], now, true, is_expired);
+        if (item != nullptr) values[k] = pinned_handle(item);
+        else if (is_expired) expired.push_back(k);
+      }
+    }
+    for (std::size_t k : expired) remove_expired(shard, keys[k], hashes[k]);
+    expired.clear();
+  }
+  return values;
+}
+
+  // A handle on an item found with pin set, which takes over its reference
+Cache::handle
+Cache::Impl::pinned_handle(const Item* item) const
+{
+  return Cache::handle(item->value(), item->val_size_, const_cast<Cache::Impl*>(this),
+                       const_cast<Item*>(item), &Cache::Impl::release_handle);
+}
+
+
+  // Remove a key from a shard whose lock is already held exclusively.
+bool
+Cache::Impl::del_locked(Shard& shard, std::string_view key, uint64_t hash)
 {
-  auto val = tbl_.find(key);
-  if (val == tbl_.end()) return false;
-  auto size = val->second.second;
-  std::scoped_lock guard(mutx_);
-  delete[] val->second.first;
-  if (tbl_.erase(key))
+  Item* item = shard.tbl_.erase(key, hash);
+  if (item == nullptr) return false;
+  shard.wheel_.cancel(item);
+  if (shard.evictor_) shard.evictor_->erase_item(item->hook_, key_type(key));
+  shard.remmem_ += shard.footprint(*item);
+  shard.value_bytes_ -= item->val_size_;
+  shard.class_items_[slabs_.class_index(item->total_size())]--;
+  assert(uint64_t(shard.remmem_) <= shard.maxmem_);
+  unref(item);
+  return true;
+}
+
+  // Ask a shard's evictor for a victim, by item or by key, and remove it.
+  // Returns false if the evictor had nothing to offer.
+bool
+Cache::Impl::evict_one(Shard& shard)
+{
+  Evictor_Hook* hook = shard.evictor_->evict_item();
+  if (hook != nullptr)
   {
-    remmem_ += size;
-    assert(remmem_ <= maxmem_);
+    const Item* victim = Item::from_hook(hook);
+    if (del_locked(shard, victim->key(), victim->hash_)) shard.evictions_++;
     return true;
   }
-  return false; 
+  const key_type evictKey = shard.evictor_->evict();
+  if (evictKey == "") return false;
+  if (del_locked(shard, evictKey, hash_of(evictKey))) shard.evictions_++;
+  return true;
 }
 
-  // Compute the total amount of memory used up by all cache values (not keys)
-Cache::size_type 
+  // Evict one of a shard's items whose chunk is of the slab class of
+  // item_size, giving the class a chunk back: the one the evictor would
+  // evict first of them. Key-based evictors can't be asked for an item of
+  // a class, so their victims go in order until one of the class has.
+  // Returns false if the shard has no item of the class.
+bool
+Cache::Impl::evict_from_class(Shard& shard, std::size_t item_size)
+{
+  const std::size_t cls = slabs_.class_index(item_size);
+  if (shard.class_items_[cls] == 0) return false;
+  Evictor_Hook* hook = shard.evictor_->evict_item_if([this, cls](const Evictor_Hook& hook) {
+    return slabs_.class_index(Item::from_hook(&hook)->total_size()) == cls;
+  });
+  if (hook != nullptr)
+  {
+    const Item* victim = Item::from_hook(hook);
+    if (del_locked(shard, victim->key(), victim->hash_)) shard.evictions_++;
+    return true;
+  }
+  const uint64_t before = shard.class_items_[cls];
+  while (shard.class_items_[cls] == before)
+  {
+    const key_type evictKey = shard.evictor_->evict();
+    if (evictKey == "") return false;
+    if (del_locked(shard, evictKey, hash_of(evictKey))) shard.evictions_++;
+  }
+  return true;
+}
+
+  // Hand the touches buffered by gets over to a shard's evictor. The caller
+  // holds the shard's lock exclusively, or shared along with evict_mutx_.
+void
+Cache::Impl::drain_touches(Shard& shard)
+{
+  if (!shard.lock_touches_) return;
+  shard.touches_.drain([&shard](Item* item) {
+    shard.evictor_->touch_item(item->hook_, key_type(item->key()), shard.footprint(*item));
+  });
+}
+
+  // Evict from a shard whose lock is already held exclusively until its
+  // budget has room for bytes more bytes. Victims come in batches, all
+  // unlinked under the one lock hold. Returns false if the evictor runs out
+  // of victims first.
+bool
+Cache::Impl::make_room(Shard& shard, std::size_t bytes)
+{
+  const Evictor_Sizer size_of = [&shard](const Evictor_Hook& hook) -> std::size_t {
+    return shard.footprint(*Item::from_hook(&hook));
+  };
+  while (shard.remmem_ < int64_t(bytes))
+  {
+    const auto batch = shard.evictor_->evict_batch(bytes - shard.remmem_, size_of);
+    if (batch.empty())
+    {
+      // key-based evictors hand out one key at a time
+      if (!evict_one(shard)) return false;
+      continue;
+    }
+    for (Evictor_Hook* hook : batch)
+    {
+      const Item* victim = Item::from_hook(hook);
+      if (del_locked(shard, victim->key(), victim->hash_)) shard.evictions_++;
+    }
+  }
+  return true;
+}
+
+  // Remove an expired item from a shard whose lock is already held
+  // exclusively, counting it in the shard's expiry stats.
+void
+Cache::Impl::expire_locked(Shard& shard, Item* item)
+{
+  shard.expired_++;
+  shard.expired_bytes_ += item->val_size_;
+  del_locked(shard, item->key(), item->hash_);
+}
+
+  // Look key up like find, but leave the stats and the evictor alone. An
+  // expired item is left to gets and the expirer to remove.
+bool
+Cache::Impl::contains(key_type key) const
+{
+  const uint64_t hash = hash_of(key);
+  Shard& shard = shard_for(hash);
+  std::shared_lock guard(shard.mutx_);
+  const Item* item = shard.tbl_.find(key, hash);
+  return item != nullptr && !item->expired(now_ms());
+}
+
+  // Delete an object from the cache, if it's still there
+bool
+Cache::Impl::del(key_type key)
+{
+  const uint64_t hash = hash_of(key);
+  Shard& shard = shard_for(hash);
+  std::unique_lock guard(shard.mutx_);
+  drain_touches(shard);
+  return del_locked(shard, key, hash);
+}
+
+  // Compute the total amount of memory used up by all cache items, as
+  // counted against maxmem
+Cache::size_type
 Cache::Impl::space_used() const
 {
-  return maxmem_ - remmem_;
+  int64_t remmem = 0;
+  for (auto& shard : shards_)
+  {
+    std::shared_lock guard(shard->mutx_);
+    remmem += shard->remmem_;
+  }
+  return maxmem_ - remmem;
+}
+
+  // Compute the total amount of memory used up by all cache values alone
+Cache::size_type
+Cache::Impl::value_space_used() const
+{
+  Cache::size_type used = 0;
+  for (auto& shard : shards_)
+  {
+    std::shared_lock guard(shard->mutx_);
+    used += shard->value_bytes_;
+  }
+  return used;
 }
 
   // Delete all data from the cache
 void
 Cache::Impl::reset()
 {
-  std::scoped_lock guard(mutx_);
-  for (auto it = tbl_.begin(); it != tbl_.end(); it++)
+  for (auto& shard : shards_)
   {
-    delete[] it->second.first;
+    std::unique_lock guard(shard->mutx_);
+    drain_touches(*shard);
+    shard->wheel_.clear();
+    shard->tbl_.for_each([this, &shard](Item* item) {
+      if (shard->evictor_) shard->evictor_->erase_item(item->hook_, key_type(item->key()));
+      unref(item);
+    });
+    shard->tbl_.clear();
+    shard->remmem_ = shard->maxmem_;
+    shard->value_bytes_ = 0;
+    std::fill(shard->class_items_.begin(), shard->class_items_.end(), 0);
   }
-  tbl_.clear();
-  remmem_ = maxmem_;
   return;
 }
 
+  // Report the counters of every shard, in shard order
+std::vector<Cache::shard_stats>
+Cache::Impl::stats() const
+{
+  std::vector<Cache::shard_stats> res;
+  res.reserve(shards_.size());
+  for (auto& shard : shards_)
+  {
+    std::shared_lock guard(shard->mutx_);
+    Cache::shard_stats st;
+    st.items = shard->tbl_.size();
+    st.bytes = shard->value_bytes_;
+    st.memory = shard->maxmem_ - shard->remmem_;
+    st.hits = shard->hits_.load(std::memory_order_relaxed);
+    st.misses = shard->misses_.load(std::memory_order_relaxed);
+    st.sets = shard->sets_;
+    st.evictions = shard->evictions_;
+    st.rejections = shard->rejections_;
+    st.expired = shard->expired_;
+    st.expired_bytes = shard->expired_bytes_;
+    res.push_back(st);
+  }
+  return res;
+}
+
+  // Report the usage of every slab class holding values, smallest first
+std::vector<Cache::slab_class_stats>
+Cache::Impl::slab_stats() const
+{
+  return slabs_.stats();
+}
+
 /* here are the cache methods, all they do is call the corresponding Impl methods */
-void Cache::set(key_type key, Cache::val_type val, Cache::size_type size)
+bool Cache::set(key_type key, Cache::val_type val, Cache::size_type size, Cache::ttl_type ttl)
 {
-  return pImpl_->set(key, val, size);
+  return pImpl_->set(key, val, size, ttl);
 }
 
 Cache::val_type Cache::get(key_type key, Cache::size_type& val_size) const
@@ -184,6 +774,21 @@ Cache::val_type Cache::get(key_type key, Cache::size_type& val_size) const
   return pImpl_->get(key, val_size);
 }
 
+Cache::handle Cache::get(key_type key) const
+{
+  return pImpl_->get(key);
+}
+
+std::vector<Cache::handle> Cache::get_many(const std::vector<key_type>& keys) const
+{
+  return pImpl_->get_many(keys);
+}
+
+bool Cache::contains(key_type key) const
+{
+  return pImpl_->contains(key);
+}
+
 bool Cache::del(key_type key)
 {
   return pImpl_->del(key);
@@ -194,8 +799,22 @@ Cache::size_type Cache::space_used() const
   return pImpl_->space_used();
 }
 
+Cache::size_type Cache::value_space_used() const
+{
+  return pImpl_->value_space_used();
+}
+
 void Cache::reset()
 {
   return pImpl_->reset();
 }
 
+std::vector<Cache::shard_stats> Cache::stats() const
+{
+  return pImpl_->stats();
+}
+
+std::vector<Cache::slab_class_stats> Cache::slab_stats() const
+{
+  return pImpl_->slab_stats();
+}
@@ -5,12 +5,23 @@
 #include "cache.hh"
 #include "lru_evictor.hh"
 #include "fifo_evictor.hh"
+#include "intrusive_lru_evictor.hh"
+#include "clock_evictor.hh"
+#include "s3fifo_evictor.hh"
+#include "tinylfu_evictor.hh"
+#include "arc_evictor.hh"
+#include "gdsf_evictor.hh"
+#include "sampled_lru_evictor.hh"
+#include "slru_evictor.hh"
+#include "memcache_protocol.hh"
+#include "resp_protocol.hh"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <array>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
@@ -18,6 +29,9 @@
 #include <boost/asio/strand.hpp>
 #include <boost/config.hpp>
 #include <boost/beast/http/fields.hpp>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <cstdlib>
 #include <functional>
 #include <memory>
@@ -26,6 +40,7 @@
 #include <vector>
 #include <string.h>
 #include <cassert>
+#include <sstream>
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -33,6 +48,138 @@ namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
 //std::mutex mutx;
+
+// A response body that sends a cached value straight from the cache's
+// memory, byte for byte. The body holds a handle on the value; a session
+// moves the handle into its Response_Queue (see queue_body), where the
+// value stays pinned until the queue is written. It has no writer, as
+// responses are only ever serialized by queue_body.
+struct pinned_body
+{
+    struct value_type
+    {
+        Cache::handle item;
+    };
+
+    static std::uint64_t
+    size(value_type const& body)
+    {
+        return body.item.size();
+    }
+};
+
+// A response body that sends many cached values straight from the cache's
+// memory, for a multi-get: every value after its length as 4 bytes, big
+// endian, or just the length 0xFFFFFFFF for a key not found. Like
+// pinned_body, its handles are moved into the session's Response_Queue.
+struct pinned_list_body
+{
+    struct value_type
+    {
+        std::vector<Cache::handle> items;   // one per key, empty if not found
+    };
+
+    static constexpr std::uint32_t MISSING = 0xFFFFFFFF;
+
+    // The length that comes before an item
+    static std::array<char, 4>
+    length_of(Cache::handle const& item)
+    {
+        const std::uint32_t len = item ? static_cast<std::uint32_t>(item.size()) : MISSING;
+        return {{static_cast<char>(len >> 24), static_cast<char>(len >> 16),
+                 static_cast<char>(len >> 8), static_cast<char>(len)}};
+    }
+
+    static std::uint64_t
+    size(value_type const& body)
+    {
+        std::uint64_t size = 0;
+        for(auto const& item : body.items)
+            size += 4 + item.size();
+        return size;
+    }
+};
+
+// Split the body of a multi-get into its keys, each after its length as 4
+// bytes, big endian. Returns false if the body isn't such a list.
+static bool
+parse_key_list(const std::string& body, std::vector<key_type>& keys)
+{
+    std::size_t pos = 0;
+    while(pos < body.size())
+    {
+        if(body.size() - pos < 4)
+            return false;
+        std::uint32_t len = 0;
+        for(std::size_t i = 0; i < 4; i++)
+            len = len << 8 | static_cast<unsigned char>(body[pos + i]);
+        pos += 4;
+        if(body.size() - pos < len)
+            return false;
+        keys.emplace_back(body, pos, len);
+        pos += len;
+    }
+    return true;
+}
+
+// Add the per-shard counters to a stats response, one comma separated
+// header per counter with a value for each shard.
+template<class Message>
+void
+set_shard_stats(Message& res, const Cache& cache)
+{
+    const auto stats = cache.stats();
+    std::string items, bytes, memory, hits, misses, sets, evictions, rejections, expired, expired_bytes;
+    for (const auto& st : stats)
+    {
+      const char* sep = items.empty() ? "" : ",";
+      items += sep + std::to_string(st.items);
+      bytes += sep + std::to_string(st.bytes);
+      memory += sep + std::to_string(st.memory);
+      hits += sep + std::to_string(st.hits);
+      misses += sep + std::to_string(st.misses);
+      sets += sep + std::to_string(st.sets);
+      evictions += sep + std::to_string(st.evictions);
+      rejections += sep + std::to_string(st.rejections);
+      expired += sep + std::to_string(st.expired);
+      expired_bytes += sep + std::to_string(st.expired_bytes);
+    }
+    res.set("Shard-Count", std::to_string(stats.size()));
+    res.set("Shard-Items", items);
+    res.set("Shard-Bytes", bytes);
+    res.set("Shard-Memory", memory);
+    res.set("Shard-Hits", hits);
+    res.set("Shard-Misses", misses);
+    res.set("Shard-Sets", sets);
+    res.set("Shard-Evictions", evictions);
+    res.set("Shard-Rejections", rejections);
+    res.set("Shard-Expired", expired);
+    res.set("Shard-Expired-Bytes", expired_bytes);
+}
+
+// Add the usage of every slab class to a stats response, in the same
+// comma separated form as the shard counters.
+template<class Message>
+void
+set_slab_stats(Message& res, const Cache& cache)
+{
+    std::string chunk_sizes, pages, used, free, wasted;
+    for (const auto& st : cache.slab_stats())
+    {
+      const char* sep = chunk_sizes.empty() ? "" : ",";
+      chunk_sizes += sep + std::to_string(st.chunk_size);
+      pages += sep + std::to_string(st.pages);
+      used += sep + std::to_string(st.used_chunks);
+      free += sep + std::to_string(st.free_chunks);
+      wasted += sep + std::to_string(st.wasted_bytes);
+    }
+    res.set("Slab-Chunk-Sizes", chunk_sizes);
+    res.set("Slab-Pages", pages);
+    res.set("Slab-Used-Chunks", used);
+    res.set("Slab-Free-Chunks", free);
+    res.set("Slab-Wasted-Bytes", wasted);
+}
+
 // This function produces an HTTP response for the given
 // request. The type of the response object depends on the
 // contents of the request, so the interface requires the
@@ -67,13 +214,20 @@ handle_request(
       return send(bad_request("Unknown HTTP-method"));
 
     {
+      // HEAD of a key tells whether it is in the cache (without counting
+      // a hit or miss); either way, the response carries the stats
       if (req.method() == http::verb::head)
       {
-        http::response<http::string_body> res{http::status::ok, req.version()};
+        const key_type key(req.target().substr(1));
+        const bool found = key.empty() || cache.contains(key);
+        http::response<http::string_body> res{found ? http::status::ok : http::status::not_found, req.version()};
         res.set(http::field::content_type, "application/json");
         res.set(http::field::accept, "text/html");
         const auto used = std::to_string(cache.space_used());
         res.set("Space-Used", used);
+        res.set("Value-Space-Used", std::to_string(cache.value_space_used()));
+        set_shard_stats(res, cache);
+        set_slab_stats(res, cache);
         res.keep_alive(req.keep_alive());
         return send(std::move(res));
       }
@@ -81,27 +235,28 @@ handle_request(
       // Respond to GET request
       else if (req.method() == http::verb::get)
       {
-        http::response<http::string_body> res{http::status::ok, req.version()};
-        res.set(http::field::content_type, "application/json");
-        res.set(http::field::accept, "text/html");
         const auto used = std::to_string(cache.space_used());
-        res.set("Space-Used", used);
-
-        key_type key = req.target().to_string().substr(1);
-        Cache::size_type size = 0;
-        //mutx.lock();
-        const auto got = cache.get(key, size);
-        //mutx.unlock();
-        if (got == nullptr)
+        const key_type key(req.target().substr(1));
+        auto got = cache.get(key);
+        if (!got)
         {
-          res.result(http::status::not_found);
+          http::response<http::string_body> res{http::status::not_found, req.version()};
+          res.set(http::field::content_type, "application/json");
+          res.set(http::field::accept, "text/html");
+          res.set("Space-Used", used);
           res.body() = "Key not in cache\n"; // or some other error message
-        } 
-        else 
-        {
-          assert(got != nullptr);
-          res.body() = "{ \"key\" : \"" + key + "\", \"value\" : \"" + got + "\"}";
+          res.prepare_payload();
+          res.keep_alive(req.keep_alive());
+          return send(std::move(res));
         }
+
+        // the value's raw bytes are written from the cache's memory, pinned
+        // by the handle
+        http::response<pinned_body> res{http::status::ok, req.version()};
+        res.set(http::field::content_type, "application/octet-stream");
+        res.set(http::field::accept, "text/html");
+        res.set("Space-Used", used);
+        res.body().item = std::move(got);
         res.prepare_payload();
         res.keep_alive(req.keep_alive());
         return send(std::move(res));
@@ -110,28 +265,30 @@ handle_request(
 
       else if (req.method() == http::verb::put)
       {
-        // get the key-value pair
-        std::string kvp = req.target().to_string().substr(1);
-
-        // get the key
-        key_type key = kvp.substr(0, kvp.find("/"));
-
-        // get the value
-        const std::string strval = kvp.substr(kvp.find("/")+1);
-        const Cache::size_type size = strval.length()+1;
-        const auto sval = strval.c_str();
-        assert(size == (strlen(sval)+1));
-        auto val = new char[size];
-        std::copy(sval,sval+size, val);
-        //{
-        //std::scoped_lock guard(mutx);
-        cache.set(key, val, size);
-        //}
-        delete[] val;
+        // an optional TTL header gives the value's time to live in seconds,
+        // cut down to the cache's longest
+        Cache::ttl_type ttl = Cache::ttl_type::zero();
+        if (req.find("TTL") != req.end())
+        {
+          const std::string strttl = req["TTL"].to_string();
+          char* end = nullptr;
+          const double seconds = strtod(strttl.c_str(), &end);
+          if (strttl.empty() || *end != '\0' || !std::isfinite(seconds) || !(seconds >= 0))
+            return send(bad_request("Invalid TTL"));
+          const std::chrono::duration<double> max = Cache::MAX_TTL;
+          ttl = std::chrono::duration_cast<Cache::ttl_type>(std::min(std::chrono::duration<double>(seconds), max));
+        }
+
+        // the target names the key, and the body holds the value's bytes
+        key_type key = req.target().to_string().substr(1);
+        if (key.empty()) return send(bad_request("Missing key"));
+        const bool b = cache.set(key, req.body().data(), req.body().size(), ttl);
         http::response<http::empty_body> res{http::status::ok, req.version()};
         res.set(http::field::content_type, "application/json");
         res.set(http::field::accept, "text/html");
-        
+        // tells the client whether the value was stored
+        res.set("Set-Bool", b ? "true" : "false");
+
         const auto used = std::to_string(cache.space_used());
         res.set("Space-Used", used);
 
@@ -162,6 +319,20 @@ handle_request(
         return send(std::move(res));
       }
 
+      else if (req.method() == http::verb::post && req.target() == "/mget")
+      // look up many keys at once, and answer with all their values
+      {
+        std::vector<key_type> keys;
+        if (!parse_key_list(req.body(), keys)) return send(bad_request("Malformed key list"));
+        http::response<pinned_list_body> res{http::status::ok, req.version()};
+        res.set(http::field::content_type, "application/octet-stream");
+        res.set(http::field::accept, "text/html");
+        res.body().items = cache.get_many(keys);
+        res.prepare_payload();
+        res.keep_alive(req.keep_alive());
+        return send(std::move(res));
+      }
+
       else if (req.method() == http::verb::post)
       // reset the cache
       {
@@ -193,7 +364,42 @@ fail(beast::error_code ec, char const* what)
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
-// Handles an HTTP server connection
+// The body of a response, queued behind its header: text bodies are
+// copied, and cached values are queued pinned so that they are written
+// straight from the cache's memory.
+static void
+queue_body(Response_Queue& out, http::string_body::value_type& body)
+{
+    out.append(body);
+}
+
+static void
+queue_body(Response_Queue&, http::empty_body::value_type&)
+{
+}
+
+static void
+queue_body(Response_Queue& out, pinned_body::value_type& body)
+{
+    out.append_value(std::move(body.item));
+}
+
+static void
+queue_body(Response_Queue& out, pinned_list_body::value_type& body)
+{
+    for(auto& item : body.items)
+    {
+        auto const length = pinned_list_body::length_of(item);
+        out.append(std::string_view(length.data(), length.size()));
+        if(item)
+            out.append_value(std::move(item));
+    }
+}
+
+// Handles an HTTP server connection. Requests a client pipelines are all
+// answered before anything is written: every complete request in the read
+// buffer is handled in turn, its response queued behind the ones before
+// it, and the whole batch is then written with one gathered write.
 class session : public std::enable_shared_from_this<session>
 {
     // This is the C++11 equivalent of a generic lambda.
@@ -208,36 +414,21 @@ class session : public std::enable_shared_from_this<session>
         {
         }
 
-        template<bool isRequest, class Body, class Fields>
+        template<class Body, class Fields>
         void
-        operator()(http::message<isRequest, Body, Fields>&& msg) const
+        operator()(http::response<Body, Fields>&& msg) const
         {
-            // The lifetime of the message has to extend
-            // for the duration of the async operation so
-            // we use a shared_ptr to manage it.
-            auto sp = std::make_shared<
-                http::message<isRequest, Body, Fields>>(std::move(msg));
-
-            // Store a type-erased version of the shared
-            // pointer in the class to keep it alive.
-            self_.res_ = sp;
-
-            // Write the response
-            http::async_write(
-                self_.stream_,
-                *sp,
-                beast::bind_front_handler(
-                    &session::on_write,
-                    self_.shared_from_this(),
-                    sp->need_eof()));
+            self_.queue(std::move(msg));
         }
     };
 
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_;
     Cache& cache_;
-    http::request<http::string_body> req_;
-    std::shared_ptr<void> res_;
+    boost::optional<http::request_parser<http::string_body>> parser_;
+    Response_Queue out_;
+    std::vector<net::const_buffer> buffers_;
+    bool close_ = false;
     send_lambda lambda_;
     //std::mutex& mutx_;
 
@@ -270,15 +461,16 @@ public:
     void
     do_read()
     {
-        // Make the request empty before reading,
-        // otherwise the operation behavior is undefined.
-        req_ = {};
+        // Start on a new request, unless the last batch left the start of
+        // one in the parser
+        if(!parser_)
+            parser_.emplace();
 
         // Set the timeout.
         stream_.expires_after(std::chrono::seconds(30));
 
         // Read a request
-        http::async_read(stream_, buffer_, req_,
+        http::async_read(stream_, buffer_, *parser_,
             beast::bind_front_handler(
                 &session::on_read,
                 shared_from_this()));
@@ -298,30 +490,85 @@ public:
         if(ec)
             return fail(ec, "read");
 
-        // Send the response
-        handle_request(std::move(req_), lambda_, cache_);
+        handle_request(parser_->release(), lambda_, cache_);
+        parser_.reset();
+
+        // Handle the requests pipelined behind it that are already in the
+        // buffer, without waiting on the socket
+        while(!close_ && buffer_.size() > 0)
+        {
+            parser_.emplace();
+            while(buffer_.size() > 0 && !parser_->is_done())
+            {
+                buffer_.consume(parser_->put(buffer_.data(), ec));
+                if(ec)
+                    break;
+            }
+            if(ec && ec != http::error::need_more)
+            {
+                fail(ec, "read");
+                close_ = true;
+                break;
+            }
+            ec = {};
+
+            // The rest of it has yet to arrive
+            if(!parser_->is_done())
+                break;
+            handle_request(parser_->release(), lambda_, cache_);
+            parser_.reset();
+        }
+
+        // Write every response at once, values straight from the cache
+        buffers_.clear();
+        out_.for_each_buffer([this](const char* data, std::size_t size) {
+            buffers_.emplace_back(data, size);
+        });
+        net::async_write(
+            stream_,
+            buffers_,
+            beast::bind_front_handler(
+                &session::on_write,
+                shared_from_this()));
+    }
+
+    // Queue a response behind the ones before it
+    template<class Body, class Fields>
+    void
+    queue(http::response<Body, Fields>&& res)
+    {
+        // Every response says how long it is, so that the client can tell
+        // where the next one starts
+        res.prepare_payload();
+        typename Fields::writer header(res, res.version(), res.result_int());
+        auto const header_buffers = header.get();
+        for(auto const buf : beast::buffers_range_ref(header_buffers))
+            out_.append(std::string_view(static_cast<const char*>(buf.data()), buf.size()));
+        queue_body(out_, res.body());
+
+        // This means we should close the connection once the response is
+        // written, usually because it indicated the "Connection: close"
+        // semantic, and answer nothing after it.
+        if(res.need_eof())
+            close_ = true;
     }
 
     void
     on_write(
-        bool close,
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
         boost::ignore_unused(bytes_transferred);
 
+        // We're done with the responses so forget them, which also lets go
+        // of any cached value they were pinning
+        out_.clear();
+
         if(ec)
             return fail(ec, "write");
 
-        if(close)
-        {
-            // This means we should close the connection, usually because
-            // the response indicated the "Connection: close" semantic.
+        if(close_)
             return do_close();
-        }
-
-        // We're done with the response so delete it
-        res_ = nullptr;
 
         // Read another request
         do_read();
@@ -340,8 +587,117 @@ public:
 
 //------------------------------------------------------------------------------
 
-// Accepts incoming connections and launches the sessions
-class listener : public std::enable_shared_from_this<listener>
+// Handles a connection on one of the stream protocol ports (memcache, RESP).
+// Whatever the client sent is handed to a Connection (Memcache_Connection
+// or Resp_Connection), which runs every complete command in it; their
+// responses are then written out in one go before reading on.
+template<class Connection>
+class stream_session : public std::enable_shared_from_this<stream_session<Connection>>
+{
+    static constexpr std::size_t READ_SIZE = 16 * 1024;
+
+    tcp::socket socket_;
+    beast::flat_buffer buffer_;
+    Connection conn_;
+    std::vector<net::const_buffer> out_;
+
+public:
+    stream_session(
+        tcp::socket&& socket,
+        Cache& cache)
+        : socket_(std::move(socket))
+        , conn_(cache)
+    {
+    }
+
+    // Start the asynchronous operation
+    void
+    run()
+    {
+        net::dispatch(socket_.get_executor(),
+                      beast::bind_front_handler(
+                          &stream_session::do_read,
+                          this->shared_from_this()));
+    }
+
+private:
+    void
+    do_read()
+    {
+        socket_.async_read_some(
+            buffer_.prepare(READ_SIZE),
+            beast::bind_front_handler(
+                &stream_session::on_read,
+                this->shared_from_this()));
+    }
+
+    void
+    on_read(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        // This means they closed the connection
+        if(ec == net::error::eof)
+            return;
+
+        if(ec)
+            return fail(ec, "read");
+
+        buffer_.commit(bytes_transferred);
+        const auto data = buffer_.data();
+        buffer_.consume(conn_.consume(static_cast<const char*>(data.data()), data.size()));
+        if(conn_.empty())
+        {
+            if(conn_.closing())
+                return do_close();
+            return do_read();
+        }
+
+        // Write every response at once, values straight from the cache
+        out_.clear();
+        conn_.for_each_buffer([this](const char* data, std::size_t size) {
+            out_.emplace_back(data, size);
+        });
+        net::async_write(
+            socket_,
+            out_,
+            beast::bind_front_handler(
+                &stream_session::on_write,
+                this->shared_from_this()));
+    }
+
+    void
+    on_write(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        // Unpin the values just written
+        conn_.clear();
+
+        if(ec)
+            return fail(ec, "write");
+
+        if(conn_.closing())
+            return do_close();
+
+        do_read();
+    }
+
+    void
+    do_close()
+    {
+        beast::error_code ec;
+        socket_.shutdown(tcp::socket::shutdown_send, ec);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Accepts incoming connections and launches a Session for each
+template<class Session>
+class listener : public std::enable_shared_from_this<listener<Session>>
 {
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
@@ -413,7 +769,7 @@ private:
             net::make_strand(ioc_),
             beast::bind_front_handler(
                 &listener::on_accept,
-                shared_from_this()));
+                this->shared_from_this()));
     }
 
     void
@@ -436,8 +792,13 @@ private:
             } else {*/
 
 
+            // Sessions write a whole batch of responses at once, so Nagle's
+            // algorithm would only hold back the last part of a batch that
+            // took more than one read
+            socket.set_option(tcp::no_delay(true), ec);
+
             // Create the session and run it
-            std::make_shared<session>(
+            std::make_shared<Session>(
                 std::move(socket), cache_)->run();
             //} //don't forget this to un-comment } ******************
         }
@@ -449,19 +810,149 @@ private:
 
 //------------------------------------------------------------------------------
 
+// Parse an option's number, which must be all of the text and lie within
+// [min, max]. Returns false otherwise.
+static bool
+parse_number(const std::string& text, double min, double max, double& number)
+{
+  char* end = nullptr;
+  number = strtod(text.c_str(), &end);
+  return !text.empty() && *end == '\0' && number >= min && number <= max;
+}
+
+// Parse an option's count, which must be all of the text and positive.
+// Returns false otherwise.
+static bool
+parse_count(const std::string& text, Cache::size_type& count)
+{
+  char* end = nullptr;
+  errno = 0;
+  count = strtoull(text.c_str(), &end, 10);
+  return !text.empty() && std::isdigit(static_cast<unsigned char>(text[0])) && *end == '\0'
+      && errno == 0 && count > 0;
+}
+
+// A number as it would be typed on the command line
+static std::string
+format_number(double number)
+{
+  std::ostringstream out;
+  out << number;
+  return out.str();
+}
+
+// Build the evictor factory for an eviction policy given as name or
+// name:parameter, and describe the effective policy. Returns false if the
+// policy is unknown or its parameter invalid.
+static bool
+parse_evictor(const std::string& spec, Cache::evictor_factory& factory, std::string& description)
+{
+  const auto colon = spec.find(':');
+  const std::string name = spec.substr(0, colon);
+  const bool has_param = colon != std::string::npos;
+  const std::string param = has_param ? spec.substr(colon + 1) : "";
+  double value = 0;
+  factory = nullptr;
+  description = name;
+
+  if (name == "none" || name == "fifo" || name == "lru" || name == "intrusive-lru"
+      || name == "clock" || name == "arc" || name == "gdsf")
+  {
+    if (has_param) return false;
+    if (name == "fifo") factory = []() { return new Fifo_Evictor(); };
+    else if (name == "lru") factory = []() { return new LRU_Evictor(); };
+    else if (name == "intrusive-lru") factory = []() { return new Intrusive_LRU_Evictor(); };
+    else if (name == "clock") factory = []() { return new Clock_Evictor(); };
+    else if (name == "arc") factory = []() { return new ARC_Evictor(); };
+    else if (name == "gdsf") factory = []() { return new GDSF_Evictor(); };
+    if (name == "none") description += " (sets fail once maxmem is reached)";
+    return true;
+  }
+  if (name == "s3fifo")
+  {
+    value = 0.1;
+    // both queues must get a share
+    if (has_param && (!parse_number(param, 0, 1, value) || value == 0 || value == 1)) return false;
+    factory = [value]() { return new S3_Fifo_Evictor(value); };
+    description += " (small queue ratio " + format_number(value) + ")";
+    return true;
+  }
+  if (name == "tinylfu")
+  {
+    value = 0.01;
+    if (has_param && !parse_number(param, 0, 0.99, value)) return false;
+    factory = [value]() { return new TinyLFU_Evictor(new Intrusive_LRU_Evictor(), value); };
+    description += " (window ratio " + format_number(value) + ", main intrusive-lru)";
+    return true;
+  }
+  if (name == "sampled-lru")
+  {
+    value = 5;
+    if (has_param && (!parse_number(param, 1, 64, value) || value != unsigned(value))) return false;
+    const unsigned samples = value;
+    factory = [samples]() { return new Sampled_LRU_Evictor(samples); };
+    description += " (" + std::to_string(samples) + " samples)";
+    return true;
+  }
+  if (name == "slru")
+  {
+    value = 0.8;
+    if (has_param && !parse_number(param, 0, 1, value)) return false;
+    factory = [value]() { return new SLRU_Evictor(value); };
+    description += " (protected ratio " + format_number(value) + ")";
+    return true;
+  }
+  return false;
+}
+
+// 64-bit FNV-1a, an alternative to the standard library's key hash
+static std::size_t
+fnv1a_hash(key_type key)
+{
+  uint64_t h = 0xCBF29CE484222325ull;
+  for (unsigned char c : key)
+  {
+    h ^= c;
+    h *= 0x100000001B3ull;
+  }
+  return h;
+}
+
 int main(int argc, char** argv)
 {
   Cache::size_type maxmem = 10; 
   int nthreads = 2;
+  unsigned nshards = 16;
+  float growth_factor = 1.25;
+  float load_factor = 0.75;
+  Cache::size_type expected_items = 0;
+  std::string policy = "none";
+  bool policy_given = false;
+  std::string protected_ratio;    // -r, shorthand for -e slru:ratio
+  std::string hash_name = "std";
   unsigned short port = 65413; 
+  unsigned short memcache_port = 0;   // -M, no memcache listener unless given
+  unsigned short resp_port = 0;       // -R, no RESP listener unless given
   auto server = net::ip::make_address("127.0.0.1");
+  auto usage = [argv]() {
+    std::cerr << "usage: " << argv[0] << " [-m maxmem] [-s server] [-p port] [-M memcache port] [-R resp port]"
+              << " [-t threads] [-n shards] [-f slab growth factor] [-i expected items]"
+              << " [-e none|fifo|lru|intrusive-lru|clock|s3fifo[:small ratio]|tinylfu[:window ratio]"
+              << "|arc|gdsf|sampled-lru[:samples]|slru[:protected ratio]]"
+              << " [-r slru protected ratio] [-l load factor] [-H std|fnv1a]" << std::endl;
+    return 1;
+  };
   int opt;
-  while ((opt = getopt(argc, argv, "m:s:p:t:")) != -1) 
+  while ((opt = getopt(argc, argv, "m:s:p:M:R:t:n:f:i:r:e:l:H:")) != -1) 
   {
     switch (opt) 
     {
     case 'm':
-      maxmem = std::atoi(optarg);
+      if (!parse_count(optarg, maxmem))
+      {
+        std::cerr << "maxmem must be a positive number of bytes" << std::endl;
+        return usage();
+      }
       break;
     case 's':
       server = net::ip::make_address(optarg);
@@ -469,29 +960,120 @@ int main(int argc, char** argv)
     case 'p':
       port = static_cast<unsigned short>(std::atoi(optarg));
       break;
+    case 'M':
+      memcache_port = static_cast<unsigned short>(std::atoi(optarg));
+      break;
+    case 'R':
+      resp_port = static_cast<unsigned short>(std::atoi(optarg));
+      break;
     case 't':
       nthreads = std::atoi(optarg);
       break;
+    case 'n':
+      nshards = std::max(1, std::atoi(optarg));
+      break;
+    case 'f':
+      growth_factor = std::atof(optarg);
+      if (growth_factor <= 1.0)
+      {
+        std::cerr << "growth factor must be greater than 1" << std::endl;
+        return 1;
+      }
+      break;
+    case 'i':
+      if (!parse_count(optarg, expected_items))
+      {
+        std::cerr << "expected items must be a positive number" << std::endl;
+        return usage();
+      }
+      break;
+    case 'r':
+      protected_ratio = optarg;
+      break;
+    case 'e':
+      // eviction policy, as name or name:parameter
+      policy = optarg;
+      policy_given = true;
+      break;
+    case 'l':
+      load_factor = std::atof(optarg);
+      if (load_factor <= 0 || load_factor > 1)
+      {
+        std::cerr << "load factor must be greater than 0 and at most 1" << std::endl;
+        return 1;
+      }
+      break;
+    case 'H':
+      hash_name = optarg;
+      break;
+    default:
+      return usage();
     }
   }
+
+  // -r alone picks SLRU; with -e slru it sets its parameter
+  if (!protected_ratio.empty())
+  {
+    if (policy_given && policy != "slru")
+    {
+      std::cerr << "-r only applies to the slru policy" << std::endl;
+      return 1;
+    }
+    policy = "slru:" + protected_ratio;
+  }
+  Cache::evictor_factory make_evictor;
+  std::string evictor_description;
+  if (!parse_evictor(policy, make_evictor, evictor_description))
+  {
+    std::cerr << "unknown eviction policy or bad parameter: " << policy << std::endl;
+    return usage();
+  }
+
+  Cache::hash_func hasher;
+  if (hash_name == "std") hasher = std::hash<key_type>();
+  else if (hash_name == "fnv1a") hasher = fnv1a_hash;
+  else
+  {
+    std::cerr << "unknown hash function: " << hash_name << std::endl;
+    return 1;
+  }
+
   std::cout << "maxmem: " << maxmem 
               << ", threads: " << nthreads
+              << ", shards: " << nshards
+              << ", slab growth factor: " << growth_factor
+              << ", expected items: " << expected_items
+              << ", evictor: " << evictor_description
+              << ", load factor: " << std::min(load_factor, 0.875f)
+              << ", hash: " << hash_name
               << ", server: " << server
-              << ", port: " << port << std::endl;
+              << ", port: " << port;
+  if (memcache_port != 0) std::cout << ", memcache port: " << memcache_port;
+  if (resp_port != 0) std::cout << ", resp port: " << resp_port;
+  std::cout << std::endl;
 
   net::io_context ioc{nthreads}; // number of threads goes here {n}
 
-  //Evictor* fifo = new Fifo_Evictor();
-  
-
-  Cache cache(maxmem, 0.75);
+  Cache cache(maxmem, make_evictor, nshards, load_factor, hasher, growth_factor, expected_items);
 
   //auto mutx = std::mutex();
 
 
-  std::make_shared<listener>(ioc,
-                             tcp::endpoint{server, port},
-                             cache)->run();
+  std::make_shared<listener<session>>(ioc,
+                                      tcp::endpoint{server, port},
+                                      cache)->run();
+  if (memcache_port != 0)
+  {
+    std::make_shared<listener<stream_session<Memcache_Connection>>>(ioc,
+                                                                    tcp::endpoint{server, memcache_port},
+                                                                    cache)->run();
+  }
+  if (resp_port != 0)
+  {
+    std::make_shared<listener<stream_session<Resp_Connection>>>(ioc,
+                                                                tcp::endpoint{server, resp_port},
+                                                                cache)->run();
+  }
 
   
   std::vector<std::thread> v;
@@ -0,0 +1,114 @@
+/*
+ * Implementation of a Clock_Evictor according to the declarations in clock_evictor.hh
+ * New items start with their reference bit clear, so an item that is never
+ * read again goes at the hand's next pass, while one read since the last
+ * pass gets a second chance.
+ */
+
+#include "clock_evictor.hh"
+#include <cassert>
+
+// find a free slot, growing the array if there is none
+std::size_t
+Clock_Evictor::add_slot()
+{
+  if (!free_.empty())
+  {
+    std::size_t slot = free_.back();
+    free_.pop_back();
+    return slot;
+  }
+  if (slots_.size() == capacity_)
+  {
+    // atomics can't be moved, so the bits are copied into a bigger array
+    const std::size_t capacity = capacity_ == 0 ? 64 : capacity_ * 2;
+    std::unique_ptr<std::atomic<uint8_t>[]> referenced(new std::atomic<uint8_t>[capacity]);
+    for (std::size_t i = 0; i < capacity; i++)
+    {
+      referenced[i].store(i < capacity_ ? referenced_[i].load(std::memory_order_relaxed) : 0,
+                          std::memory_order_relaxed);
+    }
+    referenced_ = std::move(referenced);
+    capacity_ = capacity;
+  }
+  slots_.push_back(nullptr);
+  return slots_.size() - 1;
+}
+
+void
+Clock_Evictor::touch_item(Evictor_Hook& hook, const key_type&, std::size_t)
+{
+  if (hook.meta_ != 0)
+  {
+    std::atomic<uint8_t>& bit = referenced_[hook.meta_ - 1];
+    // skip the store when the bit is set already, to keep the line clean
+    if (bit.load(std::memory_order_relaxed) == 0) bit.store(1, std::memory_order_relaxed);
+    return;
+  }
+  const std::size_t slot = add_slot();
+  slots_[slot] = &hook;
+  referenced_[slot].store(0, std::memory_order_relaxed);
+  hook.meta_ = slot + 1;
+  size_++;
+}
+
+void
+Clock_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (hook.meta_ == 0) return;
+  const std::size_t slot = hook.meta_ - 1;
+  assert(slots_[slot] == &hook);
+  slots_[slot] = nullptr;
+  free_.push_back(slot);
+  hook.meta_ = 0;
+  size_--;
+}
+
+Evictor_Hook*
+Clock_Evictor::evict_item()
+{
+  if (size_ == 0) return nullptr;
+  // every bit is cleared on the first pass, so this ends within two
+  for (;; hand_ = (hand_ + 1) % slots_.size())
+  {
+    Evictor_Hook* hook = slots_[hand_];
+    if (hook == nullptr) continue;
+    if (referenced_[hand_].load(std::memory_order_relaxed) != 0)
+    {
+      referenced_[hand_].store(0, std::memory_order_relaxed);
+      continue;
+    }
+    erase_item(*hook, key_type());
+    hand_ = (hand_ + 1) % slots_.size();
+    return hook;
+  }
+}
+
+// Sweeps once from the hand, giving accepted items their second chance on
+// the way; if none had its bit clear, the first one goes, now that its bit is.
+Evictor_Hook*
+Clock_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  Evictor_Hook* first = nullptr;
+  for (std::size_t i = 0; i < slots_.size(); i++)
+  {
+    const std::size_t slot = (hand_ + i) % slots_.size();
+    Evictor_Hook* hook = slots_[slot];
+    if (hook == nullptr || !accept(*hook)) continue;
+    if (referenced_[slot].load(std::memory_order_relaxed) == 0)
+    {
+      first = hook;
+      break;
+    }
+    referenced_[slot].store(0, std::memory_order_relaxed);
+    if (first == nullptr) first = hook;
+  }
+  if (first != nullptr) erase_item(*first, key_type());
+  return first;
+}
+
+std::size_t
+Clock_Evictor::item_overhead(std::size_t) const
+{
+  return sizeof(Evictor_Hook*) + sizeof(std::atomic<uint8_t>) + sizeof(std::size_t);
+}
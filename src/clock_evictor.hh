@@ -0,0 +1,59 @@
+/*
+ * Declarations for a CLOCK (second chance) evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * Items sit in a circular array of slots, each with a reference bit. A touch
+ * of a tracked item only sets its bit, with a relaxed atomic store, so gets
+ * can touch items concurrently without a lock. Like Intrusive_LRU_Evictor,
+ * it only works through the item calls of the interface.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Clock_Evictor : public Evictor {
+  private:
+    // tracked item of every slot (nullptr for free slots), and its
+    // reference bit; an item's hook keeps its slot number + 1 in meta_,
+    // which limits the evictor to 2^32 - 1 items
+    std::vector<Evictor_Hook*> slots_;
+    std::unique_ptr<std::atomic<uint8_t>[]> referenced_;
+    std::size_t capacity_ = 0;         // slots referenced_ has room for
+    std::vector<std::size_t> free_;    // free slots below slots_.size()
+    std::size_t hand_ = 0;
+    std::size_t size_ = 0;             // items tracked
+
+    std::size_t add_slot();
+  public:
+    Clock_Evictor() = default;
+    ~Clock_Evictor() = default;
+    Clock_Evictor(const Clock_Evictor&) = delete;
+    Clock_Evictor& operator=(const Clock_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // sets the reference bit of a tracked item, or gives a slot to a new
+    // one (which must not race with other calls)
+    void touch_item(Evictor_Hook& hook, const key_type&, std::size_t) override;
+
+    // frees the slot of an item, if it is tracked
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // sweeps the hand over the slots, clearing reference bits, until it
+    // reaches an item whose bit is clear, and returns that item
+    Evictor_Hook* evict_item() override;
+
+    // the same for the accepted items only, without moving the hand past
+    // the others
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    // a slot, its reference bit, and room for it in the free list
+    std::size_t item_overhead(std::size_t) const override;
+
+    bool concurrent_touch() const override { return true; }
+};
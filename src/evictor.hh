@@ -4,15 +4,58 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 // Data type to use as keys for Cache and Evictors:
 using key_type = std::string;
 
+// Room for an evictor's own bookkeeping inside every item of the cache, so
+// that an evictor can track items without a map or key copies of its own.
+// The cache never looks inside it. key_hash_ is shared: any evictor that
+// needs a hash of the item's key may store key_hash(key) there.
+struct Evictor_Hook {
+  Evictor_Hook* prev_ = nullptr;
+  Evictor_Hook* next_ = nullptr;
+  uint32_t meta_ = 0;
+  uint32_t key_hash_ = 0;
+};
+
+// 32-bit hash of a key, as kept in Evictor_Hook::key_hash_
+inline uint32_t
+key_hash(const key_type& key)
+{
+  const uint64_t h = std::hash<key_type>()(key);
+  return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+// Heap memory taken by a copy of a key of the given length, on top of the
+// key_type itself: nothing for keys short enough to be stored inline
+inline std::size_t
+key_copy_size(std::size_t key_len)
+{
+  static const std::size_t inline_capacity = key_type().capacity();
+  return key_len > inline_capacity ? key_len + 1 : 0;
+}
+
+// Picks one of the cache's items from a random number, for evictors that
+// sample the cache instead of ordering its items themselves. Returns
+// nullptr if the cache holds nothing.
+using Evictor_Sampler = std::function<Evictor_Hook*(uint64_t)>;
+
+// Size of one of the cache's items, as counted against its memory budget
+using Evictor_Sizer = std::function<std::size_t(const Evictor_Hook&)>;
+
+// Whether one of the cache's items may be evicted, for evict_item_if
+using Evictor_Filter = std::function<bool(const Evictor_Hook&)>;
+
 // Abstract base class to define evictions policies.
-// It allows touching a key (on a set or get event), and request for
-// eviction, which also deletes a key. There is no explicit deletion
-// mechanism other than eviction.
+// It allows touching a key (on a set or get event), request for
+// eviction, which also deletes a key, and erasing a key that left the
+// cache some other way.
 class Evictor {
  public:
   Evictor() = default;
@@ -26,4 +69,81 @@ class Evictor {
   // Request evictor for the next key to evict, and remove it from evictor.
   // If evictor doesn't know what to evict, return an empty key ("").
   virtual const key_type evict() = 0;
+
+  // Inform evictor that a key left the cache without being evicted by it
+  // (deleted, overwritten or expired), so that it can forget the key:
+  virtual void erase_key(const key_type&) {}
+
+  // The cache calls the item variants below, which also hand the evictor
+  // the hook of the item holding the key. By default they fall back on the
+  // key-based calls above, so that evictors only need the hook if they
+  // want it. They also pass the item's size, as counted against the
+  // cache's memory budget, for evictors that weigh what an eviction frees.
+
+  // Inform evictor that the item holding key has been set or get:
+  virtual void touch_item(Evictor_Hook&, const key_type& key, std::size_t) { touch_key(key); }
+
+  // Inform evictor that a new item holding key has been set. Called
+  // instead of touch_item for the set that creates the item.
+  virtual void insert_item(Evictor_Hook& hook, const key_type& key, std::size_t size)
+  {
+    touch_item(hook, key, size);
+  }
+
+  // Asked before evicting anything to make room for a new key: whether the
+  // key is worth its victims. If not, the cache rejects the set instead.
+  // An admission policy may count the key as an access here.
+  virtual bool admit(const key_type&) { return true; }
+
+  // Inform evictor that the item holding key left the cache without being
+  // evicted (deleted, overwritten or expired), or after being evicted. It
+  // must not use the hook afterwards.
+  virtual void erase_item(Evictor_Hook&, const key_type& key) { erase_key(key); }
+
+  // Request evictor for the hook of the next item to evict, and remove it
+  // from evictor. Evictors that work on keys return nullptr, and the cache
+  // asks evict() instead.
+  virtual Evictor_Hook* evict_item() { return nullptr; }
+
+  // Like evict_item, but for the item evictor would evict first among
+  // those accept takes, for when the cache needs an item of some kind gone
+  // rather than just memory. Returns nullptr if no item is taken, and for
+  // evictors that work on keys.
+  virtual Evictor_Hook* evict_item_if(const Evictor_Filter&) { return nullptr; }
+
+  // Request evictor for the hooks of enough items to free bytes_needed
+  // bytes, as told by size_of, and remove them from evictor. The batch is
+  // shorter if evictor runs out of items, and empty for evictors that work
+  // on keys. The cache erases every item of the batch before calling
+  // evictor again. By default, victims come from evict_item one at a time.
+  virtual std::vector<Evictor_Hook*> evict_batch(std::size_t bytes_needed, const Evictor_Sizer& size_of)
+  {
+    std::vector<Evictor_Hook*> batch;
+    std::size_t freed = 0;
+    while (freed < bytes_needed)
+    {
+      Evictor_Hook* hook = evict_item();
+      if (hook == nullptr) break;
+      batch.push_back(hook);
+      freed += size_of(*hook);
+    }
+    return batch;
+  }
+
+  // Called by the cache before anything else with a sampler over its
+  // items. The sampler may only be used from evict_item, which runs with
+  // the cache locked.
+  virtual void set_sampler(Evictor_Sampler) {}
+
+  // Memory that evictor spends on every item it tracks, besides the item's
+  // hook, for an item whose key has key_len bytes. The cache counts it
+  // against its memory budget along with the item, so it must only depend
+  // on key_len.
+  virtual std::size_t item_overhead(std::size_t) const { return 0; }
+
+  // Whether touch_item may run in several threads at once for items that
+  // are already tracked. The cache then skips the lock that otherwise
+  // serializes the touches of concurrent gets. Everything else still needs
+  // exclusive access.
+  virtual bool concurrent_touch() const { return false; }
 };
@@ -1,6 +1,7 @@
 /*
  * Implementation of a FIFO (First In, First Out) evictor for use in a cache following the patterns in cache.hh
- * Stores values in a standard library queue, pushing values to the back when touched and popping values from when evicting.
+ * Stores keys in a standard library list, pushing keys to the back when first touched and popping keys from the front when evicting.
+ * An index of the queued keys keeps later touches from queueing a key again, and lets erased keys leave the queue.
  */
 
 #include "fifo_evictor.hh"
@@ -11,22 +12,48 @@
 Fifo_Evictor::Fifo_Evictor()
   : mutx_(std::mutex()) {}
  
-// pushes key onto back of queue
+// pushes key onto back of queue, if it isn't queued yet
 void
 Fifo_Evictor::touch_key(const key_type& key)
 {
   std::scoped_lock guard(mutx_);
-  keyq_.push(key);
+  if (queued_.count(key) != 0) return;
+  keyq_.push_back(key);
+  queued_.emplace(keyq_.back(), std::prev(keyq_.end()));
 }
 
 // pops key at front of queue and returns it to user
 const key_type
 Fifo_Evictor::evict()
 {
+  std::scoped_lock guard(mutx_);
   key_type x = "";
   if (keyq_.empty()) return x;
-  x = keyq_.front();
-  std::scoped_lock guard(mutx_);
-  keyq_.pop();
+  queued_.erase(keyq_.front());
+  x = std::move(keyq_.front());
+  keyq_.pop_front();
   return x;
 }
+
+// removes a key from wherever it is in the queue
+void
+Fifo_Evictor::erase_key(const key_type& key)
+{
+  std::scoped_lock guard(mutx_);
+  auto it = queued_.find(key);
+  if (it == queued_.end()) return;
+  const auto pos = it->second;
+  queued_.erase(it);
+  keyq_.erase(pos);
+}
+
+// a list node holding the key, and an index entry holding a view of it, a
+// list iterator, the next pointer and the cached hash, plus about one bucket
+std::size_t
+Fifo_Evictor::item_overhead(std::size_t key_len) const
+{
+  const std::size_t list_node = 2 * sizeof(void*) + sizeof(key_type) + key_copy_size(key_len);
+  const std::size_t index_entry = sizeof(void*) + sizeof(std::string_view) + sizeof(std::list<key_type>::iterator)
+                                + sizeof(std::size_t) + sizeof(void*);
+  return list_node + index_entry;
+}
@@ -8,12 +8,16 @@
 #include "evictor.hh"
 #include <thread>
 #include <mutex>
-#include <queue>
+#include <list>
+#include <string_view>
+#include <unordered_map>
 
 class Fifo_Evictor : public Evictor {
   private:
-    // a fifo queue in which to store keys
-    std::queue<key_type> keyq_;
+    // a fifo queue in which to store keys, each key at most once
+    std::list<key_type> keyq_;
+    // where each queued key is in the queue, keyed by the queue's own copy
+    std::unordered_map<std::string_view, std::list<key_type>::iterator> queued_;
     std::mutex mutx_;
   public:
 
@@ -22,9 +26,15 @@ class Fifo_Evictor : public Evictor {
     Fifo_Evictor(const Fifo_Evictor&) = delete;
     Fifo_Evictor& operator=(const Fifo_Evictor&) = delete;
     
-    // pushes a key onto back of queue
+    // pushes a key onto back of queue, unless it is queued already
     void touch_key(const key_type&) override;
 
     // pops first key off front and returns it
     const key_type evict() override;
+
+    // takes a key out of the queue, if it is there
+    void erase_key(const key_type&) override;
+
+    // a list node holding the key and an index entry
+    std::size_t item_overhead(std::size_t key_len) const override;
 };
@@ -0,0 +1,124 @@
+/*
+ * Implementation of a GDSF_Evictor according to the declarations in gdsf_evictor.hh
+ * The cost of a miss is taken to be the same for every item, so the
+ * priority is clock + frequency / size. Sizes of 0 count as 1.
+ */
+
+#include "gdsf_evictor.hh"
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+// store an entry at a position of the heap, and tell its hook
+void
+GDSF_Evictor::put(std::size_t pos, const Entry& entry)
+{
+  heap_[pos] = entry;
+  entry.hook_->meta_ = pos + 1;
+}
+
+void
+GDSF_Evictor::sift_up(std::size_t pos)
+{
+  const Entry entry = heap_[pos];
+  while (pos > 0)
+  {
+    const std::size_t parent = (pos - 1) / 2;
+    if (heap_[parent].priority_ <= entry.priority_) break;
+    put(pos, heap_[parent]);
+    pos = parent;
+  }
+  put(pos, entry);
+}
+
+void
+GDSF_Evictor::sift_down(std::size_t pos)
+{
+  const Entry entry = heap_[pos];
+  const std::size_t size = heap_.size();
+  while (2 * pos + 1 < size)
+  {
+    std::size_t child = 2 * pos + 1;
+    if (child + 1 < size && heap_[child + 1].priority_ < heap_[child].priority_) child++;
+    if (entry.priority_ <= heap_[child].priority_) break;
+    put(pos, heap_[child]);
+    pos = child;
+  }
+  put(pos, entry);
+}
+
+// take the entry at a position out of the heap, filling its place with the last one
+void
+GDSF_Evictor::remove(std::size_t pos)
+{
+  heap_[pos].hook_->meta_ = 0;
+  const Entry last = heap_.back();
+  heap_.pop_back();
+  if (pos == heap_.size()) return;
+  put(pos, last);
+  sift_down(pos);
+  sift_up(pos);
+}
+
+void
+GDSF_Evictor::touch_item(Evictor_Hook& hook, const key_type&, std::size_t size)
+{
+  const double weight = 1.0 / std::max<std::size_t>(size, 1);
+  if (hook.meta_ == 0)
+  {
+    assert(heap_.size() < UINT32_MAX);
+    heap_.push_back(Entry{clock_ + weight, &hook, 1});
+    hook.meta_ = heap_.size();
+    sift_up(heap_.size() - 1);
+    return;
+  }
+  // the clock never goes down, so the priority can only grow
+  const std::size_t pos = hook.meta_ - 1;
+  Entry& entry = heap_[pos];
+  if (entry.freq_ < UINT32_MAX) entry.freq_++;
+  entry.priority_ = clock_ + entry.freq_ * weight;
+  sift_down(pos);
+}
+
+void
+GDSF_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (hook.meta_ != 0) remove(hook.meta_ - 1);
+}
+
+Evictor_Hook*
+GDSF_Evictor::evict_item()
+{
+  if (heap_.empty()) return nullptr;
+  Evictor_Hook* hook = heap_.front().hook_;
+  clock_ = heap_.front().priority_;
+  remove(0);
+  return hook;
+}
+
+// The heap is searched from the root in order of priority, so only the
+// items ahead of the victim are looked at.
+Evictor_Hook*
+GDSF_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  auto later = [this](std::size_t a, std::size_t b) { return heap_[a].priority_ > heap_[b].priority_; };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> frontier(later);
+  if (!heap_.empty()) frontier.push(0);
+  while (!frontier.empty())
+  {
+    const std::size_t pos = frontier.top();
+    frontier.pop();
+    if (accept(*heap_[pos].hook_))
+    {
+      Evictor_Hook* hook = heap_[pos].hook_;
+      clock_ = std::max(clock_, heap_[pos].priority_);
+      remove(pos);
+      return hook;
+    }
+    for (std::size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < heap_.size(); child++)
+    {
+      frontier.push(child);
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,63 @@
+/*
+ * Declarations for a GDSF (Greedy-Dual-Size-Frequency) evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * Every item has a priority of clock + frequency / size, and the item with
+ * the lowest priority goes first. Large items thus leave before small ones
+ * read as often, so that one big value doesn't push out many small hot
+ * items. The clock rises to the priority of each victim, so items that
+ * stop being read eventually fall behind new ones whatever their count.
+ * Like Intrusive_LRU_Evictor, it only works through the item calls of the
+ * interface.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class GDSF_Evictor : public Evictor {
+  private:
+    struct Entry {
+      double priority_;
+      Evictor_Hook* hook_;
+      uint32_t freq_;
+    };
+
+    // binary min-heap of the tracked items on their priority; an item's
+    // hook keeps its position + 1 in meta_, which limits the evictor to
+    // 2^32 - 1 items
+    std::vector<Entry> heap_;
+    double clock_ = 0;     // priority of the last victim
+
+    void put(std::size_t pos, const Entry& entry);
+    void sift_up(std::size_t pos);
+    void sift_down(std::size_t pos);
+    void remove(std::size_t pos);
+  public:
+    GDSF_Evictor() = default;
+    ~GDSF_Evictor() = default;
+    GDSF_Evictor(const GDSF_Evictor&) = delete;
+    GDSF_Evictor& operator=(const GDSF_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // counts a read of a tracked item, or adds a new one with a count of 1,
+    // and sets its priority from the current clock
+    void touch_item(Evictor_Hook& hook, const key_type&, std::size_t size) override;
+
+    // removes an item from the heap, if it is tracked
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // returns the item of lowest priority, and moves the clock up to it
+    Evictor_Hook* evict_item() override;
+
+    // the same for the accepted item of lowest priority
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    // one heap entry
+    std::size_t item_overhead(std::size_t) const override { return sizeof(Entry); }
+
+    double clock() const { return clock_; }
+};
@@ -0,0 +1,284 @@
+/*
+ * Implementation of the open-addressing index declared in hash_index.hh.
+ * Groups are aligned on multiples of 16 slots and probed quadratically
+ * (triangular numbers), so that every group is visited once the probe
+ * sequence has wrapped around.
+ * Items moved out of the old table during a resize leave tombstones behind,
+ * so that probe sequences through the old table stay intact until it is
+ * freed.
+ */
+
+#include "hash_index.hh"
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const std::size_t GROUP_SIZE = 16;
+static const int8_t CTRL_EMPTY = -128;
+static const int8_t CTRL_DELETED = -2;
+
+// groups of the old table moved by each insert or erase during a resize
+static const std::size_t MIGRATE_GROUPS = 2;
+
+// the low 7 bits of the hash are the fingerprint, the rest picks the group
+static inline int8_t h2(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+static inline std::size_t h1(uint64_t hash) { return hash >> 7; }
+
+// Bitmasks (one bit per slot) of the slots in a group whose control byte
+// equals the fingerprint, is empty, or is empty or deleted.
+#ifdef __SSE2__
+static inline uint32_t
+match_byte(const int8_t* group, int8_t byte)
+{
+  __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), ctrl));
+}
+
+static inline uint32_t
+match_empty_or_deleted(const int8_t* group)
+{
+  __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+  return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+}
+#else
+static inline uint32_t
+match_byte(const int8_t* group, int8_t byte)
+{
+  uint32_t bits = 0;
+  for (std::size_t i = 0; i < GROUP_SIZE; i++) bits |= uint32_t(group[i] == byte) << i;
+  return bits;
+}
+
+static inline uint32_t
+match_empty_or_deleted(const int8_t* group)
+{
+  uint32_t bits = 0;
+  for (std::size_t i = 0; i < GROUP_SIZE; i++) bits |= uint32_t(group[i] < -1) << i;
+  return bits;
+}
+#endif
+
+static std::size_t
+round_capacity(std::size_t capacity)
+{
+  std::size_t res = GROUP_SIZE;
+  while (res < capacity) res *= 2;
+  return res;
+}
+
+Hash_Index::Hash_Index(float max_load_factor, std::size_t capacity)
+  : max_load_factor_(std::min(max_load_factor, 0.875f))
+{
+  assert(max_load_factor_ > 0);
+  allocate(cur_, round_capacity(capacity));
+}
+
+Hash_Index::~Hash_Index()
+{
+  release(cur_);
+  release(old_);
+}
+
+void
+Hash_Index::allocate(Table& tbl, std::size_t capacity)
+{
+  tbl.capacity_ = capacity;
+  tbl.ctrl_ = new int8_t[capacity];
+  tbl.slots_ = new Item*[capacity];
+  tbl.size_ = 0;
+  tbl.deleted_ = 0;
+  std::memset(tbl.ctrl_, CTRL_EMPTY, capacity);
+}
+
+void
+Hash_Index::release(Table& tbl)
+{
+  delete[] tbl.ctrl_;
+  delete[] tbl.slots_;
+  tbl = Table();
+}
+
+// number of slots of a table that may be full or deleted before it must grow
+std::size_t
+Hash_Index::max_used(const Table& tbl) const
+{
+  return std::min(tbl.capacity_ - 1, static_cast<std::size_t>(tbl.capacity_ * max_load_factor_));
+}
+
+// slot of a table holding the key, or capacity_ if it isn't there
+std::size_t
+Hash_Index::find_slot(const Table& tbl, std::string_view key, uint64_t hash)
+{
+  if (tbl.size_ == 0) return tbl.capacity_;
+  const std::size_t mask = tbl.capacity_ / GROUP_SIZE - 1;
+  std::size_t group = h1(hash) & mask;
+  for (std::size_t probe = 1; probe <= mask + 1; probe++)
+  {
+    const int8_t* ctrl = tbl.ctrl_ + group * GROUP_SIZE;
+    for (uint32_t bits = match_byte(ctrl, h2(hash)); bits != 0; bits &= bits - 1)
+    {
+      std::size_t slot = group * GROUP_SIZE + __builtin_ctz(bits);
+      if (tbl.slots_[slot]->matches(key, hash)) return slot;
+    }
+    if (match_byte(ctrl, CTRL_EMPTY) != 0) break;
+    group = (group + probe) & mask;
+  }
+  return tbl.capacity_;
+}
+
+// put an item in the first free slot of its probe sequence
+void
+Hash_Index::insert_into(Table& tbl, Item* item)
+{
+  const std::size_t mask = tbl.capacity_ / GROUP_SIZE - 1;
+  std::size_t group = h1(item->hash_) & mask;
+  for (std::size_t probe = 1; ; probe++)
+  {
+    uint32_t bits = match_empty_or_deleted(tbl.ctrl_ + group * GROUP_SIZE);
+    if (bits != 0)
+    {
+      std::size_t slot = group * GROUP_SIZE + __builtin_ctz(bits);
+      if (tbl.ctrl_[slot] == CTRL_DELETED) tbl.deleted_--;
+      tbl.ctrl_[slot] = h2(item->hash_);
+      tbl.slots_[slot] = item;
+      tbl.size_++;
+      return;
+    }
+    group = (group + probe) & mask;
+  }
+}
+
+// free a full slot and return the item it held
+Item*
+Hash_Index::erase_slot(Table& tbl, std::size_t slot)
+{
+  // A lookup stops at the first group with an empty slot, so if this group
+  // has one no probe sequence can run through it and the slot can be
+  // emptied outright. Otherwise it must stay a tombstone.
+  const int8_t* group = tbl.ctrl_ + slot / GROUP_SIZE * GROUP_SIZE;
+  if (match_byte(group, CTRL_EMPTY) != 0)
+  {
+    tbl.ctrl_[slot] = CTRL_EMPTY;
+  }
+  else
+  {
+    tbl.ctrl_[slot] = CTRL_DELETED;
+    tbl.deleted_++;
+  }
+  tbl.size_--;
+  return tbl.slots_[slot];
+}
+
+Item*
+Hash_Index::find(std::string_view key, uint64_t hash) const
+{
+  std::size_t slot = find_slot(cur_, key, hash);
+  if (slot != cur_.capacity_) return cur_.slots_[slot];
+  if (!rehashing()) return nullptr;
+  slot = find_slot(old_, key, hash);
+  return slot == old_.capacity_ ? nullptr : old_.slots_[slot];
+}
+
+void
+Hash_Index::prefetch(uint64_t hash) const
+{
+  if (cur_.size_ == 0) return;
+  const std::size_t slot = (h1(hash) & (cur_.capacity_ / GROUP_SIZE - 1)) * GROUP_SIZE;
+  __builtin_prefetch(cur_.ctrl_ + slot);
+  __builtin_prefetch(cur_.slots_ + slot);
+}
+
+void
+Hash_Index::insert(Item* item)
+{
+  rehash_step(MIGRATE_GROUPS);
+  if (cur_.size_ + cur_.deleted_ + 1 > max_used(cur_))
+  {
+    // grow if the items themselves need the room, otherwise just drop the tombstones
+    start_resize(size() * 2 + 2 > max_used(cur_) ? cur_.capacity_ * 2 : cur_.capacity_);
+  }
+  insert_into(cur_, item);
+}
+
+Item*
+Hash_Index::erase(std::string_view key, uint64_t hash)
+{
+  rehash_step(MIGRATE_GROUPS);
+  std::size_t slot = find_slot(cur_, key, hash);
+  if (slot != cur_.capacity_) return erase_slot(cur_, slot);
+  if (!rehashing()) return nullptr;
+  slot = find_slot(old_, key, hash);
+  return slot == old_.capacity_ ? nullptr : erase_slot(old_, slot);
+}
+
+void
+Hash_Index::clear()
+{
+  release(old_);
+  migrate_pos_ = 0;
+  std::memset(cur_.ctrl_, CTRL_EMPTY, cur_.capacity_);
+  cur_.size_ = 0;
+  cur_.deleted_ = 0;
+}
+
+Item*
+Hash_Index::sample(uint64_t rnd) const
+{
+  if (size() == 0) return nullptr;
+  // during a resize, pick either table in proportion to the items it holds
+  const Table& tbl = rnd % size() < old_.size_ ? old_ : cur_;
+  const std::size_t mask = tbl.capacity_ - 1;
+  const std::size_t start = (rnd / size()) & mask;
+  for (std::size_t i = 0; i <= mask; i++)
+  {
+    const std::size_t slot = (start + i) & mask;
+    if (tbl.ctrl_[slot] >= 0) return tbl.slots_[slot];
+  }
+  return nullptr;
+}
+
+void
+Hash_Index::reserve(std::size_t nitems)
+{
+  const std::size_t capacity = round_capacity(static_cast<std::size_t>(nitems / max_load_factor_) + 1);
+  if (capacity <= cur_.capacity_) return;
+  start_resize(capacity);
+  rehash_step(old_.capacity_ / GROUP_SIZE);
+}
+
+// Make a new, empty current table and start draining the previous one.
+// A resize still in progress is finished first.
+void
+Hash_Index::start_resize(std::size_t capacity)
+{
+  if (rehashing()) rehash_step(old_.capacity_ / GROUP_SIZE);
+  old_ = cur_;
+  allocate(cur_, round_capacity(capacity));
+  migrate_pos_ = 0;
+}
+
+void
+Hash_Index::rehash_step(std::size_t ngroups)
+{
+  if (!rehashing()) return;
+  const std::size_t old_groups = old_.capacity_ / GROUP_SIZE;
+  for (; ngroups > 0 && migrate_pos_ < old_groups && old_.size_ > 0; ngroups--, migrate_pos_++)
+  {
+    for (std::size_t slot = migrate_pos_ * GROUP_SIZE; slot < (migrate_pos_ + 1) * GROUP_SIZE; slot++)
+    {
+      if (old_.ctrl_[slot] < 0) continue;
+      // leave a tombstone so that probes through the old table still work
+      insert_into(cur_, old_.slots_[slot]);
+      old_.ctrl_[slot] = CTRL_DELETED;
+      old_.size_--;
+    }
+  }
+  if (old_.size_ == 0)
+  {
+    release(old_);
+    migrate_pos_ = 0;
+  }
+}
@@ -0,0 +1,108 @@
+/*
+ * Declarations for the open-addressing hash index used by the cache to find
+ * items by key.
+ * The layout follows SwissTable/F14: slots are grouped by 16, and a separate
+ * array keeps one control byte per slot holding either "empty", "deleted" or
+ * a 7-bit fingerprint of the key's hash. A lookup compares the fingerprints of
+ * a whole group at once (with SSE2 where available) and only follows the item
+ * pointer of slots whose fingerprint matches.
+ *
+ * Resizing is incremental, like memcached's assoc_expand or Redis's
+ * dictRehash: growing allocates a new table but leaves the items in the old
+ * one, and every later insert or erase moves a few groups across. Until the
+ * old table is drained, lookups check both.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "cache_item.hh"
+
+class Hash_Index {
+  private:
+    struct Table {
+      int8_t* ctrl_ = nullptr;       // control byte of every slot
+      Item** slots_ = nullptr;       // item stored in every full slot
+      std::size_t capacity_ = 0;     // number of slots, a power of two and at least one group
+      std::size_t size_ = 0;         // full slots
+      std::size_t deleted_ = 0;      // slots left as tombstones by erase
+    };
+
+    Table cur_;                      // table receiving inserts
+    Table old_;                      // table being drained into cur_ while resizing
+    std::size_t migrate_pos_ = 0;    // next group of old_ to move
+    const float max_load_factor_;
+
+    std::size_t max_used(const Table& tbl) const;
+    static void allocate(Table& tbl, std::size_t capacity);
+    static void release(Table& tbl);
+    static std::size_t find_slot(const Table& tbl, std::string_view key, uint64_t hash);
+    static void insert_into(Table& tbl, Item* item);
+    static Item* erase_slot(Table& tbl, std::size_t slot);
+    void start_resize(std::size_t capacity);
+
+  public:
+    // Memory an item takes in the index: its slot and control byte. Free
+    // slots add more, from a quarter of that at most to once as much again
+    // right after a resize.
+    static constexpr std::size_t ENTRY_SIZE = sizeof(Item*) + 1;
+
+    // max_load_factor: maximum ratio of used slots (items and tombstones) to
+    // slots before the index grows. Capped at 7/8, which keeps probe
+    // sequences short.
+    // capacity: initial number of slots (rounded up to a power of two).
+    explicit Hash_Index(float max_load_factor = 0.75, std::size_t capacity = 16);
+    ~Hash_Index();
+    Hash_Index(const Hash_Index&) = delete;
+    Hash_Index& operator=(const Hash_Index&) = delete;
+
+    // Return the item with this key (hash must be item->hash_), or nullptr
+    Item* find(std::string_view key, uint64_t hash) const;
+
+    // Start loading the first group a find of this hash looks at into the
+    // CPU cache, so that a batch of finds waits on memory once rather than
+    // once per key
+    void prefetch(uint64_t hash) const;
+
+    // Add an item, indexed by item->hash_. Its key must not be in the index.
+    void insert(Item* item);
+
+    // Remove the item with this key and return it, or nullptr if not found
+    Item* erase(std::string_view key, uint64_t hash);
+
+    // Remove every item, keeping the current capacity
+    void clear();
+
+    // Grow the index right away so that it holds nitems without resizing
+    void reserve(std::size_t nitems);
+
+    // Move up to ngroups groups of the old table during a resize. Inserts and
+    // erases already do this; the cache's expirer thread calls it too, so
+    // that a resize also finishes under a load of lookups alone.
+    void rehash_step(std::size_t ngroups);
+
+    // Whether a resize is still moving items from the old table
+    bool rehashing() const { return old_.ctrl_ != nullptr; }
+
+    std::size_t size() const { return cur_.size_ + old_.size_; }
+    std::size_t capacity() const { return cur_.capacity_; }
+
+    // Return an item picked from a random number: the first one found from a
+    // random slot. Items after long runs of free slots come up more often,
+    // but no item is ever left out. Returns nullptr if the index is empty.
+    Item* sample(uint64_t rnd) const;
+
+    // Call f on every item in the index
+    template <class F>
+    void for_each(F f) const
+    {
+      for (const Table* tbl : {&old_, &cur_})
+      {
+        for (std::size_t i = 0; i < tbl->capacity_; i++)
+        {
+          if (tbl->ctrl_[i] >= 0) f(tbl->slots_[i]);
+        }
+      }
+    }
+};
@@ -0,0 +1,58 @@
+/*
+ * A circular doubly linked list of evictor hooks, for evictors that keep
+ * their lists inside the cache's items (see Evictor_Hook in evictor.hh).
+ * The list goes through a sentinel: the front is the sentinel's next, the
+ * back its prev. A hook is in a list exactly when its next_ is set.
+ */
+
+#pragma once
+#include <cstddef>
+#include "evictor.hh"
+
+class Hook_List {
+  private:
+    Evictor_Hook head_;
+    std::size_t size_ = 0;
+
+  public:
+    Hook_List() { head_.prev_ = head_.next_ = &head_; }
+    Hook_List(const Hook_List&) = delete;
+    Hook_List& operator=(const Hook_List&) = delete;
+
+    static bool linked(const Evictor_Hook& hook) { return hook.next_ != nullptr; }
+
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    Evictor_Hook* front() { return empty() ? nullptr : head_.next_; }
+    bool is_back(const Evictor_Hook& hook) const { return hook.next_ == &head_; }
+
+    // link a hook, which must not be in any list, at the back
+    void push_back(Evictor_Hook& hook)
+    {
+      hook.prev_ = head_.prev_;
+      hook.next_ = &head_;
+      head_.prev_->next_ = &hook;
+      head_.prev_ = &hook;
+      size_++;
+    }
+
+    // first hook from the front that accept takes, or nullptr
+    template <typename Filter>
+    Evictor_Hook* find_if(const Filter& accept)
+    {
+      for (Evictor_Hook* hook = head_.next_; hook != &head_; hook = hook->next_)
+      {
+        if (accept(*hook)) return hook;
+      }
+      return nullptr;
+    }
+
+    // unlink a hook from this list
+    void unlink(Evictor_Hook& hook)
+    {
+      hook.prev_->next_ = hook.next_;
+      hook.next_->prev_ = hook.prev_;
+      hook.prev_ = hook.next_ = nullptr;
+      size_--;
+    }
+};
@@ -0,0 +1,37 @@
+/*
+ * Implementation of an Intrusive_LRU_Evictor according to the declarations in intrusive_lru_evictor.hh
+ * The list is made of the hooks of the items themselves (see hook_list.hh),
+ * least recently used at the front.
+ */
+
+#include "intrusive_lru_evictor.hh"
+
+void
+Intrusive_LRU_Evictor::touch_item(Evictor_Hook& hook, const key_type&, std::size_t)
+{
+  if (list_.is_back(hook)) return;     // already the most recent
+  if (Hook_List::linked(hook)) list_.unlink(hook);
+  list_.push_back(hook);
+}
+
+void
+Intrusive_LRU_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (Hook_List::linked(hook)) list_.unlink(hook);
+}
+
+Evictor_Hook*
+Intrusive_LRU_Evictor::evict_item()
+{
+  Evictor_Hook* victim = list_.front();
+  if (victim != nullptr) list_.unlink(*victim);
+  return victim;
+}
+
+Evictor_Hook*
+Intrusive_LRU_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  Evictor_Hook* victim = list_.find_if(accept);
+  if (victim != nullptr) list_.unlink(*victim);
+  return victim;
+}
@@ -0,0 +1,36 @@
+/*
+ * Declarations for an LRU (Least Recently Used) evictor that keeps its list
+ * inside the cache's items, according to the pattern in evictor.hh.
+ * Unlike LRU_Evictor it needs no map, copies no keys and allocates nothing,
+ * but it only works through the item calls of the interface: touch_key()
+ * and evict() alone do nothing.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include "hook_list.hh"
+
+class Intrusive_LRU_Evictor : public Evictor {
+  private:
+    Hook_List list_;    // least recently used first
+  public:
+    Intrusive_LRU_Evictor() = default;
+    ~Intrusive_LRU_Evictor() = default;
+    Intrusive_LRU_Evictor(const Intrusive_LRU_Evictor&) = delete;
+    Intrusive_LRU_Evictor& operator=(const Intrusive_LRU_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // moves an item to the back of the list, linking it in if it is new
+    void touch_item(Evictor_Hook& hook, const key_type&, std::size_t) override;
+
+    // unlinks an item, if it is linked
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // unlinks the item at the front of the list and returns it
+    Evictor_Hook* evict_item() override;
+
+    // unlinks the accepted item nearest the front and returns it
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+};
@@ -0,0 +1,463 @@
+// Benchmarks for the cache library itself. Unlike benchmark.cc, which drives
+// a running cache_server over the network, these run the Cache in-process so
+// that the numbers reflect the library and not the HTTP stack.
+//
+// usage: ./lib_benchmark [mode]
+//   threads: throughput of a mixed get/set load from 2 to 8 threads,
+//            with a single shard and with a sharded store.
+//   index [nkeys...]: lookups per second of the cache's hash index against
+//            std::unordered_map (default: 1M and 100M keys).
+//   warmup:  latency percentiles of the sets filling a cold cache, with the
+//            index growing as it fills and with it sized up front.
+//   evictors [nkeys]: touches per second and memory per tracked key of the
+//            map-based, intrusive and sampled LRU evictors (default: 1M keys).
+//   hitratio: object and byte hit ratios of each eviction policy on the
+//            WorkloadGenerator workload, for a few cache sizes, and the gap
+//            between sampled and exact LRU.
+//   hotkey:  gets per second of one key read from 1 to 8 threads, with an
+//            evictor whose touches are buffered and one that takes them
+//            concurrently.
+//   scan:    hit ratio of the LRU, ARC and SLRU evictors on a hot set of keys
+//            read between scans of keys that are never read again.
+
+#include "cache.hh"
+#include "WorkloadGenerator.hh"
+#include "cache_item.hh"
+#include "hash_index.hh"
+#include "fifo_evictor.hh"
+#include "lru_evictor.hh"
+#include "intrusive_lru_evictor.hh"
+#include "clock_evictor.hh"
+#include "s3fifo_evictor.hh"
+#include "tinylfu_evictor.hh"
+#include "arc_evictor.hh"
+#include "gdsf_evictor.hh"
+#include "sampled_lru_evictor.hh"
+#include "slru_evictor.hh"
+#include <malloc.h>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <new>
+
+using bench_clock = std::chrono::steady_clock;
+
+// seconds elapsed since start
+static double
+seconds_since(bench_clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::duration<double>>(bench_clock::now() - start).count();
+}
+
+static std::vector<key_type>
+make_keys(unsigned nkeys)
+{
+  std::vector<key_type> keys;
+  keys.reserve(nkeys);
+  for (unsigned i = 0; i < nkeys; i++) keys.push_back("key_" + std::to_string(i));
+  return keys;
+}
+
+// Run nthreads threads doing nops requests each against the cache, 90% gets
+// and 10% sets on uniformly random keys. Returns requests per second.
+static double
+mixed_throughput(Cache& cache, const std::vector<key_type>& keys, unsigned nthreads, unsigned nops)
+{
+  const char val[] = "0123456789abcdef0123456789abcdef";
+  auto run_one_thread = [&](unsigned seed)
+  {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<unsigned> key_dist(0, keys.size() - 1);
+    std::uniform_int_distribution<unsigned> req_dist(0, 9);
+    Cache::size_type sz;
+    for (unsigned i = 0; i < nops; i++)
+    {
+      const auto& key = keys[key_dist(gen)];
+      if (req_dist(gen) == 0) cache.set(key, val, sizeof(val));
+      else cache.get(key, sz);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  const auto start = bench_clock::now();
+  for (unsigned i = 0; i < nthreads; ++i) threads.push_back(std::thread(run_one_thread, i + 1));
+  for (auto& t : threads) t.join();
+  return (double(nthreads) * nops) / seconds_since(start);
+}
+
+// Gets per second of a single key read by 1 to 8 threads at once. With the
+// touches buffered per thread, the readers don't all update the evictor.
+static void
+bench_hot_key()
+{
+  const unsigned nops = 2000000;
+  const char val[] = "0123456789abcdef0123456789abcdef";
+  const std::vector<std::pair<std::string, std::function<Evictor*()>>> policies = {
+    {"intrusive lru (buffered touches)", []() { return new Intrusive_LRU_Evictor(); }},
+    {"clock (concurrent touches)", []() { return new Clock_Evictor(); }},
+  };
+  for (const auto& policy : policies)
+  {
+    Cache cache(1 << 20, 0.75, policy.second());
+    cache.set("hot", val, sizeof(val));
+    std::cout << policy.first << std::endl;
+    for (unsigned nthreads = 1; nthreads < 9; nthreads++)
+    {
+      std::vector<std::thread> threads;
+      const auto start = bench_clock::now();
+      for (unsigned i = 0; i < nthreads; i++)
+      {
+        threads.emplace_back([&cache]() {
+          Cache::size_type sz;
+          for (unsigned j = 0; j < nops; j++) cache.get("hot", sz);
+        });
+      }
+      for (auto& t : threads) t.join();
+      std::cout << "  threads: " << nthreads << ", throughput: "
+                << double(nthreads) * nops / seconds_since(start) << " gets/s" << std::endl;
+    }
+  }
+}
+
+// Throughput from 2 to 8 threads with one lock for the whole store, and with
+// the store split in shards. Also prints how evenly keys spread over shards.
+static void
+bench_threads()
+{
+  const unsigned nkeys = 100000;
+  const unsigned nops = 1000000;
+  const auto keys = make_keys(nkeys);
+  const char val[] = "0123456789abcdef0123456789abcdef";
+
+  for (unsigned nshards : {1u, 16u})
+  {
+    Cache cache(64 << 20, []() { return new Fifo_Evictor(); }, nshards);
+    for (const auto& key : keys) cache.set(key, val, sizeof(val));
+    std::cout << "SHARDS: " << nshards << std::endl;
+    for (unsigned t = 2; t < 9; ++t)
+    {
+      std::cout << "  threads: " << t
+                << ", throughput: " << mixed_throughput(cache, keys, t, nops / t) << " req/s" << std::endl;
+    }
+
+    const auto stats = cache.stats();
+    auto by_items = [](const Cache::shard_stats& a, const Cache::shard_stats& b) { return a.items < b.items; };
+    std::cout << "  items per shard: min " << std::min_element(stats.begin(), stats.end(), by_items)->items
+              << ", max " << std::max_element(stats.begin(), stats.end(), by_items)->items << std::endl;
+  }
+}
+
+// the same bit mixing the cache applies to its hasher's output
+static uint64_t
+mix_hash(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDull;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Successful lookups per second with nkeys keys, in the Hash_Index used by
+// the cache and in the std::unordered_map it replaced. Keys are looked up
+// in random order so that the tables don't stay in the CPU caches.
+static void
+bench_index(unsigned nkeys)
+{
+  const unsigned nlookups = 10000000;
+  const auto keys = make_keys(nkeys);
+  std::hash<key_type> hasher;
+  std::vector<unsigned> order(nlookups);
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<unsigned> key_dist(0, nkeys - 1);
+  for (auto& i : order) i = key_dist(gen);
+  const char val[] = "value";
+
+  {
+    // items are laid out as in the cache, but in one buffer instead of slabs
+    std::vector<std::size_t> offsets;
+    std::size_t total = 0;
+    for (const auto& key : keys)
+    {
+      offsets.push_back(total);
+      total += (Item::size_for(key.size(), sizeof(val)) + 7) / 8 * 8;
+    }
+    std::vector<char> buffer(total);
+    Hash_Index index(0.75);
+    for (unsigned i = 0; i < nkeys; i++)
+    {
+      Item* item = new (buffer.data() + offsets[i]) Item(mix_hash(hasher(keys[i])), keys[i].size(), sizeof(val));
+      std::copy(keys[i].begin(), keys[i].end(), item->key_data());
+      std::copy(val, val + sizeof(val), item->value());
+      index.insert(item);
+    }
+    unsigned found = 0;
+    const auto start = bench_clock::now();
+    for (auto i : order) found += index.find(keys[i], mix_hash(hasher(keys[i]))) != nullptr;
+    const double secs = seconds_since(start);
+    assert(found == nlookups);
+    std::cout << "  Hash_Index:         " << nlookups / secs << " lookups/s" << std::endl;
+  }
+  {
+    std::unordered_map<key_type, std::pair<Cache::val_type, Cache::size_type>> map;
+    map.max_load_factor(0.75);
+    for (const auto& key : keys) map[key] = std::make_pair(val, Cache::size_type(sizeof(val)));
+    unsigned found = 0;
+    const auto start = bench_clock::now();
+    for (auto i : order) found += map.find(keys[i]) != map.end();
+    const double secs = seconds_since(start);
+    assert(found == nlookups);
+    std::cout << "  std::unordered_map: " << nlookups / secs << " lookups/s" << std::endl;
+  }
+}
+
+// Fill an empty single-shard cache with nkeys keys and report the tail
+// latencies of the sets, which is where index resizes show up.
+static void
+bench_warmup()
+{
+  const unsigned nkeys = 2000000;
+  const auto keys = make_keys(nkeys);
+  const char val[] = "0123456789abcdef";
+  for (Cache::size_type expected : {0u, nkeys})
+  {
+    Cache cache(256 << 20, 0.75, nullptr, std::hash<key_type>(), 1.25, expected);
+    std::vector<double> lat;
+    lat.reserve(nkeys);
+    for (const auto& key : keys)
+    {
+      const auto start = bench_clock::now();
+      cache.set(key, val, sizeof(val));
+      lat.push_back(seconds_since(start) * 1e6);
+    }
+    std::sort(lat.begin(), lat.end());
+    std::cout << "EXPECTED ITEMS: " << expected << std::endl
+              << "  p50: " << lat[lat.size() / 2] << " us"
+              << ", p99: " << lat[lat.size() * 99 / 100] << " us"
+              << ", p99.9: " << lat[lat.size() * 999 / 1000] << " us"
+              << ", max: " << lat.back() << " us" << std::endl;
+  }
+}
+
+// bytes currently allocated from the heap
+static std::size_t
+heap_in_use()
+{
+  return mallinfo2().uordblks;
+}
+
+// Track nkeys keys with each LRU evictor, then touch them in random order.
+// The hooks stand in for the items of a cache. Every item carries a whole
+// hook whatever the evictor, even one that only uses its meta_ or none of
+// it, so each figure counts the hook's size on top of the evictor's heap.
+static void
+bench_evictors(unsigned nkeys)
+{
+  const unsigned ntouches = 10000000;
+  const auto keys = make_keys(nkeys);
+  std::vector<unsigned> order(ntouches);
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<unsigned> key_dist(0, nkeys - 1);
+  for (auto& i : order) i = key_dist(gen);
+
+  {
+    const std::size_t heap_before = heap_in_use();
+    LRU_Evictor lru;
+    for (const auto& key : keys) lru.touch_key(key);
+    const double bytes = double(heap_in_use() - heap_before) / nkeys + sizeof(Evictor_Hook);
+    const auto start = bench_clock::now();
+    for (auto i : order) lru.touch_key(keys[i]);
+    std::cout << "  LRU_Evictor:           " << ntouches / seconds_since(start) << " touches/s, "
+              << bytes << " bytes/key" << std::endl;
+  }
+  {
+    std::vector<Evictor_Hook> hooks(nkeys);
+    const std::size_t heap_before = heap_in_use();
+    Intrusive_LRU_Evictor lru;
+    for (unsigned i = 0; i < nkeys; i++) lru.touch_item(hooks[i], keys[i], sizeof(Item));
+    const double bytes = double(heap_in_use() - heap_before) / nkeys + sizeof(Evictor_Hook);
+    const auto start = bench_clock::now();
+    for (auto i : order) lru.touch_item(hooks[i], keys[i], sizeof(Item));
+    std::cout << "  Intrusive_LRU_Evictor: " << ntouches / seconds_since(start) << " touches/s, "
+              << bytes << " bytes/key" << std::endl;
+  }
+  {
+    std::vector<Evictor_Hook> hooks(nkeys);
+    const std::size_t heap_before = heap_in_use();
+    Sampled_LRU_Evictor lru;
+    for (unsigned i = 0; i < nkeys; i++) lru.insert_item(hooks[i], keys[i], sizeof(Item));
+    const double bytes = double(heap_in_use() - heap_before) / nkeys + sizeof(Evictor_Hook);
+    const auto start = bench_clock::now();
+    for (auto i : order) lru.touch_item(hooks[i], keys[i], sizeof(Item));
+    std::cout << "  Sampled_LRU_Evictor:   " << ntouches / seconds_since(start) << " touches/s, "
+              << bytes << " bytes/key" << std::endl;
+  }
+}
+
+struct Hit_Ratios {
+  double objects;   // share of the gets that hit
+  double bytes;     // share of the bytes read that came from hits
+};
+
+// Replay the requests of a workload against a cache, the same way as
+// get_hit_rate in benchmark.cc, and return the hit ratios of its gets.
+static Hit_Ratios
+replay_hit_ratio(WorkloadGenerator& wg, Cache& cache)
+{
+  const unsigned max = wg.get_total();
+  unsigned set_val_counter = wg.get_num_warmups();
+  unsigned del_val_counter = 0;
+  Cache::size_type sz;
+  unsigned long gets = 0, hits = 0, bytes = 0, hit_bytes = 0;
+  wg.WarmCache(cache);
+  for (unsigned i = 0; i < wg.get_req_size(); ++i)
+  {
+    const std::string req = wg.get_req(i);
+    if (req == "get")
+    {
+      const unsigned idx = wg.get_index(set_val_counter);
+      const bool hit = cache.get(wg.get_key(idx), sz) != nullptr;
+      gets++;
+      bytes += wg.get_size(idx);
+      if (hit)
+      {
+        hits++;
+        hit_bytes += wg.get_size(idx);
+      }
+    }
+    else if (req == "set")
+    {
+      cache.set(wg.get_key(set_val_counter), wg.get_val(set_val_counter), wg.get_size(set_val_counter));
+      set_val_counter = (set_val_counter + 1) % max;
+    }
+    else
+    {
+      cache.del(wg.get_key(del_val_counter));
+      del_val_counter = (del_val_counter + 1) % max;
+    }
+  }
+  return Hit_Ratios{double(hits) / gets, double(hit_bytes) / bytes};
+}
+
+// Hit ratios of every eviction policy on the same workload, for caches
+// holding from a small part to most of the keys being read. Values follow
+// the workload's geometric size distribution, so a size-aware policy like
+// GDSF can trade byte hit ratio for object hit ratio.
+static void
+bench_hit_ratio()
+{
+  WorkloadGenerator wg(290000, 700000, 10000, 50000);
+  const std::vector<std::pair<std::string, std::function<Evictor*()>>> policies = {
+    {"fifo", []() { return new Fifo_Evictor(); }},
+    {"lru", []() { return new LRU_Evictor(); }},
+    {"clock", []() { return new Clock_Evictor(); }},
+    {"s3fifo", []() { return new S3_Fifo_Evictor(); }},
+    {"tinylfu", []() { return new TinyLFU_Evictor(new Intrusive_LRU_Evictor()); }},
+    {"arc", []() { return new ARC_Evictor(); }},
+    {"gdsf", []() { return new GDSF_Evictor(); }},
+    {"sampled lru", []() { return new Sampled_LRU_Evictor(); }},
+    {"slru", []() { return new SLRU_Evictor(); }},
+  };
+  for (Cache::size_type maxmem : {2000u, 8000u, 32000u})
+  {
+    std::cout << "MAXMEM: " << maxmem << std::endl;
+    std::unordered_map<std::string, double> objects;
+    for (const auto& policy : policies)
+    {
+      Cache cache(maxmem, 0.75, policy.second());
+      const Hit_Ratios ratios = replay_hit_ratio(wg, cache);
+      objects[policy.first] = ratios.objects;
+      std::cout << "  " << policy.first << ": " << ratios.objects << " of objects, "
+                << ratios.bytes << " of bytes" << std::endl;
+    }
+    std::cout << "  sampled lru - lru: " << objects["sampled lru"] - objects["lru"] << std::endl;
+  }
+}
+
+// Hit ratio on a hot set of keys read at random, with a scan of as many
+// fresh keys as the cache holds every few thousand reads. Every read that
+// misses sets the key, as a read-through cache would. Under LRU each scan
+// flushes the hot set; a scan-resistant policy keeps it.
+static void
+bench_scan()
+{
+  const unsigned nhot = 1000;
+  const unsigned reads_between_scans = 5000;
+  const unsigned scan_len = 2000;
+  const unsigned rounds = 50;
+  const std::string val(100, 'v');
+  const Cache::size_type maxmem = (nhot + nhot / 5) * (Item::size_for(6, val.size()) + Hash_Index::ENTRY_SIZE);
+
+  const std::vector<std::pair<std::string, std::function<Evictor*()>>> policies = {
+    {"lru", []() { return new LRU_Evictor(); }},
+    {"intrusive lru", []() { return new Intrusive_LRU_Evictor(); }},
+    {"arc", []() { return new ARC_Evictor(); }},
+    {"slru", []() { return new SLRU_Evictor(); }},
+  };
+  std::cout << "HOT KEYS: " << nhot << ", SCAN: " << scan_len << " keys every "
+            << reads_between_scans << " reads" << std::endl;
+  for (const auto& policy : policies)
+  {
+    Cache cache(maxmem, 0.75, policy.second());
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned> pick(0, nhot - 1);
+    unsigned long hot_reads = 0, hot_hits = 0, scanned = 0;
+    Cache::size_type sz;
+    auto read = [&](const std::string& key) {
+      const bool hit = cache.get(key, sz) != nullptr;
+      if (!hit) cache.set(key, val.c_str(), val.size());
+      return hit;
+    };
+    for (unsigned round = 0; round < rounds; round++)
+    {
+      for (unsigned i = 0; i < reads_between_scans; i++)
+      {
+        hot_reads++;
+        hot_hits += read("hot" + std::to_string(pick(gen)));
+      }
+      for (unsigned i = 0; i < scan_len; i++) read("scan" + std::to_string(scanned++));
+    }
+    std::cout << "  " << policy.first << ": " << double(hot_hits) / hot_reads
+              << " of hot reads hit" << std::endl;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const std::string mode = argc > 1 ? argv[1] : "threads";
+  if (mode == "threads") bench_threads();
+  else if (mode == "index")
+  {
+    std::vector<unsigned> sizes;
+    for (int i = 2; i < argc; i++) sizes.push_back(std::stoul(argv[i]));
+    if (sizes.empty()) sizes = {1000000, 100000000};
+    for (auto nkeys : sizes)
+    {
+      std::cout << "KEYS: " << nkeys << std::endl;
+      bench_index(nkeys);
+    }
+  }
+  else if (mode == "warmup") bench_warmup();
+  else if (mode == "evictors")
+  {
+    const unsigned nkeys = argc > 2 ? std::stoul(argv[2]) : 1000000;
+    std::cout << "KEYS: " << nkeys << std::endl;
+    bench_evictors(nkeys);
+  }
+  else if (mode == "hitratio") bench_hit_ratio();
+  else if (mode == "hotkey") bench_hot_key();
+  else if (mode == "scan") bench_scan();
+  else
+  {
+    std::cerr << "unknown mode: " << mode << std::endl;
+    return 1;
+  }
+  return 0;
+}
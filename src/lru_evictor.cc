@@ -63,21 +63,49 @@ LRU_Evictor::evict()
   }
 }
 
+void
+LRU_Evictor::erase_key(const key_type& key)
+// unlinks the key's node from wherever it is in the linked list, and drops it from the unordered map
+{
+  auto it = map_.find(key);
+  if (it == map_.end()) return;
+  std::shared_ptr<Node> N = it->second;
+  if (N->prev_ != nullptr) N->prev_->next_ = N->next_;
+  else LL_->root_ = N->next_;
+  if (N->next_ != nullptr) N->next_->prev_ = N->prev_;
+  else LL_->back_ = N->prev_;
+  N->prev_ = nullptr;
+  N->next_ = nullptr;
+  map_.erase(it);
+}
+
 LRU_Evictor::~LRU_Evictor()
 // destructor needs to delete all the pointers going in one direction in the linked list
 // to prevent mutual ownership between nodes, which prevents automatic deallocation by shared pointers since neither can deallocate the other.
+// Nodes are released one at a time from the front: letting the root free the whole chain
+// through its next_ pointers would recurse once per node and overflow the stack on long lists.
 {
   std::shared_ptr<Node> n = LL_->root_;
-  if (n == nullptr) 
+  LL_->root_ = nullptr;
+  LL_->back_ = nullptr;
+  while (n != nullptr)
   {
-    delete LL_;
-    return;
-  }
-  assert(LL_->back_ != nullptr);
-  while (n->next_ != nullptr)
-  {
-    n = n->next_;
     n->prev_ = nullptr;
+    std::shared_ptr<Node> next = std::move(n->next_);
+    n = std::move(next);
   }
   delete LL_;
 }
+
+std::size_t
+LRU_Evictor::item_overhead(std::size_t key_len) const
+// the node shares one allocation with its shared_ptr control block, and a map
+// entry holds the key, a shared_ptr, the next pointer and the cached hash,
+// plus about one bucket
+{
+  const std::size_t control_block = 2 * sizeof(long);
+  const std::size_t node = sizeof(Node) + control_block;
+  const std::size_t map_entry = sizeof(void*) + sizeof(key_type) + sizeof(std::shared_ptr<Node>)
+                              + sizeof(std::size_t) + sizeof(void*);
+  return node + map_entry + 2 * key_copy_size(key_len);
+}
@@ -20,4 +20,10 @@ class LRU_Evictor : public Evictor {
 
     void touch_key(const key_type&) override;
     const key_type evict() override;
+
+    // unlinks a key, if it is in the list
+    void erase_key(const key_type&) override;
+
+    // a list node and a map entry, each with its own copy of the key
+    std::size_t item_overhead(std::size_t key_len) const override;
 };
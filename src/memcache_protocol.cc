@@ -0,0 +1,584 @@
+/*
+ * Implementation of the memcached protocols declared in memcache_protocol.hh.
+ * A text command is a line ending in "\r\n" (a lone "\n" is accepted too),
+ * made of tokens separated by spaces. Storage commands are followed by a
+ * data block of the announced size, also ending in "\r\n"; until all of it
+ * has arrived the command is left in the read buffer and run again later.
+ * A binary request is a 24 byte header, whose numbers are big endian,
+ * followed by a body of extras, key and value. It is likewise only run once
+ * its whole body has arrived.
+ */
+
+#include "memcache_protocol.hh"
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+// Split the next space separated token off the front of text. Returns an
+// empty token once text has none left.
+static std::string_view
+next_token(std::string_view& text)
+{
+  const std::size_t begin = text.find_first_not_of(' ');
+  if (begin == std::string_view::npos)
+  {
+    text = std::string_view();
+    return text;
+  }
+  std::size_t end = text.find(' ', begin);
+  if (end == std::string_view::npos) end = text.size();
+  const std::string_view token = text.substr(begin, end - begin);
+  text.remove_prefix(end);
+  return token;
+}
+
+// Parse a token that must be a decimal number and nothing else
+template <class T>
+static bool
+parse_number(std::string_view token, T& number)
+{
+  const char* end = token.data() + token.size();
+  const auto res = std::from_chars(token.data(), end, number);
+  return !token.empty() && res.ec == std::errc() && res.ptr == end;
+}
+
+// Turn a memcached expiration time into a TTL: 0 means never, up to 30
+// days it is a number of seconds from now, and beyond that a Unix time.
+// Returns false if that time has already passed.
+static bool
+ttl_for(int64_t exptime, Cache::ttl_type& ttl)
+{
+  const int64_t MAX_RELATIVE = 60 * 60 * 24 * 30;
+  ttl = Cache::ttl_type::zero();
+  if (exptime == 0) return true;
+  if (exptime > MAX_RELATIVE) exptime -= std::time(nullptr);
+  if (exptime <= 0) return false;
+  // cut down to the cache's longest before it overflows in milliseconds
+  const int64_t max = std::chrono::duration_cast<std::chrono::seconds>(Cache::MAX_TTL).count();
+  ttl = std::chrono::seconds(std::min(exptime, max));
+  return true;
+}
+
+// Binary protocol magic bytes, opcodes and statuses
+static constexpr uint8_t REQUEST_MAGIC = 0x80;
+static constexpr uint8_t RESPONSE_MAGIC = 0x81;
+
+static constexpr uint8_t OP_GET = 0x00;
+static constexpr uint8_t OP_SET = 0x01;
+static constexpr uint8_t OP_ADD = 0x02;
+static constexpr uint8_t OP_REPLACE = 0x03;
+static constexpr uint8_t OP_DELETE = 0x04;
+static constexpr uint8_t OP_QUIT = 0x07;
+static constexpr uint8_t OP_FLUSH = 0x08;
+static constexpr uint8_t OP_GETQ = 0x09;
+static constexpr uint8_t OP_NOOP = 0x0a;
+static constexpr uint8_t OP_VERSION = 0x0b;
+static constexpr uint8_t OP_GETK = 0x0c;
+static constexpr uint8_t OP_GETKQ = 0x0d;
+static constexpr uint8_t OP_STAT = 0x10;
+static constexpr uint8_t OP_SETQ = 0x11;
+static constexpr uint8_t OP_ADDQ = 0x12;
+static constexpr uint8_t OP_REPLACEQ = 0x13;
+static constexpr uint8_t OP_DELETEQ = 0x14;
+static constexpr uint8_t OP_QUITQ = 0x17;
+static constexpr uint8_t OP_FLUSHQ = 0x18;
+
+static constexpr uint16_t STATUS_OK = 0x00;
+static constexpr uint16_t STATUS_NOT_FOUND = 0x01;
+static constexpr uint16_t STATUS_EXISTS = 0x02;
+static constexpr uint16_t STATUS_TOO_LARGE = 0x03;
+static constexpr uint16_t STATUS_INVALID = 0x04;
+static constexpr uint16_t STATUS_UNKNOWN_COMMAND = 0x81;
+static constexpr uint16_t STATUS_NO_MEMORY = 0x82;
+
+// Quiet opcodes leave out the responses a pipelining client can do without:
+// quiet gets only answer hits, and the others only answer errors
+static bool
+quiet(uint8_t opcode)
+{
+  switch (opcode)
+  {
+    case OP_GETQ: case OP_GETKQ: case OP_SETQ: case OP_ADDQ: case OP_REPLACEQ:
+    case OP_DELETEQ: case OP_QUITQ: case OP_FLUSHQ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static uint64_t
+load_big_endian(const char* data, std::size_t size)
+{
+  uint64_t number = 0;
+  for (std::size_t i = 0; i < size; ++i) number = number << 8 | static_cast<unsigned char>(data[i]);
+  return number;
+}
+
+static void
+store_big_endian(char* data, std::size_t size, uint64_t number)
+{
+  for (std::size_t i = size; i-- > 0; number >>= 8) data[i] = static_cast<char>(number & 0xff);
+}
+
+std::size_t
+Memcache_Connection::consume(const char* data, std::size_t size)
+{
+  if (protocol_ == Protocol::UNKNOWN && size > 0)
+  {
+    protocol_ = static_cast<unsigned char>(data[0]) == REQUEST_MAGIC ? Protocol::BINARY : Protocol::TEXT;
+  }
+  std::size_t pos = 0;
+  while (pos < size && !closing_)
+  {
+    if (skip_ > 0)
+    {
+      const std::size_t n = std::min(skip_, size - pos);
+      skip_ -= n;
+      pos += n;
+      continue;
+    }
+    const std::size_t used = protocol_ == Protocol::BINARY
+      ? run_packet(data + pos, size - pos)
+      : run_line(data + pos, size - pos);
+    if (used == NEED_MORE) break;
+    pos += used;
+  }
+  return pos;
+}
+
+// Run the text command at the start of data. Returns how many bytes it
+// took, or NEED_MORE if it isn't all there yet.
+std::size_t
+Memcache_Connection::run_line(const char* data, std::size_t size)
+{
+  const char* eol = static_cast<const char*>(std::memchr(data, '\n', size));
+  const std::size_t len = eol == nullptr ? size : eol - data;
+  if (len > MAX_LINE)
+  {
+    out_.append("CLIENT_ERROR line too long\r\n");
+    closing_ = true;
+    return size;
+  }
+  if (eol == nullptr) return NEED_MORE;
+  std::string_view text(data, len);
+  if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+  const std::size_t used = run(text, eol + 1, size - len - 1);
+  return used == NEED_MORE ? NEED_MORE : len + 1 + used;
+}
+
+// Run one command line, given the bytes that follow it. Returns how many
+// of those the command took as its data block, or NEED_MORE if its data
+// block isn't all there yet.
+std::size_t
+Memcache_Connection::run(std::string_view line, const char* data, std::size_t size)
+{
+  std::string_view args = line;
+  const std::string_view cmd = next_token(args);
+  if (cmd == "get") retrieve(args, false);
+  else if (cmd == "gets") retrieve(args, true);
+  else if (cmd == "set" || cmd == "add" || cmd == "replace") return store(cmd, args, data, size);
+  else if (cmd == "delete") remove(args);
+  else if (cmd == "flush_all") flush(args);
+  else if (cmd == "stats" && next_token(args).empty()) stats();
+  else if (cmd == "version") out_.append("VERSION 1.6.0\r\n");
+  else if (cmd == "quit") closing_ = true;
+  else out_.append("ERROR\r\n");
+  return 0;
+}
+
+// <cmd> <key> <flags> <exptime> <bytes> [noreply], then the data block
+std::size_t
+Memcache_Connection::store(std::string_view cmd, std::string_view args, const char* data, std::size_t size)
+{
+  const std::string_view key = next_token(args);
+  uint32_t flags = 0;
+  int64_t exptime = 0;
+  uint32_t bytes = 0;
+  const bool line_ok = parse_number(next_token(args), flags) && parse_number(next_token(args), exptime);
+  if (!parse_number(next_token(args), bytes))
+  {
+    out_.append("CLIENT_ERROR bad command line format\r\n");
+    return 0;
+  }
+  const std::string_view opt = next_token(args);
+  const bool noreply = opt == "noreply";
+  // the data block is on its way whatever is wrong with the command, and
+  // must not be taken for commands
+  if (!line_ok || !set_key(key) || (!opt.empty() && !noreply) || !next_token(args).empty())
+  {
+    out_.append("CLIENT_ERROR bad command line format\r\n");
+    skip_ = bytes + 2;
+    return 0;
+  }
+  if (bytes > MAX_VALUE)
+  {
+    out_.append("SERVER_ERROR object too large for cache\r\n");
+    skip_ = bytes + 2;
+    return 0;
+  }
+  if (size < bytes + 2) return NEED_MORE;
+  if (data[bytes] != '\r' || data[bytes + 1] != '\n')
+  {
+    out_.append("CLIENT_ERROR bad data chunk\r\n");
+    return bytes + 2;
+  }
+
+  const Store_Mode mode = cmd == "add" ? Store_Mode::ADD
+    : cmd == "replace" ? Store_Mode::REPLACE : Store_Mode::SET;
+  const Store_Result res = store_value(mode, data, bytes, exptime);
+  if (!noreply)
+  {
+    out_.append(res == Store_Result::STORED ? "STORED\r\n"
+           : res == Store_Result::NOT_STORED ? "NOT_STORED\r\n"
+           : "SERVER_ERROR out of memory storing object\r\n");
+  }
+  return bytes + 2;
+}
+
+// get|gets <key>*: one VALUE line and data block per key found, then END
+void
+Memcache_Connection::retrieve(std::string_view keys, bool with_cas)
+{
+  std::string_view rest = keys;
+  std::string_view key = next_token(rest);
+  if (key.empty())
+  {
+    out_.append("ERROR\r\n");
+    return;
+  }
+  for (; !key.empty(); key = next_token(rest))
+  {
+    if (key.size() > MAX_KEY)
+    {
+      out_.append("CLIENT_ERROR bad command line format\r\n");
+      return;
+    }
+  }
+  for (key = next_token(keys); !key.empty(); key = next_token(keys))
+  {
+    set_key(key);
+    Cache::handle value = cache_.get(key_);
+    if (!value) continue;
+    out_.append("VALUE ");
+    out_.append(key);
+    out_.append(" 0 ");
+    out_.append_number(value.size());
+    if (with_cas) out_.append(" 0");
+    out_.append("\r\n");
+    out_.append_value(std::move(value));
+    out_.append("\r\n");
+  }
+  out_.append("END\r\n");
+}
+
+// delete <key> [0] [noreply]
+void
+Memcache_Connection::remove(std::string_view args)
+{
+  const std::string_view key = next_token(args);
+  bool noreply = false;
+  bool ok = set_key(key);
+  for (std::string_view opt = next_token(args); ok && !opt.empty(); opt = next_token(args))
+  {
+    if (opt == "noreply") noreply = true;
+    else ok = opt == "0";
+  }
+  if (!ok)
+  {
+    out_.append("CLIENT_ERROR bad command line format.  Usage: delete <key> [noreply]\r\n");
+    return;
+  }
+  const bool deleted = cache_.del(key_);
+  if (!noreply) out_.append(deleted ? "DELETED\r\n" : "NOT_FOUND\r\n");
+}
+
+// flush_all [delay] [noreply]. The cache is emptied right away, whatever
+// the delay.
+void
+Memcache_Connection::flush(std::string_view args)
+{
+  bool noreply = false;
+  uint64_t delay = 0;
+  for (std::string_view opt = next_token(args); !opt.empty(); opt = next_token(args))
+  {
+    if (opt == "noreply") noreply = true;
+    else if (!parse_number(opt, delay))
+    {
+      out_.append("CLIENT_ERROR bad command line format\r\n");
+      return;
+    }
+  }
+  cache_.reset();
+  if (!noreply) out_.append("OK\r\n");
+}
+
+// stats, with no arguments
+void
+Memcache_Connection::stats()
+{
+  for_each_stat([this](std::string_view name, uint64_t value) {
+    out_.append("STAT ");
+    out_.append(name);
+    out_.append(" ");
+    out_.append_number(value);
+    out_.append("\r\n");
+  });
+  out_.append("END\r\n");
+}
+
+// Run the binary request at the start of data. Returns how many bytes it
+// took, or NEED_MORE if it isn't all there yet.
+std::size_t
+Memcache_Connection::run_packet(const char* data, std::size_t size)
+{
+  if (static_cast<unsigned char>(data[0]) != REQUEST_MAGIC)
+  {
+    // there's no telling where the next request starts
+    closing_ = true;
+    return size;
+  }
+  if (size < HEADER_SIZE) return NEED_MORE;
+  Request req;
+  req.opcode_ = static_cast<uint8_t>(data[1]);
+  const std::size_t key_len = load_big_endian(data + 2, 2);
+  const std::size_t extras_len = static_cast<unsigned char>(data[4]);
+  const std::size_t body_len = load_big_endian(data + 8, 4);
+  req.opaque_ = static_cast<uint32_t>(load_big_endian(data + 12, 4));
+  req.cas_ = load_big_endian(data + 16, 8);
+
+  // a refused body is thrown away as it arrives
+  if (key_len + extras_len > body_len || key_len > MAX_KEY)
+  {
+    respond(req, STATUS_INVALID, "Invalid arguments");
+    skip_ = body_len;
+    return HEADER_SIZE;
+  }
+  if (body_len - key_len - extras_len > MAX_VALUE)
+  {
+    respond(req, STATUS_TOO_LARGE, "Too large.");
+    skip_ = body_len;
+    return HEADER_SIZE;
+  }
+  if (size - HEADER_SIZE < body_len) return NEED_MORE;
+
+  const std::string_view body(data + HEADER_SIZE, body_len);
+  req.extras_ = body.substr(0, extras_len);
+  req.key_ = body.substr(extras_len, key_len);
+  req.value_ = body.substr(extras_len + key_len);
+  run(req);
+  return HEADER_SIZE + body_len;
+}
+
+void
+Memcache_Connection::run(const Request& req)
+{
+  switch (req.opcode_)
+  {
+    case OP_GET: case OP_GETQ: case OP_GETK: case OP_GETKQ:
+      return binary_get(req);
+    case OP_SET: case OP_SETQ: case OP_ADD: case OP_ADDQ: case OP_REPLACE: case OP_REPLACEQ:
+      return binary_store(req);
+    case OP_DELETE: case OP_DELETEQ:
+      return binary_delete(req);
+    case OP_FLUSH: case OP_FLUSHQ:
+      // the cache is emptied right away, whatever the expiration given
+      if (!req.key_.empty() || !req.value_.empty() || (!req.extras_.empty() && req.extras_.size() != 4))
+      {
+        return respond(req, STATUS_INVALID, "Invalid arguments");
+      }
+      cache_.reset();
+      if (!quiet(req.opcode_)) respond(req, STATUS_OK);
+      return;
+    case OP_STAT:
+      return binary_stats(req);
+    case OP_VERSION:
+      return respond(req, STATUS_OK, "1.6.0");
+    case OP_NOOP:
+      // answered in order after everything before it, which is what lets a
+      // client tell that a batch of quiet requests is done
+      return respond(req, STATUS_OK);
+    case OP_QUIT: case OP_QUITQ:
+      if (!quiet(req.opcode_)) respond(req, STATUS_OK);
+      closing_ = true;
+      return;
+    default:
+      return respond(req, STATUS_UNKNOWN_COMMAND, "Unknown command");
+  }
+}
+
+// get, getq, getk and getkq: the value after 4 bytes of flags, and after
+// the key for getk and getkq
+void
+Memcache_Connection::binary_get(const Request& req)
+{
+  if (!req.extras_.empty() || !req.value_.empty() || !set_key(req.key_))
+  {
+    return respond(req, STATUS_INVALID, "Invalid arguments");
+  }
+  Cache::handle value = cache_.get(key_);
+  if (!value)
+  {
+    if (!quiet(req.opcode_)) respond(req, STATUS_NOT_FOUND, "Not found");
+    return;
+  }
+  const bool with_key = req.opcode_ == OP_GETK || req.opcode_ == OP_GETKQ;
+  const std::size_t key_len = with_key ? req.key_.size() : 0;
+  append_header(req, STATUS_OK, 4, key_len, 4 + key_len + value.size());
+  out_.append(std::string_view("\0\0\0\0", 4));
+  if (with_key) out_.append(req.key_);
+  out_.append_value(std::move(value));
+}
+
+// set, add, replace and their quiet forms, with 4 bytes of flags and 4 of
+// expiration time as extras
+void
+Memcache_Connection::binary_store(const Request& req)
+{
+  if (req.extras_.size() != 8 || !set_key(req.key_))
+  {
+    return respond(req, STATUS_INVALID, "Invalid arguments");
+  }
+  if (cas_mismatch(req)) return;
+  const int64_t exptime = load_big_endian(req.extras_.data() + 4, 4);
+  const Store_Mode mode = req.opcode_ == OP_ADD || req.opcode_ == OP_ADDQ ? Store_Mode::ADD
+    : req.opcode_ == OP_REPLACE || req.opcode_ == OP_REPLACEQ ? Store_Mode::REPLACE
+    : Store_Mode::SET;
+  switch (store_value(mode, req.value_.data(), req.value_.size(), exptime))
+  {
+    case Store_Result::STORED:
+      if (!quiet(req.opcode_)) respond(req, STATUS_OK);
+      return;
+    case Store_Result::NOT_STORED:
+      if (mode == Store_Mode::ADD) return respond(req, STATUS_EXISTS, "Data exists for key.");
+      return respond(req, STATUS_NOT_FOUND, "Not found");
+    case Store_Result::NO_MEMORY:
+      return respond(req, STATUS_NO_MEMORY, "Out of memory");
+  }
+}
+
+// delete and deleteq
+void
+Memcache_Connection::binary_delete(const Request& req)
+{
+  if (!req.extras_.empty() || !req.value_.empty() || !set_key(req.key_))
+  {
+    return respond(req, STATUS_INVALID, "Invalid arguments");
+  }
+  if (cas_mismatch(req)) return;
+  if (!cache_.del(key_)) return respond(req, STATUS_NOT_FOUND, "Not found");
+  if (!quiet(req.opcode_)) respond(req, STATUS_OK);
+}
+
+// stat, with no key: one response per statistic, with its name as key and
+// its value as text, then one with neither
+void
+Memcache_Connection::binary_stats(const Request& req)
+{
+  if (!req.key_.empty()) return respond(req, STATUS_NOT_FOUND, "Not found");
+  for_each_stat([this, &req](std::string_view name, uint64_t value) {
+    char buf[20];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    const std::size_t len = res.ptr - buf;
+    append_header(req, STATUS_OK, 0, name.size(), name.size() + len);
+    out_.append(name);
+    out_.append(std::string_view(buf, len));
+  });
+  respond(req, STATUS_OK);
+}
+
+// The cache keeps no CAS values, so a request that gives one never matches
+// the item: it is answered as memcached answers a stale CAS, and the caller
+// must not go on with it. Returns false for requests that give none.
+bool
+Memcache_Connection::cas_mismatch(const Request& req)
+{
+  if (req.cas_ == 0) return false;
+  if (cache_.contains(key_)) respond(req, STATUS_EXISTS, "Data exists for key.");
+  else respond(req, STATUS_NOT_FOUND, "Not found");
+  return true;
+}
+
+// Queue a response to req with no extras nor key, and value as its body
+void
+Memcache_Connection::respond(const Request& req, uint16_t status, std::string_view value)
+{
+  append_header(req, status, 0, 0, value.size());
+  out_.append(value);
+}
+
+// Queue the header of a response to req, whose body_len bytes of extras,
+// key and value must be queued next
+void
+Memcache_Connection::append_header(const Request& req, uint16_t status, std::size_t extras_len,
+                                   std::size_t key_len, std::size_t body_len)
+{
+  char header[HEADER_SIZE] = {};
+  header[0] = static_cast<char>(RESPONSE_MAGIC);
+  header[1] = static_cast<char>(req.opcode_);
+  store_big_endian(header + 2, 2, key_len);
+  header[4] = static_cast<char>(extras_len);
+  store_big_endian(header + 6, 2, status);
+  store_big_endian(header + 8, 4, body_len);
+  store_big_endian(header + 12, 4, req.opaque_);
+  out_.append(std::string_view(header, HEADER_SIZE));
+}
+
+// Set the current key to value, leaving it alone when the mode says it
+// must or must not be there already and it isn't, or is. A value that is
+// already expired only removes the old one.
+Memcache_Connection::Store_Result
+Memcache_Connection::store_value(Store_Mode mode, const char* data, std::size_t size, int64_t exptime)
+{
+  if (mode != Store_Mode::SET && cache_.contains(key_) != (mode == Store_Mode::REPLACE))
+  {
+    return Store_Result::NOT_STORED;
+  }
+  Cache::ttl_type ttl;
+  if (!ttl_for(exptime, ttl))
+  {
+    cache_.del(key_);
+    return Store_Result::STORED;
+  }
+  return cache_.set(key_, data, size, ttl) ? Store_Result::STORED : Store_Result::NO_MEMORY;
+}
+
+// Call f(name, value) on the general statistics that map onto the cache's
+// counters
+template <class F>
+void
+Memcache_Connection::for_each_stat(F f)
+{
+  uint64_t items = 0, hits = 0, misses = 0, sets = 0, evictions = 0, expired = 0;
+  for (const auto& st : cache_.stats())
+  {
+    items += st.items;
+    hits += st.hits;
+    misses += st.misses;
+    sets += st.sets;
+    evictions += st.evictions;
+    expired += st.expired;
+  }
+  f("pid", getpid());
+  f("time", std::time(nullptr));
+  f("curr_items", items);
+  f("bytes", cache_.space_used());
+  f("cmd_get", hits + misses);
+  f("get_hits", hits);
+  f("get_misses", misses);
+  f("total_items", sets);
+  f("evictions", evictions);
+  f("reclaimed", expired);
+}
+
+// Make key the current key, if it is a valid one
+bool
+Memcache_Connection::set_key(std::string_view key)
+{
+  if (key.empty() || key.size() > MAX_KEY) return false;
+  key_.assign(key.data(), key.size());
+  return true;
+}
+
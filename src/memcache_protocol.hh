@@ -0,0 +1,125 @@
+/*
+ * Declarations for the memcached text and binary protocols, which
+ * cache_server speaks on its memcache port on top of the same Cache as the
+ * HTTP front end. Like memcached, a connection speaks the binary protocol
+ * if the first byte it sends is the binary magic byte, and text otherwise.
+ * A Memcache_Connection holds the state of one client connection: it runs
+ * the commands found in the bytes read from the socket and queues their
+ * responses. Commands are parsed in place in the read buffer, and values
+ * are answered straight from the cache's memory (see Response_Queue), so a
+ * connection allocates nothing once its buffers have grown to fit its
+ * traffic (keys longer than the short string buffer aside).
+ * It knows nothing of sockets: the server hands it what it reads and
+ * writes out what it queues.
+ *
+ * Text commands: get, gets, set, add, replace, delete, flush_all, stats,
+ * version and quit. Binary opcodes: get, getk, set, add, replace, delete,
+ * flush, stat, version, noop and quit, and their quiet forms, so that a
+ * client can pipeline a batch of them behind a noop: quiet gets only
+ * answer hits, and quiet sets and deletes only answer errors.
+ * The cache keeps no client flags nor CAS values, so values come back
+ * with flags 0 and a CAS of 0, and a binary request that gives a CAS never
+ * matches. add and replace look the key up before setting it (without
+ * counting it as a hit or miss), so they may race with a concurrent set
+ * of the same key.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cache.hh"
+#include "response_queue.hh"
+
+class Memcache_Connection {
+  public:
+    // Longest command line accepted, which leaves room for multi-gets of
+    // a few hundred keys
+    static constexpr std::size_t MAX_LINE = 64 * 1024;
+
+    // Longest key accepted, as in memcached
+    static constexpr std::size_t MAX_KEY = 250;
+
+    // Largest value a storage command may carry; larger ones are read and
+    // thrown away
+    static constexpr std::size_t MAX_VALUE = 1 << 20;
+
+    // Size of a binary request or response header
+    static constexpr std::size_t HEADER_SIZE = 24;
+
+  private:
+    enum class Protocol { UNKNOWN, TEXT, BINARY };
+    enum class Store_Mode { SET, ADD, REPLACE };
+    enum class Store_Result { STORED, NOT_STORED, NO_MEMORY };
+
+    // A binary request whose body has all arrived
+    struct Request {
+      uint8_t opcode_;
+      uint32_t opaque_;            // echoed back in the response
+      uint64_t cas_;
+      std::string_view extras_;
+      std::string_view key_;
+      std::string_view value_;
+    };
+
+    Cache& cache_;
+    Response_Queue out_;
+    key_type key_;                    // key of the command being run, reused
+    std::size_t skip_ = 0;            // bytes of a refused value still to throw away
+    bool closing_ = false;
+    Protocol protocol_ = Protocol::UNKNOWN;
+
+    static constexpr std::size_t NEED_MORE = static_cast<std::size_t>(-1);
+
+    // Text protocol
+    std::size_t run_line(const char* data, std::size_t size);
+    std::size_t run(std::string_view line, const char* data, std::size_t size);
+    std::size_t store(std::string_view cmd, std::string_view args, const char* data, std::size_t size);
+    void retrieve(std::string_view keys, bool with_cas);
+    void remove(std::string_view args);
+    void flush(std::string_view args);
+    void stats();
+
+    // Binary protocol
+    std::size_t run_packet(const char* data, std::size_t size);
+    void run(const Request& req);
+    void binary_get(const Request& req);
+    void binary_store(const Request& req);
+    void binary_delete(const Request& req);
+    void binary_stats(const Request& req);
+    bool cas_mismatch(const Request& req);
+    void respond(const Request& req, uint16_t status, std::string_view value = std::string_view());
+    void append_header(const Request& req, uint16_t status, std::size_t extras_len,
+                       std::size_t key_len, std::size_t body_len);
+
+    // Shared by both
+    Store_Result store_value(Store_Mode mode, const char* data, std::size_t size, int64_t exptime);
+    template <class F> void for_each_stat(F f);
+    bool set_key(std::string_view key);
+
+  public:
+    explicit Memcache_Connection(Cache& cache) : cache_(cache) {}
+    Memcache_Connection(const Memcache_Connection&) = delete;
+    Memcache_Connection& operator=(const Memcache_Connection&) = delete;
+
+    // Run every complete command at the start of data, queueing their
+    // responses, and return how many bytes they took. The rest (a partial
+    // command) must be handed in again, followed by more bytes.
+    std::size_t consume(const char* data, std::size_t size);
+
+    // Call f(data, size) on every buffer of the queued responses, in order
+    template <class F>
+    void for_each_buffer(F f) const { out_.for_each_buffer(f); }
+
+    // Whether any response is queued
+    bool empty() const { return out_.empty(); }
+
+    // Forget the queued responses once written, unpinning their values
+    void clear() { out_.clear(); }
+
+    // Whether the connection should be closed once the queued responses
+    // are written, after a quit or an error the stream can't recover from
+    bool closing() const { return closing_; }
+};
@@ -0,0 +1,355 @@
+/*
+ * Implementation of the Redis protocol declared in resp_protocol.hh.
+ * A command is normally an array of bulk strings: "*<count>\r\n", then for
+ * each argument "$<length>\r\n<bytes>\r\n". Anything else is taken for an
+ * inline command, a line of arguments separated by spaces. Until a whole
+ * command has arrived it is left in the read buffer; an array's arguments
+ * are parsed as they arrive, and the parser picks up after the last whole
+ * one when more bytes come in.
+ */
+
+#include "resp_protocol.hh"
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+// Whether arg names the command name, which is lower case, in any case
+static bool
+is_command(std::string_view arg, std::string_view name)
+{
+  if (arg.size() != name.size()) return false;
+  for (std::size_t i = 0; i < arg.size(); ++i)
+  {
+    const char ch = arg[i] >= 'A' && arg[i] <= 'Z' ? arg[i] - 'A' + 'a' : arg[i];
+    if (ch != name[i]) return false;
+  }
+  return true;
+}
+
+std::size_t
+Resp_Connection::consume(const char* data, std::size_t size)
+{
+  std::size_t pos = 0;
+  while (pos < size && !closing_)
+  {
+    const std::size_t used = data[pos] == '*'
+      ? parse(data + pos, size - pos)
+      : parse_inline(data + pos, size - pos);
+    if (used == NEED_MORE) break;
+    if (!args_.empty()) run();
+    pos += used;
+  }
+  return pos;
+}
+
+// Read the number on the array or bulk string header at the start of data,
+// after its type byte. Returns the length of the header with its "\r\n",
+// NEED_MORE if it isn't all there, or 0 if it isn't well formed.
+std::size_t
+Resp_Connection::read_header(const char* data, std::size_t size, int64_t& number)
+{
+  const char* eol = static_cast<const char*>(std::memchr(data, '\n', std::min(size, MAX_INLINE)));
+  if (eol == nullptr) return size < MAX_INLINE ? NEED_MORE : 0;
+  if (eol[-1] != '\r') return 0;
+  const auto res = std::from_chars(data + 1, eol - 1, number);
+  if (res.ec != std::errc() || res.ptr != eol - 1) return 0;
+  return eol + 1 - data;
+}
+
+// Parse the array of bulk strings at the start of data into args_.
+// Returns how many bytes it took, or NEED_MORE if it isn't all there yet.
+// The arguments already received are remembered, so that each call only
+// parses what arrived since the last one.
+std::size_t
+Resp_Connection::parse(const char* data, std::size_t size)
+{
+  if (arg_count_ < 0)
+  {
+    int64_t count = 0;
+    const std::size_t header = read_header(data, size, count);
+    if (header == NEED_MORE) return NEED_MORE;
+    if (header == 0 || count > static_cast<int64_t>(MAX_ARGS)) return protocol_error("invalid multibulk length", size);
+    arg_count_ = std::max<int64_t>(count, 0);
+    parsed_ = header;
+    spans_.clear();
+  }
+  std::size_t pos = parsed_;
+  while (spans_.size() < static_cast<std::size_t>(arg_count_))
+  {
+    // the next call starts over from the argument that isn't all there
+    parsed_ = pos;
+    if (pos == size) return NEED_MORE;
+    if (data[pos] != '$') return protocol_error("expected '$'", size);
+    int64_t len = 0;
+    const std::size_t header = read_header(data + pos, size - pos, len);
+    if (header == NEED_MORE) return NEED_MORE;
+    if (header == 0 || len < 0 || len > static_cast<int64_t>(MAX_BULK))
+    {
+      return protocol_error("invalid bulk length", size);
+    }
+    // refused before the string arrives, so the buffer never outgrows the cap
+    if (pos + header + len + 2 > MAX_REQUEST) return protocol_error("too big request", size);
+    if (size - pos - header < static_cast<std::size_t>(len) + 2) return NEED_MORE;
+    pos += header;
+    if (data[pos + len] != '\r' || data[pos + len + 1] != '\n')
+    {
+      return protocol_error("expected CRLF after bulk string", size);
+    }
+    spans_.push_back(Span{pos, static_cast<std::size_t>(len)});
+    pos += len + 2;
+  }
+  args_.clear();
+  for (const Span& span : spans_) args_.emplace_back(data + span.offset_, span.size_);
+  arg_count_ = -1;
+  parsed_ = 0;
+  return pos;
+}
+
+// Parse the inline command at the start of data into args_. Returns how
+// many bytes it took, or NEED_MORE if it isn't all there yet.
+std::size_t
+Resp_Connection::parse_inline(const char* data, std::size_t size)
+{
+  args_.clear();
+  const char* eol = static_cast<const char*>(std::memchr(data, '\n', std::min(size, MAX_INLINE)));
+  if (eol == nullptr) return size < MAX_INLINE ? NEED_MORE : protocol_error("too big inline request", size);
+  std::string_view line(data, eol - data);
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+  for (std::size_t begin = line.find_first_not_of(" \t"); begin != std::string_view::npos;
+       begin = line.find_first_not_of(" \t", begin))
+  {
+    const std::size_t end = std::min(line.find_first_of(" \t", begin), line.size());
+    args_.push_back(line.substr(begin, end - begin));
+    begin = end;
+  }
+  return eol + 1 - data;
+}
+
+// Answer a malformed command, after which there's no telling where the
+// next one starts, so the connection is closed. Returns size, to take all
+// of the rest.
+std::size_t
+Resp_Connection::protocol_error(std::string_view why, std::size_t size)
+{
+  out_.append("-ERR Protocol error: ");
+  out_.append(why);
+  out_.append("\r\n");
+  args_.clear();
+  arg_count_ = -1;
+  closing_ = true;
+  return size;
+}
+
+void
+Resp_Connection::run()
+{
+  const std::string_view cmd = args_[0];
+  if (is_command(cmd, "get")) get();
+  else if (is_command(cmd, "set")) set();
+  else if (is_command(cmd, "del")) del();
+  else if (is_command(cmd, "mget")) mget();
+  else if (is_command(cmd, "mset")) mset();
+  else if (is_command(cmd, "exists")) exists();
+  else if (is_command(cmd, "info")) info();
+  else if (is_command(cmd, "ping")) ping();
+  else if (is_command(cmd, "flushall"))
+  {
+    // the cache is emptied right away, asked to or not
+    if (args_.size() > 2 || (args_.size() == 2 && !is_command(args_[1], "async") && !is_command(args_[1], "sync")))
+    {
+      out_.append("-ERR syntax error\r\n");
+      return;
+    }
+    cache_.reset();
+    out_.append("+OK\r\n");
+  }
+  else if (is_command(cmd, "quit"))
+  {
+    out_.append("+OK\r\n");
+    closing_ = true;
+  }
+  else out_.append("-ERR unknown command\r\n");
+}
+
+// GET key
+void
+Resp_Connection::get()
+{
+  if (args_.size() != 2) return append_arity_error("get");
+  append_value(cache_.get(set_key(args_[1])));
+}
+
+// SET key value [EX seconds|PX milliseconds]
+void
+Resp_Connection::set()
+{
+  if (args_.size() < 3) return append_arity_error("set");
+  if (args_[1].empty()) return append_empty_key_error();
+  Cache::ttl_type ttl = Cache::ttl_type::zero();
+  for (std::size_t i = 3; i < args_.size(); i += 2)
+  {
+    const bool ex = is_command(args_[i], "ex");
+    if ((!ex && !is_command(args_[i], "px")) || i + 1 == args_.size() || ttl != Cache::ttl_type::zero())
+    {
+      out_.append("-ERR syntax error\r\n");
+      return;
+    }
+    const std::string_view arg = args_[i + 1];
+    int64_t number = 0;
+    const auto res = std::from_chars(arg.data(), arg.data() + arg.size(), number);
+    const int64_t max = std::numeric_limits<int64_t>::max() / (ex ? 1000 : 1);
+    if (res.ec != std::errc() || res.ptr != arg.data() + arg.size() || number <= 0 || number > max)
+    {
+      out_.append("-ERR invalid expire time in 'set' command\r\n");
+      return;
+    }
+    ttl = Cache::ttl_type(ex ? number * 1000 : number);
+  }
+  const std::string_view val = args_[2];
+  if (cache_.set(set_key(args_[1]), val.data(), val.size(), ttl)) out_.append("+OK\r\n");
+  else out_.append("-OOM not enough memory to store the value\r\n");
+}
+
+// DEL key [key ...]: how many of the keys were there
+void
+Resp_Connection::del()
+{
+  if (args_.size() < 2) return append_arity_error("del");
+  uint64_t deleted = 0;
+  for (std::size_t i = 1; i < args_.size(); ++i) deleted += cache_.del(set_key(args_[i]));
+  append_integer(deleted);
+}
+
+// MGET key [key ...]: the value of every key, or nil for missing ones
+void
+Resp_Connection::mget()
+{
+  if (args_.size() < 2) return append_arity_error("mget");
+  out_.append("*");
+  out_.append_number(args_.size() - 1);
+  out_.append("\r\n");
+  for (std::size_t i = 1; i < args_.size(); ++i) append_value(cache_.get(set_key(args_[i])));
+}
+
+// MSET key value [key value ...]. Pairs that fit are stored even if an
+// earlier one didn't.
+void
+Resp_Connection::mset()
+{
+  if (args_.size() < 3 || args_.size() % 2 == 0) return append_arity_error("mset");
+  for (std::size_t i = 1; i < args_.size(); i += 2)
+  {
+    if (args_[i].empty()) return append_empty_key_error();
+  }
+  bool stored = true;
+  for (std::size_t i = 1; i < args_.size(); i += 2)
+  {
+    stored &= cache_.set(set_key(args_[i]), args_[i + 1].data(), args_[i + 1].size());
+  }
+  if (stored) out_.append("+OK\r\n");
+  else out_.append("-OOM not enough memory to store the value\r\n");
+}
+
+// EXISTS key [key ...]: how many of the keys are there, counting repeats
+void
+Resp_Connection::exists()
+{
+  if (args_.size() < 2) return append_arity_error("exists");
+  uint64_t found = 0;
+  for (std::size_t i = 1; i < args_.size(); ++i) found += bool(cache_.get(set_key(args_[i])));
+  append_integer(found);
+}
+
+// INFO [section]: the fields of Redis's INFO that map onto the cache's
+// counters, whatever the section asked for
+void
+Resp_Connection::info()
+{
+  if (args_.size() > 2) return append_arity_error("info");
+  uint64_t items = 0, hits = 0, misses = 0, evictions = 0, expired = 0;
+  for (const auto& st : cache_.stats())
+  {
+    items += st.items;
+    hits += st.hits;
+    misses += st.misses;
+    evictions += st.evictions;
+    expired += st.expired;
+  }
+  std::string text = "# Server\r\nredis_version:6.0.0\r\nprocess_id:" + std::to_string(getpid())
+    + "\r\n\r\n# Memory\r\nused_memory:" + std::to_string(cache_.space_used())
+    + "\r\n\r\n# Stats\r\nkeyspace_hits:" + std::to_string(hits)
+    + "\r\nkeyspace_misses:" + std::to_string(misses)
+    + "\r\nexpired_keys:" + std::to_string(expired)
+    + "\r\nevicted_keys:" + std::to_string(evictions)
+    + "\r\n\r\n# Keyspace\r\ndb0:keys=" + std::to_string(items) + "\r\n";
+  append_bulk(text);
+}
+
+// PING [message]
+void
+Resp_Connection::ping()
+{
+  if (args_.size() > 2) return append_arity_error("ping");
+  if (args_.size() == 2) append_bulk(args_[1]);
+  else out_.append("+PONG\r\n");
+}
+
+// Make key the current key, and return it
+const key_type&
+Resp_Connection::set_key(std::string_view key)
+{
+  key_.assign(key.data(), key.size());
+  return key_;
+}
+
+// Queue a value as a bulk string, or nil if there's none
+void
+Resp_Connection::append_value(Cache::handle&& value)
+{
+  if (!value)
+  {
+    out_.append("$-1\r\n");
+    return;
+  }
+  out_.append("$");
+  out_.append_number(value.size());
+  out_.append("\r\n");
+  out_.append_value(std::move(value));
+  out_.append("\r\n");
+}
+
+void
+Resp_Connection::append_bulk(std::string_view text)
+{
+  out_.append("$");
+  out_.append_number(text.size());
+  out_.append("\r\n");
+  out_.append(text);
+  out_.append("\r\n");
+}
+
+void
+Resp_Connection::append_integer(uint64_t number)
+{
+  out_.append(":");
+  out_.append_number(number);
+  out_.append("\r\n");
+}
+
+void
+Resp_Connection::append_arity_error(std::string_view cmd)
+{
+  out_.append("-ERR wrong number of arguments for '");
+  out_.append(cmd);
+  out_.append("' command\r\n");
+}
+
+// The cache can't store a value under an empty key
+void
+Resp_Connection::append_empty_key_error()
+{
+  out_.append("-ERR empty keys are not supported\r\n");
+}
@@ -0,0 +1,103 @@
+/*
+ * Declarations for the Redis protocol (RESP2), which cache_server speaks on
+ * its RESP port on top of the same Cache as the HTTP front end, so that
+ * Redis client libraries can use the cache as is.
+ * A Resp_Connection holds the state of one client connection: it runs the
+ * commands found in the bytes read from the socket and queues their
+ * replies. Commands are parsed in place in the read buffer, and values are
+ * answered straight from the cache's memory (see Response_Queue). Like
+ * Memcache_Connection, it knows nothing of sockets.
+ *
+ * Commands: GET, SET with EX or PX, DEL, MGET, MSET, EXISTS, FLUSHALL,
+ * INFO, PING and QUIT, sent as arrays of bulk strings or as inline
+ * commands. There is a single database, and values are plain strings.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cache.hh"
+#include "response_queue.hh"
+
+class Resp_Connection {
+  public:
+    // Longest inline command, or array or bulk string header, accepted
+    static constexpr std::size_t MAX_INLINE = 64 * 1024;
+
+    // Most arguments a command may have
+    static constexpr std::size_t MAX_ARGS = 1024 * 1024;
+
+    // Longest bulk string (key or value) accepted, as large as the largest
+    // item the cache can hold
+    static constexpr std::size_t MAX_BULK = 1 << 20;
+
+    // Most bytes a command may take in all, so that a client can't make
+    // the server buffer MAX_ARGS bulk strings of MAX_BULK each
+    static constexpr std::size_t MAX_REQUEST = 16 * MAX_BULK;
+
+  private:
+    Cache& cache_;
+    Response_Queue out_;
+    std::vector<std::string_view> args_;   // arguments of the command being run, reused
+    key_type key_;                         // key of the command being run, reused
+    bool closing_ = false;
+
+    // Arguments of an array only partly received, as offsets from its
+    // start: the read buffer may move before the rest of it arrives
+    struct Span {
+      std::size_t offset_;
+      std::size_t size_;
+    };
+    std::vector<Span> spans_;
+    int64_t arg_count_ = -1;               // arguments the array announced, -1 between arrays
+    std::size_t parsed_ = 0;               // bytes of the array parsed so far
+
+    static constexpr std::size_t NEED_MORE = static_cast<std::size_t>(-1);
+
+    static std::size_t read_header(const char* data, std::size_t size, int64_t& number);
+    std::size_t parse(const char* data, std::size_t size);
+    std::size_t parse_inline(const char* data, std::size_t size);
+    std::size_t protocol_error(std::string_view why, std::size_t size);
+    void run();
+    void get();
+    void set();
+    void del();
+    void mget();
+    void mset();
+    void exists();
+    void info();
+    void ping();
+    const key_type& set_key(std::string_view key);
+    void append_value(Cache::handle&& value);
+    void append_bulk(std::string_view text);
+    void append_integer(uint64_t number);
+    void append_arity_error(std::string_view cmd);
+    void append_empty_key_error();
+
+  public:
+    explicit Resp_Connection(Cache& cache) : cache_(cache) {}
+    Resp_Connection(const Resp_Connection&) = delete;
+    Resp_Connection& operator=(const Resp_Connection&) = delete;
+
+    // Run every complete command at the start of data, queueing their
+    // replies, and return how many bytes they took. The rest (a partial
+    // command) must be handed in again, followed by more bytes.
+    std::size_t consume(const char* data, std::size_t size);
+
+    // Call f(data, size) on every buffer of the queued replies, in order
+    template <class F>
+    void for_each_buffer(F f) const { out_.for_each_buffer(f); }
+
+    // Whether any reply is queued
+    bool empty() const { return out_.empty(); }
+
+    // Forget the queued replies once written, unpinning their values
+    void clear() { out_.clear(); }
+
+    // Whether the connection should be closed once the queued replies are
+    // written, after a QUIT or a protocol error
+    bool closing() const { return closing_; }
+};
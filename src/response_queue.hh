@@ -0,0 +1,79 @@
+/*
+ * Responses queued by a connection of one of cache_server's stream
+ * protocols (memcached, RESP) until the server writes them out.
+ * Responses are text, built in one string, interleaved with values that
+ * are answered straight from the cache's memory: a value is pinned by its
+ * handle until the queue is cleared, once what it holds has been written.
+ * The queue hands out the buffers to write in order, so that a whole batch
+ * of responses goes out in one gathered write, and allocates nothing once
+ * its buffers have grown to fit the connection's traffic.
+ */
+
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "cache.hh"
+
+class Response_Queue {
+  private:
+    // Every segment is a run of text followed by a pinned value
+    struct Segment {
+      std::size_t text_begin_;
+      std::size_t text_end_;
+      const char* value_;
+      std::size_t value_size_;
+    };
+
+    std::string text_;
+    std::size_t text_begin_ = 0;      // start of the text after the last segment
+    std::vector<Segment> segments_;
+    std::vector<Cache::handle> pinned_;
+
+  public:
+    void append(std::string_view text)
+    {
+      text_.append(text.data(), text.size());
+    }
+
+    void append_number(uint64_t number)
+    {
+      char buf[20];
+      const auto res = std::to_chars(buf, buf + sizeof(buf), number);
+      text_.append(buf, res.ptr - buf);
+    }
+
+    // Queue a value after the text so far, pinned until the next clear
+    void append_value(Cache::handle&& value)
+    {
+      segments_.push_back(Segment{text_begin_, text_.size(), value.data(), value.size()});
+      text_begin_ = text_.size();
+      pinned_.push_back(std::move(value));
+    }
+
+    // Call f(data, size) on every buffer of the queued responses, in order
+    template <class F>
+    void for_each_buffer(F f) const
+    {
+      for (const auto& seg : segments_)
+      {
+        if (seg.text_end_ > seg.text_begin_) f(text_.data() + seg.text_begin_, seg.text_end_ - seg.text_begin_);
+        if (seg.value_size_ > 0) f(seg.value_, seg.value_size_);
+      }
+      if (text_.size() > text_begin_) f(text_.data() + text_begin_, text_.size() - text_begin_);
+    }
+
+    bool empty() const { return text_.empty() && segments_.empty(); }
+
+    // Forget the queued responses once written, unpinning their values
+    void clear()
+    {
+      text_.clear();
+      text_begin_ = 0;
+      segments_.clear();
+      pinned_.clear();
+    }
+};
@@ -0,0 +1,165 @@
+/*
+ * Implementation of an S3_Fifo_Evictor according to the declarations in s3fifo_evictor.hh
+ * Both queues are made of the hooks of the items, linked in circles through
+ * sentinels like in Intrusive_LRU_Evictor. A hook's meta_ holds a read
+ * counter (saturating at 3) and a flag telling which queue it is in, and its
+ * key_hash_ is what the ghost queue remembers.
+ */
+
+#include "s3fifo_evictor.hh"
+#include <cassert>
+
+static const uint32_t FREQ_MASK = 0x3;
+static const uint32_t IN_MAIN = 0x4;
+
+static inline uint32_t freq(const Evictor_Hook& hook) { return hook.meta_ & FREQ_MASK; }
+static inline void set_freq(Evictor_Hook& hook, uint32_t f) { hook.meta_ = (hook.meta_ & ~FREQ_MASK) | f; }
+
+S3_Fifo_Evictor::S3_Fifo_Evictor(double small_ratio)
+  : small_ratio_(small_ratio)
+{
+  assert(small_ratio_ > 0 && small_ratio_ < 1);
+  small_.prev_ = small_.next_ = &small_;
+  main_.prev_ = main_.next_ = &main_;
+}
+
+// append a hook at the back of a queue
+void
+S3_Fifo_Evictor::push(Evictor_Hook& queue, Evictor_Hook& hook)
+{
+  hook.prev_ = queue.prev_;
+  hook.next_ = &queue;
+  queue.prev_->next_ = &hook;
+  queue.prev_ = &hook;
+  if (&queue == &main_)
+  {
+    hook.meta_ |= IN_MAIN;
+    main_size_++;
+  }
+  else
+  {
+    hook.meta_ &= ~IN_MAIN;
+    small_size_++;
+  }
+}
+
+void
+S3_Fifo_Evictor::unlink(Evictor_Hook& hook)
+{
+  hook.prev_->next_ = hook.next_;
+  hook.next_->prev_ = hook.prev_;
+  hook.prev_ = hook.next_ = nullptr;
+  if (hook.meta_ & IN_MAIN) main_size_--;
+  else small_size_--;
+}
+
+// Add a hash to the ghost queue, which holds as many hashes as there are
+// items tracked. A hash added again only leaves with its latest copy.
+void
+S3_Fifo_Evictor::remember(uint32_t hash)
+{
+  ghost_[hash] = ++ghost_seq_;
+  ghost_queue_.emplace_back(hash, ghost_seq_);
+  while (ghost_queue_.size() > small_size_ + main_size_)
+  {
+    auto oldest = ghost_queue_.front();
+    ghost_queue_.pop_front();
+    auto it = ghost_.find(oldest.first);
+    if (it != ghost_.end() && it->second == oldest.second) ghost_.erase(it);
+  }
+}
+
+void
+S3_Fifo_Evictor::touch_item(Evictor_Hook& hook, const key_type& key, std::size_t)
+{
+  if (hook.next_ != nullptr)
+  {
+    if (freq(hook) < FREQ_MASK) set_freq(hook, freq(hook) + 1);
+    return;
+  }
+  const uint32_t hash = key_hash(key);
+  hook.meta_ = 0;
+  hook.key_hash_ = hash;
+  auto it = ghost_.find(hash);
+  if (it == ghost_.end())
+  {
+    push(small_, hook);
+    return;
+  }
+  ghost_.erase(it);
+  push(main_, hook);
+}
+
+void
+S3_Fifo_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (hook.next_ == nullptr) return;
+  const bool in_main = hook.meta_ & IN_MAIN;
+  unlink(hook);
+  if (in_main) remember(hook.key_hash_);
+}
+
+Evictor_Hook*
+S3_Fifo_Evictor::evict_item()
+{
+  while (small_size_ + main_size_ > 0)
+  {
+    if (small_size_ > 0 && (main_size_ == 0 || small_size_ >= small_ratio_ * (small_size_ + main_size_)))
+    {
+      Evictor_Hook* hook = small_.next_;
+      unlink(*hook);
+      if (freq(*hook) == 0)
+      {
+        remember(hook->key_hash_);
+        return hook;
+      }
+      // read while on probation: keep it, starting afresh in the main queue
+      set_freq(*hook, 0);
+      push(main_, *hook);
+    }
+    else
+    {
+      Evictor_Hook* hook = main_.next_;
+      unlink(*hook);
+      if (freq(*hook) == 0) return hook;
+      set_freq(*hook, freq(*hook) - 1);
+      push(main_, *hook);
+    }
+  }
+  return nullptr;
+}
+
+// oldest hook of a queue that accept takes and, if unread is set, that
+// wasn't read since it was queued
+static Evictor_Hook*
+find_in(Evictor_Hook& queue, const Evictor_Filter& accept, bool unread)
+{
+  for (Evictor_Hook* hook = queue.next_; hook != &queue; hook = hook->next_)
+  {
+    if ((!unread || freq(*hook) == 0) && accept(*hook)) return hook;
+  }
+  return nullptr;
+}
+
+Evictor_Hook*
+S3_Fifo_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  Evictor_Hook* hook = find_in(small_, accept, true);
+  if (hook == nullptr) hook = find_in(main_, accept, true);
+  if (hook == nullptr) hook = find_in(small_, accept, false);
+  if (hook == nullptr) hook = find_in(main_, accept, false);
+  if (hook == nullptr) return nullptr;
+  const bool in_main = hook->meta_ & IN_MAIN;
+  unlink(*hook);
+  if (!in_main) remember(hook->key_hash_);
+  return hook;
+}
+
+// a map entry holds the next pointer and the pair, plus about one bucket
+std::size_t
+S3_Fifo_Evictor::item_overhead(std::size_t) const
+{
+  const std::size_t queue_entry = sizeof(decltype(ghost_queue_)::value_type);
+  const std::size_t map_entry = sizeof(void*) + sizeof(decltype(ghost_)::value_type) + sizeof(void*);
+  return queue_entry + map_entry;
+}
@@ -0,0 +1,70 @@
+/*
+ * Declarations for an S3-FIFO evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * New items enter a small probationary FIFO queue. Those read again before
+ * reaching its end move on to the main FIFO queue; the others are evicted
+ * and their key hashes remembered in a ghost queue, so that they go straight
+ * to the main queue if they come back soon. The main queue gives items read
+ * since their last pass another round instead of evicting them.
+ * One-hit wonders thus leave after a short stay in the small queue, without
+ * pushing out the items of the main queue. Like Intrusive_LRU_Evictor, it
+ * only works through the item calls of the interface.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+class S3_Fifo_Evictor : public Evictor {
+  private:
+    // sentinels of the two circular queues, oldest first
+    Evictor_Hook small_;
+    Evictor_Hook main_;
+    std::size_t small_size_ = 0;
+    std::size_t main_size_ = 0;
+    const double small_ratio_;
+
+    // hashes of keys evicted from the small queue, oldest first; the map
+    // holds the sequence number each hash was last added with
+    std::deque<std::pair<uint32_t, uint64_t>> ghost_queue_;
+    std::unordered_map<uint32_t, uint64_t> ghost_;
+    uint64_t ghost_seq_ = 0;
+
+    void push(Evictor_Hook& queue, Evictor_Hook& hook);
+    void unlink(Evictor_Hook& hook);
+    void remember(uint32_t hash);
+  public:
+    // small_ratio: share of the tracked items the small queue may hold
+    // before evictions start taking from it
+    explicit S3_Fifo_Evictor(double small_ratio = 0.1);
+    ~S3_Fifo_Evictor() = default;
+    S3_Fifo_Evictor(const S3_Fifo_Evictor&) = delete;
+    S3_Fifo_Evictor& operator=(const S3_Fifo_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // counts a read of a tracked item, or queues a new one
+    void touch_item(Evictor_Hook& hook, const key_type& key, std::size_t) override;
+
+    // unlinks an item from its queue, if it is in one; the hash of an item
+    // leaving the main queue is remembered, so that an overwritten key
+    // stays in the main queue
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // returns the next item to evict, moving items between queues on the way
+    Evictor_Hook* evict_item() override;
+
+    // returns the oldest accepted item not read since it was queued, from
+    // the small queue first, or else the oldest accepted item; nothing
+    // else moves
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    // a ghost queue entry and a ghost map entry, as the ghosts may be as
+    // many as the items tracked
+    std::size_t item_overhead(std::size_t) const override;
+};
@@ -0,0 +1,146 @@
+/*
+ * Implementation of a Sampled_LRU_Evictor according to the declarations in sampled_lru_evictor.hh
+ * The clock counts touches rather than time, so that idle times mean the
+ * same under any load. It ticks about 1024 times in as many touches as
+ * there are items tracked: precise enough to tell items apart, while an
+ * item must stay idle through some 16000 such rounds before its 24-bit
+ * access time wraps around and it looks recent again.
+ * A touched item leaves the pool, so the pool always holds the items'
+ * current access times and stays ordered as the clock moves on.
+ */
+
+#include "sampled_lru_evictor.hh"
+#include <cassert>
+
+static const uint32_t CLOCK_MASK = (uint32_t(1) << 24) - 1;
+static const uint32_t IN_POOL = uint32_t(1) << 24;
+// handed out by evict_item, but not erased yet (when evicting a batch)
+static const uint32_t VICTIM = uint32_t(1) << 25;
+// samples evict_item_if draws per accepted item it looks for, at most
+static const unsigned FILTER_TRIES = 64;
+
+Sampled_LRU_Evictor::Sampled_LRU_Evictor(unsigned samples, uint64_t seed)
+  : samples_(samples), rnd_state_(seed | 1)
+{
+  assert(samples_ > 0);
+}
+
+// xorshift64*, good enough for picking samples
+uint64_t
+Sampled_LRU_Evictor::next_random()
+{
+  rnd_state_ ^= rnd_state_ >> 12;
+  rnd_state_ ^= rnd_state_ << 25;
+  rnd_state_ ^= rnd_state_ >> 27;
+  return rnd_state_ * 0x2545F4914F6CDD1DULL;
+}
+
+uint32_t
+Sampled_LRU_Evictor::idle(const Evictor_Hook& hook) const
+{
+  return (clock_ - hook.meta_) & CLOCK_MASK;
+}
+
+void
+Sampled_LRU_Evictor::stamp(Evictor_Hook& hook)
+{
+  if (hook.meta_ & IN_POOL) pool_remove(hook);
+  if (--ticks_left_ == 0)
+  {
+    clock_ = (clock_ + 1) & CLOCK_MASK;
+    ticks_left_ = size_ / 1024 + 1;
+  }
+  hook.meta_ = clock_;
+}
+
+// add a sampled item to the pool if it is idler than the pool's least idle
+// item, or the pool has room
+void
+Sampled_LRU_Evictor::pool_insert(Evictor_Hook& hook)
+{
+  const uint32_t hook_idle = idle(hook);
+  std::size_t pos = pool_size_;
+  while (pos > 0 && idle(*pool_[pos - 1]) < hook_idle) pos--;
+  if (pos == POOL_SIZE) return;
+  if (pool_size_ == POOL_SIZE)
+  {
+    pool_[POOL_SIZE - 1]->meta_ &= ~IN_POOL;
+    pool_size_--;
+  }
+  for (std::size_t i = pool_size_; i > pos; i--) pool_[i] = pool_[i - 1];
+  pool_[pos] = &hook;
+  pool_size_++;
+  hook.meta_ |= IN_POOL;
+}
+
+void
+Sampled_LRU_Evictor::pool_remove(Evictor_Hook& hook)
+{
+  std::size_t pos = 0;
+  while (pool_[pos] != &hook) pos++;
+  for (; pos + 1 < pool_size_; pos++) pool_[pos] = pool_[pos + 1];
+  pool_size_--;
+  hook.meta_ &= ~IN_POOL;
+}
+
+void
+Sampled_LRU_Evictor::touch_item(Evictor_Hook& hook, const key_type&, std::size_t)
+{
+  stamp(hook);
+}
+
+void
+Sampled_LRU_Evictor::insert_item(Evictor_Hook& hook, const key_type&, std::size_t)
+{
+  size_++;
+  hook.meta_ = 0;
+  stamp(hook);
+}
+
+void
+Sampled_LRU_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (hook.meta_ & IN_POOL) pool_remove(hook);
+  if (size_ > 0) size_--;
+}
+
+Evictor_Hook*
+Sampled_LRU_Evictor::evict_item()
+{
+  if (!sampler_) return nullptr;
+  for (unsigned i = 0; i < samples_; i++)
+  {
+    Evictor_Hook* hook = sampler_(next_random());
+    if (hook == nullptr) break;
+    if (!(hook->meta_ & (IN_POOL | VICTIM))) pool_insert(*hook);
+  }
+  if (pool_size_ == 0) return nullptr;
+  Evictor_Hook* victim = pool_[0];
+  pool_remove(*victim);
+  victim->meta_ |= VICTIM;
+  return victim;
+}
+
+Evictor_Hook*
+Sampled_LRU_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  if (!sampler_) return nullptr;
+  Evictor_Hook* victim = nullptr;
+  for (std::size_t i = 0; i < pool_size_ && victim == nullptr; i++)
+  {
+    if (accept(*pool_[i])) victim = pool_[i];
+  }
+  unsigned found = 0;
+  for (unsigned i = 0; found < samples_ && i < samples_ * FILTER_TRIES; i++)
+  {
+    Evictor_Hook* hook = sampler_(next_random());
+    if (hook == nullptr) break;
+    if ((hook->meta_ & VICTIM) || !accept(*hook)) continue;
+    found++;
+    if (victim == nullptr || idle(*hook) > idle(*victim)) victim = hook;
+  }
+  if (victim == nullptr) return nullptr;
+  if (victim->meta_ & IN_POOL) pool_remove(*victim);
+  victim->meta_ |= VICTIM;
+  return victim;
+}
@@ -0,0 +1,69 @@
+/*
+ * Declarations for an approximate LRU evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * Like Redis's maxmemory-policy allkeys-lru, it keeps no list at all: each
+ * item only carries a 24-bit access time in its hook's meta_ (the rest of
+ * the hook, which every item has, goes unused). To evict, it
+ * samples a few of the cache's items and evicts the one idle the longest.
+ * Candidates that lose are kept in a small pool, ordered by idle time, so
+ * that good ones found by earlier calls still compete in later ones.
+ * It needs the sampler the cache passes to set_sampler, so it can't be
+ * wrapped by an evictor that keeps some of the cache's items to itself
+ * (like TinyLFU_Evictor's window).
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <cstddef>
+#include <cstdint>
+
+class Sampled_LRU_Evictor : public Evictor {
+  private:
+    static const std::size_t POOL_SIZE = 16;
+
+    Evictor_Sampler sampler_;
+    const unsigned samples_;
+    uint64_t rnd_state_;
+
+    // items idle the longest of those sampled, most idle first; pooled
+    // items are flagged in their meta_
+    Evictor_Hook* pool_[POOL_SIZE] = {};
+    std::size_t pool_size_ = 0;
+
+    std::size_t size_ = 0;        // items tracked
+    uint32_t clock_ = 0;          // current access time, 24 bits
+    std::size_t ticks_left_ = 1;  // touches until the clock ticks again
+
+    uint32_t idle(const Evictor_Hook& hook) const;
+    void stamp(Evictor_Hook& hook);
+    void pool_insert(Evictor_Hook& hook);
+    void pool_remove(Evictor_Hook& hook);
+    uint64_t next_random();
+  public:
+    // samples: items looked at by each evict_item
+    explicit Sampled_LRU_Evictor(unsigned samples = 5, uint64_t seed = 1);
+    ~Sampled_LRU_Evictor() = default;
+    Sampled_LRU_Evictor(const Sampled_LRU_Evictor&) = delete;
+    Sampled_LRU_Evictor& operator=(const Sampled_LRU_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // sets an item's access time to now
+    void touch_item(Evictor_Hook& hook, const key_type&, std::size_t) override;
+
+    // counts a new item and sets its access time
+    void insert_item(Evictor_Hook& hook, const key_type& key, std::size_t size) override;
+
+    // forgets an item, taking it out of the pool if it is there
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // samples the cache into the pool and returns the pool's most idle item
+    Evictor_Hook* evict_item() override;
+
+    // returns the most idle accepted item of the pool and of samples drawn
+    // until as many accepted items turn up, or too many samples don't
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    void set_sampler(Evictor_Sampler sampler) override { sampler_ = std::move(sampler); }
+};
@@ -0,0 +1,225 @@
+/*
+ * Implementation of the slab allocator declared in slab_allocator.hh.
+ * Follows memcached: chunk sizes grow geometrically from a small minimum up
+ * to a whole page, pages are carved from one preallocated arena, and each
+ * class keeps its own free list. As in memcached, a class that has no page
+ * at all may get one from the heap once the arena is used up, so that small
+ * caches can still hold values of every size. Arena pages can move between
+ * classes once they are empty, as memcached's slab rebalancing does,
+ * though here a page is never emptied on purpose: it moves once its
+ * chunks have all been freed.
+ */
+
+#include "slab_allocator.hh"
+#include <cassert>
+#include <algorithm>
+
+// smallest chunk size, and the alignment of every chunk
+static const std::size_t MIN_CHUNK = 16;
+static const std::size_t CHUNK_ALIGN = 8;
+
+static std::size_t
+align_up(std::size_t size, std::size_t alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+Slab_Allocator::Slab_Allocator(std::size_t arena_size, double growth_factor, std::size_t page_size)
+  : page_size_(align_up(page_size, CHUNK_ALIGN)),
+    arena_size_(align_up(std::max<std::size_t>(arena_size, 1), page_size_)),
+    arena_(new char[arena_size_]),
+    page_class_(arena_size_ / page_size_, nullptr),
+    page_used_(arena_size_ / page_size_, 0)
+{
+  assert(growth_factor > 1.0);
+  assert(page_size_ >= MIN_CHUNK);
+  std::size_t size = MIN_CHUNK;
+  while (size < page_size_ / growth_factor)
+  {
+    classes_.push_back(new Slab_Class(size));
+    std::size_t next = align_up(static_cast<std::size_t>(size * growth_factor), CHUNK_ALIGN);
+    size = std::max(next, size + CHUNK_ALIGN);
+  }
+  classes_.push_back(new Slab_Class(page_size_));
+}
+
+Slab_Allocator::~Slab_Allocator()
+{
+  for (auto cls : classes_) delete cls;
+  for (auto page : extra_pages_) delete[] page;
+  delete[] arena_;
+}
+
+// find the smallest class whose chunks can hold size bytes
+Slab_Allocator::Slab_Class*
+Slab_Allocator::class_for(std::size_t size) const
+{
+  auto it = std::lower_bound(classes_.begin(), classes_.end(), size,
+      [](const Slab_Class* cls, std::size_t sz) { return cls->chunk_size_ < sz; });
+  if (it == classes_.end()) return nullptr;
+  return *it;
+}
+
+// Take the next free page of the arena for a class, or nullptr if none is
+// left. The class's lock is held by the caller.
+char*
+Slab_Allocator::grab_page(Slab_Class& cls)
+{
+  std::scoped_lock guard(page_mutx_);
+  if (next_page_ + page_size_ <= arena_size_)
+  {
+    char* page = arena_ + next_page_;
+    page_class_[next_page_ / page_size_] = &cls;
+    next_page_ += page_size_;
+    return page;
+  }
+  if (cls.pages_ > 0) return nullptr;
+  extra_pages_.push_back(new char[page_size_]);
+  return extra_pages_.back();
+}
+
+// index of the arena page holding a chunk, or the number of pages if the
+// chunk is on a page from the heap
+std::size_t
+Slab_Allocator::page_of(const void* chunk) const
+{
+  const char* ptr = static_cast<const char*>(chunk);
+  if (ptr < arena_ || ptr >= arena_ + arena_size_) return page_used_.size();
+  return (ptr - arena_) / page_size_;
+}
+
+void*
+Slab_Allocator::allocate(std::size_t size)
+{
+  Slab_Class* cls = class_for(std::max<std::size_t>(size, 1));
+  if (cls == nullptr) return nullptr;
+  std::scoped_lock guard(cls->mutx_);
+  void* chunk = nullptr;
+  bool new_page = false;   // a page just grabbed was never counted empty
+  if (cls->free_list_ != nullptr)
+  {
+    chunk = cls->free_list_;
+    cls->free_list_ = *static_cast<void**>(chunk);
+  }
+  else
+  {
+    if (cls->carve_ == cls->carve_end_)
+    {
+      char* page = grab_page(*cls);
+      if (page == nullptr) return nullptr;
+      new_page = true;
+      cls->pages_++;
+      cls->carve_ = page;
+      cls->carve_end_ = page + page_size_ / cls->chunk_size_ * cls->chunk_size_;
+      cls->free_chunks_ += page_size_ / cls->chunk_size_;
+    }
+    chunk = cls->carve_;
+    cls->carve_ += cls->chunk_size_;
+  }
+  const std::size_t page = page_of(chunk);
+  if (page < page_used_.size() && page_used_[page]++ == 0 && !new_page) empty_pages_--;
+  cls->free_chunks_--;
+  cls->used_chunks_++;
+  cls->requested_bytes_ += size;
+  return chunk;
+}
+
+void
+Slab_Allocator::free(void* chunk, std::size_t size)
+{
+  Slab_Class* cls = class_for(std::max<std::size_t>(size, 1));
+  assert(cls != nullptr);
+  std::scoped_lock guard(cls->mutx_);
+  *static_cast<void**>(chunk) = cls->free_list_;
+  cls->free_list_ = chunk;
+  const std::size_t page = page_of(chunk);
+  if (page < page_used_.size() && --page_used_[page] == 0) empty_pages_++;
+  cls->free_chunks_++;
+  assert(cls->used_chunks_ > 0);
+  cls->used_chunks_--;
+  cls->requested_bytes_ -= size;
+}
+
+bool
+Slab_Allocator::reassign_page(std::size_t size)
+{
+  if (empty_pages_.load() == 0) return false;
+  Slab_Class* cls = class_for(std::max<std::size_t>(size, 1));
+  if (cls == nullptr) return false;
+  for (auto donor : classes_)
+  {
+    if (donor == cls) continue;
+    std::scoped_lock guard(cls->mutx_, donor->mutx_);
+    // another thread may have made room in the meantime
+    if (cls->free_list_ != nullptr || cls->carve_ != cls->carve_end_) return true;
+    std::scoped_lock page_guard(page_mutx_);
+    for (std::size_t page = 0; page < page_class_.size(); page++)
+    {
+      if (page_class_[page] == donor && page_used_[page] == 0)
+      {
+        move_page(page, *donor, *cls);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Hand an empty page over, taking its chunks off the free list of the class
+// it leaves and making it the page the other class carves next. Both
+// classes' locks and page_mutx_ are held by the caller. The page stays
+// counted empty until a chunk of it is allocated.
+void
+Slab_Allocator::move_page(std::size_t page, Slab_Class& from, Slab_Class& to)
+{
+  char* begin = arena_ + page * page_size_;
+  char* end = begin + page_size_;
+  for (void** link = &from.free_list_; *link != nullptr;)
+  {
+    char* chunk = static_cast<char*>(*link);
+    if (chunk >= begin && chunk < end) *link = *reinterpret_cast<void**>(chunk);
+    else link = reinterpret_cast<void**>(chunk);
+  }
+  if (from.carve_ >= begin && from.carve_ < end) from.carve_ = from.carve_end_ = nullptr;
+  from.pages_--;
+  from.free_chunks_ -= page_size_ / from.chunk_size_;
+  page_class_[page] = &to;
+  to.pages_++;
+  to.carve_ = begin;
+  to.carve_end_ = begin + page_size_ / to.chunk_size_ * to.chunk_size_;
+  to.free_chunks_ += page_size_ / to.chunk_size_;
+}
+
+std::size_t
+Slab_Allocator::class_index(std::size_t size) const
+{
+  auto it = std::lower_bound(classes_.begin(), classes_.end(), std::max<std::size_t>(size, 1),
+      [](const Slab_Class* cls, std::size_t sz) { return cls->chunk_size_ < sz; });
+  assert(it != classes_.end());
+  return it - classes_.begin();
+}
+
+std::size_t
+Slab_Allocator::max_size() const
+{
+  return page_size_;
+}
+
+std::vector<Slab_Class_Stats>
+Slab_Allocator::stats() const
+{
+  std::vector<Slab_Class_Stats> res;
+  for (auto cls : classes_)
+  {
+    std::scoped_lock guard(cls->mutx_);
+    if (cls->pages_ == 0) continue;
+    Slab_Class_Stats st;
+    st.chunk_size = cls->chunk_size_;
+    st.pages = cls->pages_;
+    st.used_chunks = cls->used_chunks_;
+    st.free_chunks = cls->free_chunks_;
+    st.wasted_bytes = cls->used_chunks_ * cls->chunk_size_ - cls->requested_bytes_;
+    res.push_back(st);
+  }
+  return res;
+}
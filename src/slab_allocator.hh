@@ -0,0 +1,98 @@
+/*
+ * Declarations for a memcached-style slab allocator, used by the cache to
+ * store values without a heap allocation per item.
+ * Memory comes from one arena allocated up front and is handed out in
+ * pages. Each page belongs to a size class and is cut into equal chunks;
+ * freed chunks go back to the free list of their class. An arena page none
+ * of whose chunks is in use can be moved over to a class that ran out.
+ */
+
+#pragma once
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Usage of one size class, as reported by Slab_Allocator::stats()
+struct Slab_Class_Stats {
+  std::size_t chunk_size = 0;
+  uint64_t pages = 0;         // pages handed to this class
+  uint64_t used_chunks = 0;   // chunks holding a value
+  uint64_t free_chunks = 0;   // chunks in this class's pages that are free
+  uint64_t wasted_bytes = 0;  // space in used chunks not used by their values
+};
+
+class Slab_Allocator {
+  private:
+    struct Slab_Class {
+      std::size_t chunk_size_;
+      void* free_list_ = nullptr;  // freed chunks, linked through their first bytes
+      char* carve_ = nullptr;      // part of the newest page not yet handed out
+      char* carve_end_ = nullptr;
+      uint64_t pages_ = 0;
+      uint64_t used_chunks_ = 0;
+      uint64_t free_chunks_ = 0;
+      uint64_t requested_bytes_ = 0;
+      std::mutex mutx_;
+
+      explicit Slab_Class(std::size_t chunk_size) : chunk_size_(chunk_size) {}
+    };
+
+    const std::size_t page_size_;
+    const std::size_t arena_size_;
+    char* arena_;
+    std::size_t next_page_ = 0;    // offset of the first unused page in the arena
+    std::vector<char*> extra_pages_;
+    std::mutex page_mutx_;
+    std::vector<Slab_Class*> classes_;
+
+    // class and used chunks of every arena page, the latter under the lock
+    // of the page's class; nullptr for pages not handed out yet
+    std::vector<Slab_Class*> page_class_;
+    std::vector<uint32_t> page_used_;
+    std::atomic<std::size_t> empty_pages_{0};   // handed out pages with no chunk in use
+
+    Slab_Class* class_for(std::size_t size) const;
+    char* grab_page(Slab_Class& cls);
+    std::size_t page_of(const void* chunk) const;
+    void move_page(std::size_t page, Slab_Class& from, Slab_Class& to);
+
+  public:
+    // arena_size: total memory for all slabs (rounded up to whole pages).
+    // growth_factor: ratio between the chunk sizes of consecutive classes.
+    // page_size: size of a slab page, which is also the largest chunk.
+    Slab_Allocator(std::size_t arena_size,
+                   double growth_factor = 1.25,
+                   std::size_t page_size = 1 << 20);
+    ~Slab_Allocator();
+    Slab_Allocator(const Slab_Allocator&) = delete;
+    Slab_Allocator& operator=(const Slab_Allocator&) = delete;
+
+    // Return a chunk of at least size bytes, or nullptr if its class has no
+    // free chunk and no page is left in the arena.
+    void* allocate(std::size_t size);
+
+    // Give a chunk back to its class. size must be the one it was allocated with.
+    void free(void* chunk, std::size_t size);
+
+    // Move an arena page that has no chunk in use from another class to the
+    // class of size, for when allocate(size) fails. Returns whether a page
+    // was moved.
+    bool reassign_page(std::size_t size);
+
+    // Number of size classes, and the index of the one chunks for size come
+    // from (size must be at most max_size())
+    std::size_t class_count() const { return classes_.size(); }
+    std::size_t class_index(std::size_t size) const;
+
+    // Size of the chunks size bytes are allocated from (size must be at
+    // most max_size())
+    std::size_t chunk_size(std::size_t size) const { return classes_[class_index(size)]->chunk_size_; }
+
+    // Largest size that can be allocated
+    std::size_t max_size() const;
+
+    // Usage of every class that owns at least one page, smallest chunks first
+    std::vector<Slab_Class_Stats> stats() const;
+};
@@ -0,0 +1,90 @@
+/*
+ * Implementation of an SLRU_Evictor according to the declarations in slru_evictor.hh
+ * A hook's meta_ tells which segment it is in.
+ */
+
+#include "slru_evictor.hh"
+#include <cassert>
+
+static const uint32_t IN_PROTECTED = 1;
+
+SLRU_Evictor::SLRU_Evictor(double protected_ratio)
+  : protected_ratio_(protected_ratio)
+{
+  assert(protected_ratio_ >= 0 && protected_ratio_ <= 1);
+}
+
+// move the least recent protected items back to probation until the
+// protected segment is within its share
+void
+SLRU_Evictor::demote_overflow()
+{
+  const std::size_t limit = protected_ratio_ * (probation_.size() + protected_.size());
+  while (protected_.size() > limit)
+  {
+    Evictor_Hook* hook = protected_.front();
+    protected_.unlink(*hook);
+    hook->meta_ = 0;
+    probation_.push_back(*hook);
+  }
+}
+
+void
+SLRU_Evictor::touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size)
+{
+  if (!Hook_List::linked(hook))
+  {
+    insert_item(hook, key, size);
+    return;
+  }
+  if (hook.meta_ == IN_PROTECTED)
+  {
+    if (protected_.is_back(hook)) return;
+    protected_.unlink(hook);
+  }
+  else
+  {
+    probation_.unlink(hook);
+    hook.meta_ = IN_PROTECTED;
+  }
+  protected_.push_back(hook);
+  demote_overflow();
+}
+
+void
+SLRU_Evictor::insert_item(Evictor_Hook& hook, const key_type&, std::size_t)
+{
+  hook.meta_ = 0;
+  probation_.push_back(hook);
+}
+
+void
+SLRU_Evictor::erase_item(Evictor_Hook& hook, const key_type&)
+{
+  if (!Hook_List::linked(hook)) return;
+  if (hook.meta_ == IN_PROTECTED) protected_.unlink(hook);
+  else probation_.unlink(hook);
+}
+
+Evictor_Hook*
+SLRU_Evictor::evict_item()
+{
+  Hook_List& segment = probation_.empty() ? protected_ : probation_;
+  Evictor_Hook* victim = segment.front();
+  if (victim != nullptr) segment.unlink(*victim);
+  return victim;
+}
+
+Evictor_Hook*
+SLRU_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  Hook_List* segment = &probation_;
+  Evictor_Hook* victim = probation_.find_if(accept);
+  if (victim == nullptr)
+  {
+    segment = &protected_;
+    victim = protected_.find_if(accept);
+  }
+  if (victim != nullptr) segment->unlink(*victim);
+  return victim;
+}
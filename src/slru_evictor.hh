@@ -0,0 +1,55 @@
+/*
+ * Declarations for a segmented LRU (SLRU) evictor according to the pattern in evictor.hh
+ * for use in a cache according to the pattern in cache.hh
+ * New items enter a probationary segment, and move to a protected segment
+ * when read again. The protected segment holds at most a set share of the
+ * items; when it overflows, its least recent item goes back to the most
+ * recent end of probation, where it gets one more chance to be read.
+ * Victims come from probation first, so items read only once never push
+ * out the protected ones. Both segments are LRU lists made of the items'
+ * hooks, like Intrusive_LRU_Evictor's.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include "hook_list.hh"
+#include <cstddef>
+
+class SLRU_Evictor : public Evictor {
+  private:
+    Hook_List probation_;    // least recently used first
+    Hook_List protected_;    // least recently used first
+    const double protected_ratio_;
+
+    void demote_overflow();
+  public:
+    // protected_ratio: share of the tracked items the protected segment
+    // may hold, between 0 and 1
+    explicit SLRU_Evictor(double protected_ratio = 0.8);
+    ~SLRU_Evictor() = default;
+    SLRU_Evictor(const SLRU_Evictor&) = delete;
+    SLRU_Evictor& operator=(const SLRU_Evictor&) = delete;
+
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+
+    // promotes an item on probation, or moves a protected item to the most
+    // recent end of its segment; a new item goes on probation
+    void touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size) override;
+
+    // puts a new item at the most recent end of probation
+    void insert_item(Evictor_Hook& hook, const key_type&, std::size_t) override;
+
+    // unlinks an item from its segment, if it is in one
+    void erase_item(Evictor_Hook& hook, const key_type&) override;
+
+    // unlinks and returns the least recent item on probation, or the least
+    // recent protected item if probation is empty
+    Evictor_Hook* evict_item() override;
+
+    // unlinks and returns the least recent accepted item on probation, or
+    // the least recent accepted protected item if there is none
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    double protected_ratio() const { return protected_ratio_; }
+};
@@ -3,7 +3,7 @@
 #include <iostream>
 #include <cstring>
 #include "catch.hpp"
-using size_type = uint32_t;
+using size_type = Cache::size_type;
 /*
  * Some basic unit tests for Cache objects.
  * The documentation expected behavior of each method is copied directly from cache.hh
@@ -64,6 +64,36 @@ TEST_CASE("Begin testing the cache"){
         REQUIRE(val_size == strlen(val_3) + 1);
     }
 
+    // Test: values come back byte for byte, whatever bytes they hold
+    SECTION("Binary Values"){
+        const char val[] = "a\0b\"c/d:e\r\n\xff";
+        REQUIRE(c.set("Binary", val, sizeof(val)));
+        Cache::size_type val_size = 0;
+        Cache::val_type got = c.get("Binary", val_size);
+        REQUIRE(val_size == sizeof(val));
+        REQUIRE(memcmp(got, val, sizeof(val)) == 0);
+        REQUIRE(c.set("Empty", val, 0));
+        REQUIRE(c.get("Empty", val_size) != nullptr);
+        REQUIRE(val_size == 0);
+    }
+
+    // Test: a TTL too long to count in milliseconds is cut down, not overflowed
+    SECTION("Long TTL"){
+        REQUIRE(c.set(key_3, val_3, val_3_size, Cache::ttl_type::max()));
+        REQUIRE(strcmp(c.get(key_3, val_3_size), val_3) == 0);
+    }
+
+    // Test: get_many returns every value in one request, in the order of
+    // the keys, with empty handles for keys not in the cache
+    SECTION("Get Many"){
+        const auto values = c.get_many({key_2, key_3, key_1});
+        REQUIRE(values.size() == 3);
+        REQUIRE(strcmp(values[0].data(), val_2) == 0);
+        REQUIRE(!values[1]);
+        REQUIRE(values[2].size() == val_1_size);
+        REQUIRE(strcmp(values[2].data(), val_1) == 0);
+    }
+
     // Expected behavior for Cache::get(key_type key, size_type& val_size):
     // Retrieve a pointer to the value associated with key in the cache,
     // or nullptr if not found.
@@ -80,6 +110,12 @@ TEST_CASE("Begin testing the cache"){
         REQUIRE(strcmp(c.get(key_1, val_1_size), val_1) == 0);
     }
 
+    // Test: contains finds the keys get would
+    SECTION("Contains"){
+        REQUIRE(c.contains(key_1));
+        REQUIRE(!c.contains(key_3));
+    }
+
     // Expected behavior for Cache::del(key_type key):
     // Delete an object from the cache, if it's still there
     // Should return True if the key was found and deleted
@@ -100,24 +136,24 @@ TEST_CASE("Begin testing the cache"){
         REQUIRE(c.get(key_2, val_2_size) == nullptr);
     }
 
-    // Expected behavior for Cache::space_used():
-    // Compute the total amount of memory used up by all cache values (not keys)
+    // Expected behavior for Cache::value_space_used():
+    // Compute the total amount of memory used up by all cache values alone
 
-    // Test: space_used should be the sum of the sizes of the two values in cache
+    // Test: value_space_used should be the sum of the sizes of the two values in cache
     SECTION("Space Used"){
-        REQUIRE(c.space_used() == val_1_size + val_2_size);
+        REQUIRE(c.value_space_used() == val_1_size + val_2_size);
     }
 
     // Test: Removing a value reduces cache size by size of that value
     SECTION("Decrease Space Used"){
         c.del(key_1);
-        REQUIRE(c.space_used() == val_2_size);
+        REQUIRE(c.value_space_used() == val_2_size);
     }
 
-    // Test: space_used changes if new items are set into the cache
+    // Test: value_space_used changes if new items are set into the cache
     SECTION("Increase Space Used"){
         c.set(key_3, val_3, val_3_size);
-        REQUIRE(c.space_used() == val_1_size + val_2_size + val_3_size);
+        REQUIRE(c.value_space_used() == val_1_size + val_2_size + val_3_size);
     }
 
     // Expected behavior for Cache::reset():
@@ -1,9 +1,34 @@
 #include "cache.hh"
+#include "hash_index.hh"
+#include "timing_wheel.hh"
+#include "touch_buffer.hh"
+#include "intrusive_lru_evictor.hh"
+#include "clock_evictor.hh"
+#include "s3fifo_evictor.hh"
+#include "arc_evictor.hh"
+#include "sampled_lru_evictor.hh"
+#include "tinylfu_evictor.hh"
+#include "memcache_protocol.hh"
+#include "resp_protocol.hh"
 #include <cassert>
 #include <iostream>
 #include <cstring>
+#include <new>
+#include <random>
+#include <set>
+#include <thread>
 #include "catch.hpp"
-using size_type = uint32_t;
+using size_type = Cache::size_type;
+
+// Memory charged against maxmem for an item, with an evictor that keeps
+// nothing for it outside the item: its slab chunk and its index entry
+static size_type
+footprint(std::size_t key_len, size_type val_size)
+{
+    static const Slab_Allocator slabs(0);
+    return slabs.chunk_size(Item::size_for(key_len, val_size)) + Hash_Index::ENTRY_SIZE;
+}
+
 /*
  * Some basic unit tests for Cache objects.
  * The documentation expected behavior of each method is copied directly from cache.hh
@@ -11,7 +36,7 @@ using size_type = uint32_t;
  */
 
 TEST_CASE("Begin testing the cache"){
-    Cache c = Cache(30);
+    Cache c = Cache(1000);
     std::string key_1 = "Item 1";
     std::string key_2 = "Item 2";
     std::string key_3 = "Item 3";
@@ -71,6 +96,14 @@ TEST_CASE("Begin testing the cache"){
         REQUIRE(strcmp(c.get(key_1, val_1_size), val_1) == 0);
     }
 
+    // Test: contains finds the keys get would, without counting hits or misses
+    SECTION("Contains"){
+        REQUIRE(c.contains(key_1));
+        REQUIRE(!c.contains(key_3));
+        REQUIRE(c.stats()[0].hits == 0);
+        REQUIRE(c.stats()[0].misses == 0);
+    }
+
     // Expected behavior for Cache::del(key_type key):
     // Delete an object from the cache, if it's still there
     // Should return True if the key was found and deleted
@@ -92,23 +125,33 @@ TEST_CASE("Begin testing the cache"){
     }
 
     // Expected behavior for Cache::space_used():
-    // Compute the total amount of memory used up by all cache values (not keys)
+    // Compute the total amount of memory used up by all cache items, as counted
+    // against maxmem: keys and values along with the memory the cache and its
+    // evictor spend on each item.
+
+    // Test: space_used counts the keys and the per-item overhead too
+    SECTION("Space Used Counts Overhead"){
+        REQUIRE(c.space_used() == footprint(key_1.size(), val_1_size) + footprint(key_2.size(), val_2_size));
+    }
+
+    // Expected behavior for Cache::value_space_used():
+    // Compute the total amount of memory used up by all cache values alone
 
-    // Test: space_used should be the sum of the sizes of the two values in cache
+    // Test: value_space_used should be the sum of the sizes of the two values in cache
     SECTION("Space Used"){
-        REQUIRE(c.space_used() == val_1_size + val_2_size);
+        REQUIRE(c.value_space_used() == val_1_size + val_2_size);
     }
 
     // Test: Removing a value reduces cache size by size of that value
     SECTION("Decrease Space Used"){
         c.del(key_1);
-        REQUIRE(c.space_used() == val_2_size);
+        REQUIRE(c.value_space_used() == val_2_size);
     }
 
-    // Test: space_used changes if new items are set into the cache
+    // Test: value_space_used changes if new items are set into the cache
     SECTION("Increase Space Used"){
         c.set(key_3, val_3, val_3_size);
-        REQUIRE(c.space_used() == val_1_size + val_2_size + val_3_size);
+        REQUIRE(c.value_space_used() == val_1_size + val_2_size + val_3_size);
     }
 
     // Expected behavior for Cache::reset():
@@ -118,6 +161,7 @@ TEST_CASE("Begin testing the cache"){
     SECTION("Space Used After Reset"){
         c.reset();
         REQUIRE(c.space_used() == 0);
+        REQUIRE(c.value_space_used() == 0);
     }
 
     // Test: after reset, all items previously set are absent
@@ -133,4 +177,1263 @@ TEST_CASE("Begin testing the cache"){
         c.set(key_3, val_3, val_3_size);
         REQUIRE(c.get(key_3, val_3_size) != nullptr);
     }
-}
\ No newline at end of file
+}
+
+/*
+ * Tests for a cache split into several shards.
+ * Every key must still be found in whichever shard it was routed to,
+ * and the per-shard counters must add up to the whole cache.
+ */
+
+TEST_CASE("Sharded cache"){
+    Cache c = Cache(40000, nullptr, 8);
+    const char *val = "value";
+    size_type val_size = strlen(val) + 1;
+    for (int i = 0; i < 100; i++) {
+        c.set("key" + std::to_string(i), val, val_size);
+    }
+
+    // Test: every key set can be retrieved
+    SECTION("Get From Shards"){
+        size_type size = 0;
+        for (int i = 0; i < 100; i++) {
+            REQUIRE(strcmp(c.get("key" + std::to_string(i), size), val) == 0);
+        }
+        REQUIRE(size == val_size);
+    }
+
+    // Test: one stats entry per shard, and the counters add up
+    SECTION("Shard Stats"){
+        size_type size = 0;
+        c.get("key1", size);
+        c.get("missing", size);
+        auto stats = c.stats();
+        REQUIRE(stats.size() == 8);
+        uint64_t items = 0, bytes = 0, memory = 0, hits = 0, misses = 0, sets = 0;
+        for (auto& st : stats) {
+            items += st.items;
+            bytes += st.bytes;
+            memory += st.memory;
+            hits += st.hits;
+            misses += st.misses;
+            sets += st.sets;
+        }
+        REQUIRE(items == 100);
+        REQUIRE(bytes == c.value_space_used());
+        REQUIRE(memory == c.space_used());
+        REQUIRE(hits == 1);
+        REQUIRE(misses == 1);
+        REQUIRE(sets == 100);
+    }
+
+    // Test: get_many finds keys across shards, in the order asked for,
+    // counting a hit or miss for each
+    SECTION("Get Many"){
+        c.set("short-lived", val, val_size, std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::vector<key_type> keys = {"key42", "missing", "key0", "short-lived", "key42"};
+        for (int i = 50; i < 100; i++) keys.push_back("key" + std::to_string(i));
+        const auto values = c.get_many(keys);
+        REQUIRE(values.size() == keys.size());
+        REQUIRE(!values[1]);
+        REQUIRE(!values[3]);
+        for (std::size_t i : {0, 2, 4}) {
+            REQUIRE(values[i].size() == val_size);
+            REQUIRE(strcmp(values[i].data(), val) == 0);
+        }
+        for (std::size_t i = 5; i < keys.size(); i++) REQUIRE(values[i]);
+        uint64_t hits = 0, misses = 0, items = 0;
+        for (auto& st : c.stats()) {
+            hits += st.hits;
+            misses += st.misses;
+            items += st.items;
+        }
+        REQUIRE(hits == 53);
+        REQUIRE(misses == 2);
+        REQUIRE(items == 100);
+        REQUIRE(c.get_many({}).empty());
+    }
+
+    // Test: deleting and resetting work across shards
+    SECTION("Delete And Reset Shards"){
+        REQUIRE(c.del("key7") == true);
+        REQUIRE(c.value_space_used() == 99 * val_size);
+        c.reset();
+        REQUIRE(c.space_used() == 0);
+        for (auto& st : c.stats()) REQUIRE(st.items == 0);
+    }
+}
+
+
+/*
+ * Tests for the memory budget, which covers each item's key, header, index
+ * entry and evictor bookkeeping as well as its value.
+ */
+
+TEST_CASE("Memory accounting"){
+    const char *val = "ten bytes";
+
+    // Test: maxmem caps the items' whole footprint, not just their values
+    SECTION("Budget Counts Overhead"){
+        Cache c(3 * footprint(6, 10));
+        REQUIRE(c.set("Item 1", val, 10));
+        REQUIRE(c.set("Item 2", val, 10));
+        REQUIRE(c.set("Item 3", val, 10));
+        REQUIRE(!c.set("Item 4", val, 10));
+        REQUIRE(c.space_used() == 3 * footprint(6, 10));
+        REQUIRE(c.value_space_used() == 30);
+        REQUIRE(c.stats()[0].memory == c.space_used());
+        REQUIRE(c.stats()[0].bytes == 30);
+    }
+
+    // Test: what the evictor keeps for an item is charged along with it
+    auto charges_overhead = [val](Evictor* evictor) {
+        REQUIRE(evictor->item_overhead(6) > 0);
+        const size_type item = footprint(6, 10) + evictor->item_overhead(6);
+        Cache c(2 * item, 0.75, evictor);
+        c.set("Item 1", val, 10);
+        REQUIRE(c.space_used() == item);
+        c.del("Item 1");
+        REQUIRE(c.space_used() == 0);
+    };
+    SECTION("Evictor Overhead"){
+        charges_overhead(new TinyLFU_Evictor(new Intrusive_LRU_Evictor()));
+    }
+    SECTION("Clock Overhead"){
+        charges_overhead(new Clock_Evictor());
+    }
+    SECTION("S3-FIFO Overhead"){
+        charges_overhead(new S3_Fifo_Evictor());
+    }
+    SECTION("ARC Overhead"){
+        charges_overhead(new ARC_Evictor());
+    }
+
+    // Test: budgets past 4 GiB don't wrap around (to less than an item)
+    SECTION("Large Budget"){
+        const size_type maxmem = (size_type(1) << 32) + 50;
+        Cache c(maxmem, []() { return nullptr; }, 4);
+        REQUIRE(c.set("Item 1", val, 10));
+        REQUIRE(c.space_used() == footprint(6, 10));
+        uint64_t memory = 0;
+        for (auto& st : c.stats()) memory += st.memory;
+        REQUIRE(memory == c.space_used());
+    }
+}
+
+
+/*
+ * Tests for the slab allocator that holds cache values.
+ */
+
+TEST_CASE("Slab allocator"){
+    // one page arena of 1 KiB, chunk sizes doubling from 16 bytes
+    Slab_Allocator slabs(1024, 2.0, 1024);
+
+    // Test: a freed chunk is reused by the next allocation of its class
+    SECTION("Reuse Freed Chunk"){
+        void* a = slabs.allocate(10);
+        void* b = slabs.allocate(10);
+        REQUIRE(a != nullptr);
+        REQUIRE(b != nullptr);
+        REQUIRE(a != b);
+        slabs.free(a, 10);
+        REQUIRE(slabs.allocate(12) == a);
+    }
+
+    // Test: stats report chunk size, used and free chunks and wasted bytes
+    SECTION("Class Stats"){
+        slabs.allocate(10);
+        slabs.allocate(20);
+        auto stats = slabs.stats();
+        REQUIRE(stats.size() == 2);
+        REQUIRE(stats[0].chunk_size == 16);
+        REQUIRE(stats[0].used_chunks == 1);
+        REQUIRE(stats[0].free_chunks == 1024 / 16 - 1);
+        REQUIRE(stats[0].wasted_bytes == 6);
+        REQUIRE(stats[1].chunk_size == 32);
+        REQUIRE(stats[1].wasted_bytes == 12);
+    }
+
+    // Test: once the arena is used up, a class that already has a page
+    // can't grow, but a class without any page still gets one
+    SECTION("Arena Exhausted"){
+        for (int i = 0; i < 1024 / 16; i++) REQUIRE(slabs.allocate(16) != nullptr);
+        REQUIRE(slabs.allocate(16) == nullptr);
+        REQUIRE(slabs.allocate(100) != nullptr);
+    }
+
+    // Test: an arena page with no chunk in use moves to a class that is
+    // full, but not while any of its chunks is in use
+    SECTION("Empty Page Moves"){
+        std::vector<void*> small;
+        for (int i = 0; i < 1024 / 16; i++) small.push_back(slabs.allocate(16));
+        for (int i = 0; i < 1024 / 128; i++) REQUIRE(slabs.allocate(100) != nullptr);
+        REQUIRE(slabs.allocate(100) == nullptr);
+        for (std::size_t i = 1; i < small.size(); i++) slabs.free(small[i], 16);
+        REQUIRE(!slabs.reassign_page(100));
+        slabs.free(small[0], 16);
+        REQUIRE(slabs.reassign_page(100));
+        for (int i = 0; i < 1024 / 128; i++) REQUIRE(slabs.allocate(100) != nullptr);
+        auto stats = slabs.stats();
+        REQUIRE(stats.size() == 1);
+        REQUIRE(stats[0].chunk_size == 128);
+        REQUIRE(stats[0].pages == 2);
+        REQUIRE(stats[0].used_chunks == 2 * 1024 / 128);
+        REQUIRE(!slabs.reassign_page(100));
+    }
+
+    // Test: sizes larger than a page can't be allocated
+    SECTION("Too Large"){
+        REQUIRE(slabs.max_size() == 1024);
+        REQUIRE(slabs.allocate(1025) == nullptr);
+    }
+}
+
+TEST_CASE("Cache slab usage"){
+    Cache c = Cache(4096);
+    const char *val = "value";
+    size_type val_size = strlen(val) + 1;
+    for (int i = 0; i < 10; i++) {
+        c.set("key" + std::to_string(i), val, val_size);
+    }
+
+    // Test: every stored value holds one chunk, deleted values give it back
+    SECTION("Chunks Follow Values"){
+        auto stats = c.slab_stats();
+        REQUIRE(stats.size() == 1);
+        REQUIRE(stats[0].used_chunks == 10);
+        c.del("key0");
+        c.del("key1");
+        REQUIRE(c.slab_stats()[0].used_chunks == 8);
+        c.reset();
+        REQUIRE(c.slab_stats()[0].used_chunks == 0);
+    }
+}
+
+TEST_CASE("Mixed value sizes"){
+    const std::string small(100, 's');
+    const std::string big(3000, 'b');
+    Cache c(8 << 20, []() -> Evictor* { return new Intrusive_LRU_Evictor(); }, 4);
+    auto totals = [&c](uint64_t Cache::shard_stats::*field) {
+        uint64_t total = 0;
+        for (const auto& st : c.stats()) total += st.*field;
+        return total;
+    };
+    // fill the whole arena with small values
+    int nsmall = 0;
+    while (totals(&Cache::shard_stats::evictions) == 0) {
+        c.set("small" + std::to_string(nsmall++), small.data(), small.size());
+    }
+
+    // Test: once the big values' class is full, a set only evicts values
+    // of that class, and about as many small ones as the budget needs
+    SECTION("Full Class Evicts Its Own"){
+        for (int i = 0; i < 2000; i++)
+        {
+            const uint64_t items = totals(&Cache::shard_stats::items);
+            REQUIRE(c.set("big" + std::to_string(i), big.data(), big.size()));
+            REQUIRE(items + 1 - totals(&Cache::shard_stats::items) <= big.size() / small.size());
+        }
+        REQUIRE(totals(&Cache::shard_stats::items) > uint64_t(nsmall) * 8 / 10);
+    }
+
+    // Test: the values of the full class go in the evictor's order
+    SECTION("Full Class Evicts In Order"){
+        size_type size;
+        for (int i = 0; i < 2000; i++)
+        {
+            REQUIRE(c.set("big" + std::to_string(i), big.data(), big.size()));
+            for (int h = 0; h < 10 && h <= i; h++) REQUIRE(c.get("big" + std::to_string(h), size) != nullptr);
+        }
+    }
+
+    // Test: pages emptied by deletes move over to the class that needs them
+    SECTION("Freed Pages Move"){
+        const uint64_t evictions = totals(&Cache::shard_stats::evictions);
+        for (int i = 0; i < nsmall; i++) c.del("small" + std::to_string(i));
+        for (int i = 0; i < 2000; i++) REQUIRE(c.set("big" + std::to_string(i), big.data(), big.size()));
+        REQUIRE(totals(&Cache::shard_stats::items) == 2000);
+        REQUIRE(totals(&Cache::shard_stats::evictions) == evictions);
+    }
+
+    // Test: a set that can't get a chunk of its class removes nothing
+    SECTION("Failed Set Removes Nothing"){
+        // both pages of the huge values' class stay pinned after a delete
+        const std::string huge(600 << 10, 'h');
+        Cache one(2 << 20, 0.75, new Intrusive_LRU_Evictor());
+        REQUIRE(one.set("huge1", huge.data(), huge.size()));
+        REQUIRE(one.set("huge2", huge.data(), huge.size()));
+        auto pin1 = one.get("huge1");
+        auto pin2 = one.get("huge2");
+        one.del("huge1");
+        one.del("huge2");
+        for (int i = 0; i < 100; i++) one.set("small" + std::to_string(i), small.data(), small.size());
+        REQUIRE(!one.set("huge3", huge.data(), huge.size()));
+        REQUIRE(one.stats()[0].items == 100);
+        pin1 = Cache::handle();
+        REQUIRE(one.set("huge3", huge.data(), huge.size()));
+        REQUIRE(one.stats()[0].items == 101);
+    }
+}
+
+
+/*
+ * Tests for the open-addressing index that finds items by key.
+ */
+
+TEST_CASE("Hash index"){
+    Hash_Index index(0.75);
+    std::vector<std::vector<char>> storage;
+    std::vector<Item*> items;
+    for (int i = 0; i < 200; i++) {
+        std::string key = "key" + std::to_string(i);
+        storage.emplace_back(Item::size_for(key.size(), 0));
+        // every hash has the same low 7 bits, so all fingerprints collide
+        Item* item = new (storage.back().data()) Item((uint64_t(i) << 7) | 0x2A, key.size(), 0);
+        std::copy(key.begin(), key.end(), item->key_data());
+        items.push_back(item);
+        index.insert(item);
+    }
+
+    // Test: every inserted item is found, and the index grew past its initial size
+    SECTION("Find All"){
+        REQUIRE(index.size() == 200);
+        REQUIRE(index.capacity() * 3 / 4 >= 200);
+        for (auto item : items) REQUIRE(index.find(item->key(), item->hash_) == item);
+    }
+
+    // Test: a key with a matching hash but different bytes isn't found
+    SECTION("Missing Key"){
+        REQUIRE(index.find("nokey", items[0]->hash_) == nullptr);
+        REQUIRE(index.find("key0", items[1]->hash_) == nullptr);
+    }
+
+    // Test: erased items are gone, and the others are still reachable
+    SECTION("Erase"){
+        for (int i = 0; i < 200; i += 2) REQUIRE(index.erase(items[i]->key(), items[i]->hash_) == items[i]);
+        REQUIRE(index.size() == 100);
+        REQUIRE(index.erase(items[0]->key(), items[0]->hash_) == nullptr);
+        for (int i = 0; i < 200; i++) {
+            REQUIRE((index.find(items[i]->key(), items[i]->hash_) != nullptr) == (i % 2 == 1));
+        }
+        // reinserting into tombstones works
+        for (int i = 0; i < 200; i += 2) index.insert(items[i]);
+        for (auto item : items) REQUIRE(index.find(item->key(), item->hash_) == item);
+    }
+
+    // Test: a resize moves items a few groups at a time, and every item
+    // stays reachable while both tables are in use
+    SECTION("Incremental Resize"){
+        const std::size_t capacity = index.capacity();
+        std::size_t i = 0;
+        while (!index.rehashing()) {
+            REQUIRE(index.erase(items[i]->key(), items[i]->hash_) == items[i]);
+            index.insert(items[i]);
+            i = (i + 1) % items.size();
+        }
+        bool saw_both = false;
+        while (index.rehashing()) {
+            for (auto item : items) REQUIRE(index.find(item->key(), item->hash_) == item);
+            saw_both = true;
+            index.rehash_step(1);
+        }
+        REQUIRE(saw_both);
+        REQUIRE(index.capacity() >= capacity);
+        REQUIRE(index.size() == 200);
+        for (auto item : items) REQUIRE(index.find(item->key(), item->hash_) == item);
+    }
+
+    // Test: an index sized up front never resizes while filling up
+    SECTION("Reserve"){
+        Hash_Index sized(0.75);
+        sized.reserve(200);
+        const std::size_t capacity = sized.capacity();
+        for (auto item : items) {
+            sized.insert(item);
+            REQUIRE(!sized.rehashing());
+        }
+        REQUIRE(sized.capacity() == capacity);
+    }
+
+    // Test: samples only return indexed items, and reach all of them
+    SECTION("Sample"){
+        std::mt19937_64 gen(7);
+        std::set<Item*> seen;
+        for (int i = 0; i < 20000; i++) {
+            Item* item = index.sample(gen());
+            REQUIRE(index.find(item->key(), item->hash_) == item);
+            seen.insert(item);
+        }
+        REQUIRE(seen.size() == 200);
+        index.clear();
+        REQUIRE(index.sample(gen()) == nullptr);
+    }
+
+    // Test: for_each visits every item once, and clear empties the index
+    SECTION("For Each And Clear"){
+        int count = 0;
+        index.for_each([&count](Item*) { count++; });
+        REQUIRE(count == 200);
+        index.clear();
+        REQUIRE(index.size() == 0);
+        REQUIRE(index.find(items[5]->key(), items[5]->hash_) == nullptr);
+    }
+}
+
+
+/*
+ * Tests for the handles returned by Cache::get(key), which keep a value's
+ * bytes alive while the cache changes underneath them.
+ */
+
+TEST_CASE("Value handles"){
+    Cache c = Cache(4096);
+    const char *val_1 = "3.14159";
+    const char *val_2 = "tau / 2";
+    size_type val_1_size = strlen(val_1) + 1;
+    size_type val_2_size = strlen(val_2) + 1;
+    c.set("Item 1", val_1, val_1_size);
+
+    // Test: a handle gives the value and its size, an absent key an empty handle
+    SECTION("Get Handle"){
+        auto h = c.get("Item 1");
+        REQUIRE(h);
+        REQUIRE(h.size() == val_1_size);
+        REQUIRE(strcmp(h.data(), val_1) == 0);
+        REQUIRE(!c.get("Item 2"));
+    }
+
+    // Test: the value survives a delete, an overwrite and a reset while pinned
+    SECTION("Pinned Through Changes"){
+        auto h1 = c.get("Item 1");
+        c.del("Item 1");
+        auto h2 = c.get("Item 1");
+        REQUIRE(!h2);
+        c.set("Item 1", val_2, val_2_size);
+        h2 = c.get("Item 1");
+        c.reset();
+        REQUIRE(strcmp(h1.data(), val_1) == 0);
+        REQUIRE(strcmp(h2.data(), val_2) == 0);
+        REQUIRE(c.space_used() == 0);
+    }
+
+    // Test: the chunk of an unlinked item is only freed with its last handle
+    SECTION("Freed On Release"){
+        auto h1 = c.get("Item 1");
+        auto h2 = std::move(h1);
+        REQUIRE(!h1);
+        c.del("Item 1");
+        REQUIRE(c.slab_stats()[0].used_chunks == 1);
+        h2.reset();
+        REQUIRE(c.slab_stats()[0].used_chunks == 0);
+    }
+
+    // Test: readers holding handles see whole values while writers replace
+    // and delete the same keys from other threads
+    SECTION("Concurrent Readers And Writers"){
+        const std::string vals[2] = {std::string(100, 'a'), std::string(200, 'b')};
+        bool torn = false;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; t++) {
+            threads.emplace_back([&c, &vals, t]() {
+                for (int i = 0; i < 20000; i++) {
+                    const auto& v = vals[(i + t) % 2];
+                    c.set("key" + std::to_string(i % 8), v.c_str(), v.size() + 1);
+                    if (i % 5 == 0) c.del("key" + std::to_string((i + 3) % 8));
+                }
+            });
+        }
+        for (int t = 0; t < 2; t++) {
+            threads.emplace_back([&c, &vals, &torn]() {
+                for (int i = 0; i < 20000; i++) {
+                    auto h = c.get("key" + std::to_string(i % 8));
+                    if (h && h.data() != vals[0] && h.data() != vals[1]) torn = true;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        REQUIRE(!torn);
+    }
+}
+
+TEST_CASE("Timing wheel"){
+    Timing_Wheel wheel;
+    // expiry times (ms) due on every level of the wheel, the last one past its top
+    const std::vector<uint64_t> expires = {50, 100, 150, 6400, 6450, 500000,
+                                           1800000, 172800000, 2000000000};
+    std::vector<std::vector<char>> storage;
+    std::vector<Item*> items;
+    for (auto e : expires) {
+        storage.emplace_back(Item::size_for(0, 0));
+        items.push_back(new (storage.back().data()) Item(0, 0, 0, e));
+        wheel.schedule(items.back());
+    }
+    REQUIRE(wheel.size() == expires.size());
+
+    // Test: every item comes due at the first tick past its expiry time, and no earlier
+    SECTION("Expire In Order"){
+        std::set<const Item*> expired;
+        for (uint64_t now : {0, 100, 200, 6400, 6500, 499900, 500000, 1800000,
+                             172800000, 1999999900, 2000000000}) {
+            wheel.advance(now, [&](Item* item) {
+                REQUIRE(item->wheel_slot_ == Item::NO_SLOT);
+                expired.insert(item);
+            });
+            for (auto item : items) REQUIRE(expired.count(item) == (item->expires_ <= now));
+        }
+        REQUIRE(wheel.size() == 0);
+    }
+
+    // Test: cancelled items never come due, and rescheduling moves an item
+    SECTION("Cancel And Reschedule"){
+        wheel.cancel(items[0]);
+        wheel.cancel(items[0]);
+        items[1]->expires_ = 600;
+        wheel.schedule(items[1]);
+        REQUIRE(wheel.size() == expires.size() - 1);
+        std::vector<Item*> expired;
+        wheel.advance(500, [&](Item* item) { expired.push_back(item); });
+        REQUIRE(expired == std::vector<Item*>{items[2]});
+        wheel.advance(600, [&](Item* item) { expired.push_back(item); });
+        REQUIRE(expired == std::vector<Item*>{items[2], items[1]});
+        wheel.clear();
+        REQUIRE(wheel.size() == 0);
+        REQUIRE(items[3]->wheel_slot_ == Item::NO_SLOT);
+    }
+}
+
+TEST_CASE("Expiry"){
+    Cache c(4096);
+    const char val[] = "expiring";
+    const auto ttl = std::chrono::milliseconds(50);
+
+    // Test: a get past the TTL misses, and removes the item there and then
+    SECTION("Lazy Expiry"){
+        size_type size;
+        c.set("a", val, sizeof(val), ttl);
+        REQUIRE(c.get("a", size) != nullptr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        REQUIRE(c.get("a", size) == nullptr);
+        REQUIRE(!c.get("a"));
+        REQUIRE(c.stats()[0].expired == 1);
+        REQUIRE(c.stats()[0].expired_bytes == sizeof(val));
+        REQUIRE(c.stats()[0].misses == 2);
+        REQUIRE(c.space_used() == 0);
+    }
+
+    // Test: the expiry thread removes items nobody asks for again
+    SECTION("Background Expiry"){
+        for (int i = 0; i < 10; i++) c.set("key" + std::to_string(i), val, sizeof(val), ttl);
+        c.set("forever", val, sizeof(val));
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        REQUIRE(c.stats()[0].items == 1);
+        REQUIRE(c.stats()[0].expired == 10);
+        REQUIRE(c.value_space_used() == sizeof(val));
+        REQUIRE(c.slab_stats()[0].used_chunks == 1);
+    }
+
+    // Test: setting or deleting a key takes its old TTL off the wheel
+    SECTION("Overwrite Clears TTL"){
+        size_type size;
+        c.set("a", val, sizeof(val), ttl);
+        c.set("a", val, sizeof(val));
+        c.set("b", val, sizeof(val), ttl);
+        c.del("b");
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        REQUIRE(c.get("a", size) != nullptr);
+        REQUIRE(c.stats()[0].expired == 0);
+    }
+
+    // Test: a TTL past MAX_TTL counts as MAX_TTL, rather than overflowing
+    // into the past
+    SECTION("Long TTL"){
+        size_type size;
+        c.set("a", val, sizeof(val), Cache::ttl_type::max());
+        c.set("b", val, sizeof(val), Cache::MAX_TTL + std::chrono::hours(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        REQUIRE(c.get("a", size) != nullptr);
+        REQUIRE(c.get("b", size) != nullptr);
+        REQUIRE(c.stats()[0].expired == 0);
+    }
+}
+
+TEST_CASE("Intrusive evictor"){
+    Cache c(3 * footprint(6, 10), 0.75, new Intrusive_LRU_Evictor());
+    const char *val = "ten bytes";
+    size_type size;
+    c.set("Item 1", val, 10);
+    c.set("Item 2", val, 10);
+    c.set("Item 3", val, 10);
+
+    // Test: the cache evicts the item the evictor hands back
+    SECTION("Evict Least Recent"){
+        c.get("Item 1", size);
+        c.set("Item 4", val, 10);
+        REQUIRE(c.get("Item 2", size) == nullptr);
+        REQUIRE(c.get("Item 1", size) != nullptr);
+        REQUIRE(c.stats()[0].evictions == 1);
+    }
+
+    // Test: with values all of a size, the budget runs out before the slabs
+    // do, so the values read all the time stay
+    SECTION("Hot Items Stay"){
+        Cache big(4 << 20, 0.75, new Intrusive_LRU_Evictor());
+        const std::string value(100, 'v');
+        for (int i = 0; i < 50000; i++)
+        {
+            big.set("key" + std::to_string(i), value.data(), value.size());
+            for (int h = 0; h < 20; h++)
+            {
+                const std::string hot = "hot" + std::to_string(h);
+                if (big.get(hot, size) == nullptr) REQUIRE((i == 0 && big.set(hot, value.data(), value.size())));
+            }
+        }
+        REQUIRE(big.stats()[0].evictions > 0);
+    }
+
+    // Test: deleted, overwritten and reset items leave the evictor's list
+    SECTION("Unlinked Items Leave The List"){
+        c.del("Item 1");
+        c.set("Item 2", val, 10);
+        c.set("Item 4", val, 10);
+        c.set("Item 5", val, 10);
+        REQUIRE(c.get("Item 3", size) == nullptr);
+        REQUIRE(c.get("Item 2", size) != nullptr);
+        c.reset();
+        c.set("Item 6", val, 10);
+        c.set("Item 7", val, 10);
+        c.set("Item 8", val, 10);
+        c.set("Item 9", val, 10);
+        REQUIRE(c.get("Item 6", size) == nullptr);
+        REQUIRE(c.value_space_used() == 30);
+    }
+}
+
+// An evictor that never knows what to evict
+class Empty_Evictor : public Evictor {
+  public:
+    void touch_key(const key_type&) override {}
+    const key_type evict() override { return ""; }
+};
+
+TEST_CASE("Batched eviction"){
+    const char *val = "ten bytes";
+    // fills the whole budget, so every item must go
+    const std::string big(3 * footprint(6, 10) - footprint(3, 0), 'b');
+    size_type size;
+
+    // Test: one batch frees as many items as the new value needs
+    SECTION("Batch Frees Enough"){
+        Cache c(3 * footprint(6, 10), 0.75, new Intrusive_LRU_Evictor());
+        c.set("Item 1", val, 10);
+        c.set("Item 2", val, 10);
+        c.set("Item 3", val, 10);
+        REQUIRE(c.set("Big", big.c_str(), big.size()));
+        REQUIRE(c.stats()[0].evictions == 3);
+        REQUIRE(c.get("Big", size) != nullptr);
+        REQUIRE(c.value_space_used() == big.size());
+    }
+
+    // Test: victims sampled in one batch are never handed out twice
+    SECTION("Sampled Batch"){
+        Cache c(3 * footprint(6, 10), 0.75, new Sampled_LRU_Evictor(16));
+        c.set("Item 1", val, 10);
+        c.set("Item 2", val, 10);
+        c.set("Item 3", val, 10);
+        REQUIRE(c.set("Big", big.c_str(), big.size()));
+        REQUIRE(c.stats()[0].evictions == 3);
+        REQUIRE(c.value_space_used() == big.size());
+    }
+
+    // Test: a set fails instead of spinning when the evictor runs dry
+    SECTION("Evictor Out Of Victims"){
+        Cache c(3 * footprint(6, 10), 0.75, new Empty_Evictor());
+        c.set("Item 1", val, 10);
+        c.set("Item 2", val, 10);
+        c.set("Item 3", val, 10);
+        REQUIRE(!c.set("Item 4", val, 10));
+        REQUIRE(c.get("Item 4", size) == nullptr);
+        REQUIRE(c.value_space_used() == 30);
+    }
+}
+
+TEST_CASE("Sampled evictor"){
+    // room for three items of the longest keys below
+    Cache c(3 * footprint(8, 10), 0.75, new Sampled_LRU_Evictor(16));
+    const char *val = "ten bytes";
+    size_type size;
+    c.set("Item 1", val, 10);
+    c.set("Item 2", val, 10);
+    c.set("Item 3", val, 10);
+
+    // Test: the evictor samples the cache's own items, and never takes the
+    // one read last
+    SECTION("Evict From Samples"){
+        c.get("Item 1", size);
+        c.set("Item 4", val, 10);
+        REQUIRE(c.stats()[0].evictions == 1);
+        REQUIRE(c.get("Item 1", size) != nullptr);
+        REQUIRE(c.get("Item 4", size) != nullptr);
+        REQUIRE(c.value_space_used() == 30);
+    }
+
+    // Test: deleted items are never handed back, even from the pool
+    SECTION("Deleted Items Leave The Pool"){
+        for (int i = 4; i < 40; i++) {
+            c.del("Item " + std::to_string(i - 2));
+            c.set("Item " + std::to_string(i), val, 10);
+            c.set("Item " + std::to_string(i) + "b", val, 10);
+        }
+        REQUIRE(c.value_space_used() == 30);
+    }
+}
+
+TEST_CASE("Touch buffer"){
+    Touch_Buffer buffer;
+    std::vector<std::vector<char>> storage;
+    std::vector<Item*> items;
+    for (int i = 0; i < 100; i++) {
+        storage.emplace_back(Item::size_for(0, 0));
+        items.push_back(new (storage.back().data()) Item(i, 0, 0));
+    }
+
+    // Test: a thread's touches drain in order, and only once
+    SECTION("Drain In Order"){
+        for (int i = 0; i < 10; i++) REQUIRE(buffer.record(items[i]));
+        std::vector<Item*> drained;
+        buffer.drain([&drained](Item* item) { drained.push_back(item); });
+        REQUIRE(drained == std::vector<Item*>(items.begin(), items.begin() + 10));
+        drained.clear();
+        buffer.drain([&drained](Item* item) { drained.push_back(item); });
+        REQUIRE(drained.empty());
+    }
+
+    // Test: touches are dropped once a ring is full, and recorded again after a drain
+    SECTION("Full Ring Drops"){
+        for (unsigned i = 0; i < Touch_Buffer::RING_SIZE; i++) REQUIRE(buffer.record(items[i % 100]));
+        REQUIRE(!buffer.record(items[0]));
+        std::size_t count = 0;
+        buffer.drain([&count](Item*) { count++; });
+        REQUIRE(count == Touch_Buffer::RING_SIZE);
+        REQUIRE(buffer.record(items[0]));
+    }
+
+    // Test: gets of one hot key from many threads buffer their touches while
+    // sets drain them and evict; the evictor stays in step with the index
+    SECTION("Concurrent Hot Key"){
+        Cache c(2000, 0.75, new Intrusive_LRU_Evictor());
+        const std::string val(99, 'v');
+        c.set("hot", val.c_str(), val.size() + 1);
+        std::vector<std::thread> threads;
+        std::atomic<bool> torn(false);
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&c, &val, &torn]() {
+                for (int i = 0; i < 20000; i++) {
+                    auto h = c.get("hot");
+                    if (h && h.data() != val) torn = true;
+                }
+            });
+        }
+        threads.emplace_back([&c, &val]() {
+            for (int i = 0; i < 20000; i++) {
+                c.set("key" + std::to_string(i % 100), val.c_str(), val.size() + 1);
+                if (i % 3 == 0) c.del("key" + std::to_string((i + 50) % 100));
+            }
+        });
+        for (auto& t : threads) t.join();
+        REQUIRE(!torn);
+        REQUIRE(c.value_space_used() == c.stats()[0].items * 100);
+        REQUIRE(c.space_used() <= 2000);
+    }
+}
+
+TEST_CASE("Clock evictor"){
+    // Test: gets touch items without the evictor lock while other threads
+    // set keys and force evictions; values stay whole and the books balance
+    SECTION("Concurrent Touches And Evictions"){
+        Cache c(4 * 2000, []() { return new Clock_Evictor(); }, 4);
+        const std::string vals[2] = {std::string(99, 'a'), std::string(99, 'b')};
+        std::atomic<bool> torn(false);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 2; t++) {
+            threads.emplace_back([&c, &vals, t]() {
+                for (int i = 0; i < 20000; i++) {
+                    const auto& v = vals[(i + t) % 2];
+                    c.set("key" + std::to_string((i * 7 + t) % 200), v.c_str(), v.size() + 1);
+                }
+            });
+        }
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&c, &vals, &torn, t]() {
+                for (int i = 0; i < 40000; i++) {
+                    auto h = c.get("key" + std::to_string((i + t) % 200));
+                    if (h && h.data() != vals[0] && h.data() != vals[1]) torn = true;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        REQUIRE(!torn);
+        uint64_t items = 0, evictions = 0, sets = 0;
+        for (auto& st : c.stats()) {
+            items += st.items;
+            evictions += st.evictions;
+            sets += st.sets;
+        }
+        REQUIRE(evictions > 0);
+        REQUIRE(c.value_space_used() == items * 100);
+        REQUIRE(c.space_used() <= 4 * 2000);
+        REQUIRE(sets == 40000);
+    }
+}
+
+TEST_CASE("Admission"){
+    // the window's entries count against the budget as well
+    auto evictor = new TinyLFU_Evictor(new Intrusive_LRU_Evictor());
+    Cache c(3 * (footprint(6, 10) + evictor->item_overhead(6)), 0.75, evictor);
+    const char *val = "ten bytes";
+    size_type size;
+    REQUIRE(c.set("Item 1", val, 10));
+    REQUIRE(c.set("Item 2", val, 10));
+    REQUIRE(c.set("Item 3", val, 10));
+    // Item 3 is left in the window, and read the most
+    for (int i = 0; i < 3; i++) {
+        c.get("Item 1", size);
+        c.get("Item 2", size);
+        c.get("Item 3", size);
+    }
+    c.get("Item 3", size);
+
+    // Test: a new key gets in through the window, and pushes out its
+    // candidate, which replaces the main region's victim if more frequent
+    SECTION("New Key Enters Window"){
+        REQUIRE(c.set("Item 4", val, 10));
+        REQUIRE(c.get("Item 4", size) != nullptr);
+        REQUIRE(c.get("Item 1", size) == nullptr);
+        REQUIRE(c.get("Item 3", size) != nullptr);
+        REQUIRE(c.stats()[0].rejections == 0);
+        REQUIRE(c.stats()[0].evictions == 1);
+        REQUIRE(c.value_space_used() == 30);
+    }
+
+    // Test: a cold key only lasts until the next new key pushes it out of
+    // the window, as it loses to the victim
+    SECTION("Cold Key Leaves"){
+        REQUIRE(c.set("Item 4", val, 10));
+        REQUIRE(c.set("Item 5", val, 10));
+        REQUIRE(c.get("Item 4", size) == nullptr);
+        REQUIRE(c.get("Item 5", size) != nullptr);
+        REQUIRE(c.get("Item 2", size) != nullptr);
+        REQUIRE(c.get("Item 3", size) != nullptr);
+    }
+
+    // Test: a key read often while in the window stays once pushed out
+    SECTION("Frequent Key Stays"){
+        REQUIRE(c.set("Item 4", val, 10));
+        for (int i = 0; i < 10; i++) c.get("Item 4", size);
+        REQUIRE(c.set("Item 5", val, 10));
+        REQUIRE(c.get("Item 4", size) != nullptr);
+        REQUIRE(c.get("Item 2", size) == nullptr);
+    }
+}
+
+/*
+ * Tests for the memcached text protocol. Commands are fed in as they would
+ * be read from a socket, and the queued responses read back as one string.
+ */
+
+// Feed input to a connection (of any of the stream protocols) and return
+// the responses queued, along with how many bytes it took
+template <class Connection>
+static std::string
+connection_run(Connection& conn, const std::string& input, std::size_t* used = nullptr)
+{
+    const std::size_t n = conn.consume(input.data(), input.size());
+    if (used != nullptr) *used = n;
+    std::string out;
+    conn.for_each_buffer([&out](const char* data, std::size_t size) { out.append(data, size); });
+    conn.clear();
+    return out;
+}
+
+TEST_CASE("Memcache text protocol"){
+    Cache c(1 << 20);
+    Memcache_Connection conn(c);
+
+    // Test: pipelined sets and a multi-get, with binary values
+    SECTION("Set And Get"){
+        using namespace std::string_literals;
+        REQUIRE(connection_run(conn, "set a 0 0 3\r\nabc\r\nset b 0 0 3 noreply\r\nx\0y\r\nget a b missing\r\n"s)
+                == "STORED\r\nVALUE a 0 3\r\nabc\r\nVALUE b 0 3\r\nx\0y\r\nEND\r\n"s);
+        REQUIRE(connection_run(conn, "gets a\r\n") == "VALUE a 0 3 0\r\nabc\r\nEND\r\n");
+    }
+
+    // Test: a command is only run once all of it has arrived
+    SECTION("Partial Commands"){
+        std::size_t used = 0;
+        REQUIRE(connection_run(conn, "set a 0 0 5\r\nab", &used) == "");
+        REQUIRE(used == 0);
+        REQUIRE(connection_run(conn, "set a 0 0 5\r\nabcde\r\nget", &used) == "STORED\r\n");
+        REQUIRE(used == 20);
+    }
+
+    // Test: add and replace depend on the key being there, delete reports it
+    SECTION("Add Replace Delete"){
+        REQUIRE(connection_run(conn, "replace a 0 0 1\r\nx\r\nadd a 0 0 1\r\nx\r\nadd a 0 0 1\r\ny\r\n")
+                == "NOT_STORED\r\nSTORED\r\nNOT_STORED\r\n");
+        REQUIRE(connection_run(conn, "replace a 0 0 1\r\nz\r\nget a\r\n")
+                == "STORED\r\nVALUE a 0 1\r\nz\r\nEND\r\n");
+        REQUIRE(connection_run(conn, "delete a\r\ndelete a\r\ndelete a noreply\r\n")
+                == "DELETED\r\nNOT_FOUND\r\n");
+        // only the get counts as an access
+        REQUIRE(c.stats()[0].hits == 1);
+        REQUIRE(c.stats()[0].misses == 0);
+    }
+
+    // Test: bad commands are answered with errors and their data skipped
+    SECTION("Errors"){
+        REQUIRE(connection_run(conn, "bogus\r\n") == "ERROR\r\n");
+        REQUIRE(connection_run(conn, "set a 0 x 1\r\nq\r\nget a\r\n")
+                == "CLIENT_ERROR bad command line format\r\nEND\r\n");
+        const std::string big(Memcache_Connection::MAX_VALUE + 1, 'v');
+        REQUIRE(connection_run(conn, "set a 0 0 " + std::to_string(big.size()) + "\r\n" + big + "\r\nget a\r\n")
+                == "SERVER_ERROR object too large for cache\r\nEND\r\n");
+        REQUIRE(connection_run(conn, "get " + std::string(251, 'k') + "\r\n")
+                == "CLIENT_ERROR bad command line format\r\n");
+    }
+
+    // Test: values already expired aren't kept, flush_all empties the cache
+    SECTION("Expiry And Flush"){
+        REQUIRE(connection_run(conn, "set a 0 -1 1\r\nx\r\nget a\r\n") == "STORED\r\nEND\r\n");
+        REQUIRE(connection_run(conn, "set a 0 100 1\r\nx\r\nflush_all\r\nget a\r\n")
+                == "STORED\r\nOK\r\nEND\r\n");
+        REQUIRE(c.stats()[0].items == 0);
+        // a Unix time too far ahead to count in milliseconds is cut down
+        REQUIRE(connection_run(conn, "set a 0 9223372036854775807 1\r\nx\r\nget a\r\n")
+                == "STORED\r\nVALUE a 0 1\r\nx\r\nEND\r\n");
+    }
+
+    // Test: stats end with END, and quit closes the connection
+    SECTION("Stats And Quit"){
+        connection_run(conn, "set a 0 0 1\r\nx\r\n");
+        const std::string stats = connection_run(conn, "stats\r\n");
+        REQUIRE(stats.find("STAT curr_items 1\r\n") != std::string::npos);
+        REQUIRE(stats.substr(stats.size() - 5) == "END\r\n");
+        REQUIRE(!conn.closing());
+        REQUIRE(connection_run(conn, "quit\r\nget a\r\n") == "");
+        REQUIRE(conn.closing());
+    }
+}
+
+/*
+ * Tests for the memcached binary protocol. Requests are built byte by
+ * byte, and the responses queued for them split back into their fields.
+ */
+
+struct Binary_Response {
+    int opcode;
+    int status;
+    uint32_t opaque;
+    std::string extras;
+    std::string key;
+    std::string value;
+};
+
+static void
+put_big_endian(std::string& out, uint64_t number, std::size_t size)
+{
+    for (std::size_t i = size; i-- > 0;) out += static_cast<char>(number >> (8 * i) & 0xff);
+}
+
+static uint64_t
+get_big_endian(const std::string& in, std::size_t pos, std::size_t size)
+{
+    uint64_t number = 0;
+    for (std::size_t i = 0; i < size; ++i) number = number << 8 | static_cast<unsigned char>(in[pos + i]);
+    return number;
+}
+
+// A binary request with the given fields
+static std::string
+memcache_request(int opcode, const std::string& key = "", const std::string& value = "",
+                 const std::string& extras = "", uint32_t opaque = 0, uint64_t cas = 0)
+{
+    std::string req;
+    req += '\x80';
+    req += static_cast<char>(opcode);
+    put_big_endian(req, key.size(), 2);
+    req += static_cast<char>(extras.size());
+    put_big_endian(req, 0, 3);
+    put_big_endian(req, extras.size() + key.size() + value.size(), 4);
+    put_big_endian(req, opaque, 4);
+    put_big_endian(req, cas, 8);
+    return req + extras + key + value;
+}
+
+// The extras of a storage request: flags, then expiration time
+static std::string
+memcache_store_extras(uint32_t exptime = 0)
+{
+    std::string extras(4, '\0');
+    put_big_endian(extras, exptime, 4);
+    return extras;
+}
+
+// Split a stream of binary responses
+static std::vector<Binary_Response>
+memcache_responses(const std::string& out)
+{
+    std::vector<Binary_Response> responses;
+    for (std::size_t pos = 0; pos + Memcache_Connection::HEADER_SIZE <= out.size();)
+    {
+        REQUIRE(static_cast<unsigned char>(out[pos]) == 0x81);
+        const std::size_t key_len = get_big_endian(out, pos + 2, 2);
+        const std::size_t extras_len = static_cast<unsigned char>(out[pos + 4]);
+        const std::size_t body_len = get_big_endian(out, pos + 8, 4);
+        const std::size_t body = pos + Memcache_Connection::HEADER_SIZE;
+        responses.push_back(Binary_Response{
+            static_cast<unsigned char>(out[pos + 1]),
+            static_cast<int>(get_big_endian(out, pos + 6, 2)),
+            static_cast<uint32_t>(get_big_endian(out, pos + 12, 4)),
+            out.substr(body, extras_len),
+            out.substr(body + extras_len, key_len),
+            out.substr(body + extras_len + key_len, body_len - extras_len - key_len)});
+        pos = body + body_len;
+    }
+    return responses;
+}
+
+TEST_CASE("Memcache binary protocol"){
+    Cache c(1 << 20);
+    Memcache_Connection conn(c);
+    const int GET = 0x00, SET = 0x01, ADD = 0x02, REPLACE = 0x03, DELETE = 0x04, QUIT = 0x07,
+        GETQ = 0x09, NOOP = 0x0a, VERSION = 0x0b, GETK = 0x0c, GETKQ = 0x0d, STAT = 0x10, SETQ = 0x11;
+
+    // Test: a set then a get, which answers with flags and the value
+    SECTION("Set And Get"){
+        const auto res = memcache_responses(connection_run(conn,
+            memcache_request(SET, "a", std::string("x\0y", 3), memcache_store_extras(), 7)
+            + memcache_request(GET, "a", "", "", 8)
+            + memcache_request(GETK, "a")
+            + memcache_request(GET, "missing")));
+        REQUIRE(res.size() == 4);
+        REQUIRE(res[0].opcode == SET);
+        REQUIRE(res[0].status == 0);
+        REQUIRE(res[0].opaque == 7);
+        REQUIRE(res[1].status == 0);
+        REQUIRE(res[1].opaque == 8);
+        REQUIRE(res[1].extras == std::string(4, '\0'));
+        REQUIRE(res[1].key == "");
+        REQUIRE(res[1].value == std::string("x\0y", 3));
+        REQUIRE(res[2].key == "a");
+        REQUIRE(res[2].value == std::string("x\0y", 3));
+        REQUIRE(res[3].status == 1);
+    }
+
+    // Test: quiet requests only answer hits, and the noop closes the batch
+    SECTION("Quiet Pipeline"){
+        std::string batch;
+        for (int i = 0; i < 100; ++i)
+        {
+            batch += memcache_request(SETQ, "k" + std::to_string(i), "v", memcache_store_extras());
+        }
+        for (int i = 0; i < 200; i += 2)
+        {
+            batch += memcache_request(GETKQ, "k" + std::to_string(i), "", "", i);
+        }
+        batch += memcache_request(GETQ, "k1") + memcache_request(NOOP, "", "", "", 1000);
+        const auto res = memcache_responses(connection_run(conn, batch));
+        REQUIRE(res.size() == 52);
+        REQUIRE(res[0].key == "k0");
+        REQUIRE(res[49].key == "k98");
+        REQUIRE(res[49].opaque == 98);
+        REQUIRE(res[50].opcode == GETQ);
+        REQUIRE(res[50].value == "v");
+        REQUIRE(res[51].opcode == NOOP);
+        REQUIRE(res[51].opaque == 1000);
+    }
+
+    // Test: a request is only run once all of it has arrived
+    SECTION("Partial Requests"){
+        const std::string req = memcache_request(SET, "a", "abcde", memcache_store_extras());
+        std::size_t used = 0;
+        REQUIRE(connection_run(conn, req.substr(0, 10), &used) == "");
+        REQUIRE(used == 0);
+        REQUIRE(connection_run(conn, req.substr(0, req.size() - 1), &used) == "");
+        REQUIRE(used == 0);
+        REQUIRE(memcache_responses(connection_run(conn, req + "\x80", &used)).size() == 1);
+        REQUIRE(used == req.size());
+    }
+
+    // Test: add and replace depend on the key being there, a CAS never
+    // matches, and delete reports whether the key was there
+    SECTION("Add Replace Delete"){
+        auto status = [&conn](const std::string& req) { return memcache_responses(connection_run(conn, req)).at(0).status; };
+        REQUIRE(status(memcache_request(REPLACE, "a", "x", memcache_store_extras())) == 1);
+        REQUIRE(status(memcache_request(ADD, "a", "x", memcache_store_extras())) == 0);
+        REQUIRE(status(memcache_request(ADD, "a", "y", memcache_store_extras())) == 2);
+        REQUIRE(status(memcache_request(REPLACE, "a", "z", memcache_store_extras())) == 0);
+        REQUIRE(status(memcache_request(SET, "a", "w", memcache_store_extras(), 0, 1)) == 2);
+        REQUIRE(memcache_responses(connection_run(conn, memcache_request(GET, "a"))).at(0).value == "z");
+        REQUIRE(status(memcache_request(DELETE, "a")) == 0);
+        REQUIRE(status(memcache_request(DELETE, "a")) == 1);
+    }
+
+    // Test: bad requests are answered with errors and their bodies skipped
+    SECTION("Errors"){
+        const std::string big(Memcache_Connection::MAX_VALUE + 1, 'v');
+        const auto res = memcache_responses(connection_run(conn,
+            memcache_request(0x50)
+            + memcache_request(SET, "a", "x")
+            + memcache_request(SETQ, "a", big, memcache_store_extras())
+            + memcache_request(GET, std::string(251, 'k'))
+            + memcache_request(GET, "a")));
+        REQUIRE(res.size() == 5);
+        REQUIRE(res[0].status == 0x81);
+        REQUIRE(res[1].status == 4);
+        REQUIRE(res[2].status == 3);
+        REQUIRE(res[3].status == 4);
+        REQUIRE(res[4].status == 1);
+        REQUIRE(connection_run(conn, "get a\r\n") == "");
+        REQUIRE(conn.closing());
+    }
+
+    // Test: values already expired aren't kept
+    SECTION("Expiry"){
+        REQUIRE(memcache_responses(connection_run(conn,
+            memcache_request(SET, "a", "x", memcache_store_extras(1))
+            + memcache_request(SET, "b", "x", memcache_store_extras(1000000000))
+            + memcache_request(GETQ, "b"))).size() == 2);
+        REQUIRE(c.stats()[0].items == 1);
+    }
+
+    // Test: stats end with an empty response, version answers, and quit
+    // closes the connection
+    SECTION("Stats Version And Quit"){
+        connection_run(conn, memcache_request(SET, "a", "x", memcache_store_extras()));
+        const auto res = memcache_responses(connection_run(conn, memcache_request(STAT) + memcache_request(VERSION)));
+        REQUIRE(res.size() >= 3);
+        bool found = false;
+        for (const auto& r : res) found |= r.key == "curr_items" && r.value == "1";
+        REQUIRE(found);
+        REQUIRE(res[res.size() - 2].key == "");
+        REQUIRE(res[res.size() - 2].value == "");
+        REQUIRE(res.back().value == "1.6.0");
+        REQUIRE(!conn.closing());
+        REQUIRE(memcache_responses(connection_run(conn, memcache_request(QUIT) + memcache_request(GET, "a"))).size() == 1);
+        REQUIRE(conn.closing());
+    }
+}
+
+/*
+ * Tests for the Redis protocol, fed in and read back as for memcached's.
+ */
+
+TEST_CASE("RESP protocol"){
+    Cache c(1 << 20);
+    Resp_Connection conn(c);
+
+    // Test: pipelined commands get their replies in order, with binary
+    // values and nil for missing keys
+    SECTION("Set And Get"){
+        using namespace std::string_literals;
+        REQUIRE(connection_run(conn, "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$3\r\nx\0y\r\n"
+                                     "*2\r\n$3\r\nget\r\n$1\r\na\r\n*2\r\n$3\r\nGET\r\n$1\r\nb\r\n"s)
+                == "+OK\r\n$3\r\nx\0y\r\n$-1\r\n"s);
+        REQUIRE(connection_run(conn, "*5\r\n$4\r\nMSET\r\n$1\r\nb\r\n$2\r\nbb\r\n$1\r\nc\r\n$0\r\n\r\n"
+                                     "*4\r\n$4\r\nMGET\r\n$1\r\nb\r\n$1\r\nz\r\n$1\r\nc\r\n")
+                == "+OK\r\n*3\r\n$2\r\nbb\r\n$-1\r\n$0\r\n\r\n");
+    }
+
+    // Test: a command is only run once all of it has arrived
+    SECTION("Partial Commands"){
+        const std::string cmd = "*3\r\n$3\r\nSET\r\n$1\r\na\r\n$5\r\nabcde\r\n";
+        for (std::size_t n = 0; n < cmd.size(); ++n)
+        {
+            std::size_t used = 1;
+            REQUIRE(connection_run(conn, cmd.substr(0, n), &used) == "");
+            REQUIRE(used == 0);
+        }
+        std::size_t used = 0;
+        REQUIRE(connection_run(conn, cmd + "*1\r\n", &used) == "+OK\r\n");
+        REQUIRE(used == cmd.size());
+    }
+
+    // Test: a long array received a piece at a time, as the read buffer
+    // grows and moves, is run once with all of its arguments
+    SECTION("Long Array In Pieces"){
+        std::string cmd = "*2001\r\n$4\r\nMSET\r\n";
+        for (int i = 0; i < 1000; i++) {
+            const std::string key = "key" + std::to_string(i);
+            cmd += "$" + std::to_string(key.size()) + "\r\n" + key + "\r\n$1\r\nv\r\n";
+        }
+        std::string out;
+        for (std::size_t n = 100; out.empty(); n += 100) {
+            std::size_t used = 0;
+            out = connection_run(conn, std::string(cmd, 0, std::min(n, cmd.size())), &used);
+            REQUIRE(used == (out.empty() ? 0 : cmd.size()));
+        }
+        REQUIRE(out == "+OK\r\n");
+        REQUIRE(connection_run(conn, "EXISTS key0 key999 key1000\r\n") == ":2\r\n");
+    }
+
+    // Test: DEL and EXISTS count keys, FLUSHALL empties the cache, and
+    // inline commands work too
+    SECTION("Del Exists Flushall"){
+        connection_run(conn, "MSET a 1 b 2\r\n");
+        REQUIRE(connection_run(conn, "EXISTS a b a z\r\nDEL a z\r\nexists a\r\n") == ":3\r\n:1\r\n:0\r\n");
+        REQUIRE(connection_run(conn, "FLUSHALL\r\nEXISTS b\r\n") == "+OK\r\n:0\r\n");
+        REQUIRE(c.stats()[0].items == 0);
+    }
+
+    // Test: EX and PX set a TTL, and bad ones are refused
+    SECTION("Expiry"){
+        REQUIRE(connection_run(conn, "SET a 1 EX 100\r\nSET b 1 px 1\r\n") == "+OK\r\n+OK\r\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE(connection_run(conn, "EXISTS a b\r\n") == ":1\r\n");
+        REQUIRE(connection_run(conn, "SET a 1 EX 0\r\nSET a 1 EX x\r\n")
+                == "-ERR invalid expire time in 'set' command\r\n-ERR invalid expire time in 'set' command\r\n");
+        REQUIRE(connection_run(conn, "SET a 1 EX 1 PX 1\r\nSET a 1 KEEPTTL\r\n")
+                == "-ERR syntax error\r\n-ERR syntax error\r\n");
+    }
+
+    // Test: PING, INFO, errors, and QUIT closing the connection
+    SECTION("Ping Info Errors And Quit"){
+        REQUIRE(connection_run(conn, "PING\r\n*2\r\n$4\r\nping\r\n$2\r\nhi\r\n") == "+PONG\r\n$2\r\nhi\r\n");
+        REQUIRE(connection_run(conn, "INFO\r\n").find("db0:keys=0\r\n") != std::string::npos);
+        REQUIRE(connection_run(conn, "BOGUS\r\nGET\r\n")
+                == "-ERR unknown command\r\n-ERR wrong number of arguments for 'get' command\r\n");
+        REQUIRE(!conn.closing());
+        REQUIRE(connection_run(conn, "QUIT\r\nPING\r\n") == "+OK\r\n");
+        REQUIRE(conn.closing());
+    }
+
+    // Test: values can't be stored under an empty key, and MSET stores
+    // none of its pairs if any key is empty
+    SECTION("Empty Key"){
+        REQUIRE(connection_run(conn, "*3\r\n$3\r\nSET\r\n$0\r\n\r\n$1\r\nx\r\n")
+                == "-ERR empty keys are not supported\r\n");
+        REQUIRE(connection_run(conn, "*5\r\n$4\r\nMSET\r\n$1\r\na\r\n$1\r\nx\r\n$0\r\n\r\n$1\r\ny\r\n")
+                == "-ERR empty keys are not supported\r\n");
+        REQUIRE(connection_run(conn, "EXISTS a\r\n") == ":0\r\n");
+        REQUIRE(!conn.closing());
+    }
+
+    // Test: a malformed array is answered with an error, and closes the
+    // connection
+    SECTION("Protocol Error"){
+        REQUIRE(connection_run(conn, "*1\r\n+PING\r\nPING\r\n") == "-ERR Protocol error: expected '$'\r\n");
+        REQUIRE(conn.closing());
+    }
+
+    // Test: a command is refused as soon as its bulk strings announce more
+    // than MAX_REQUEST bytes, before they have all arrived
+    SECTION("Request Too Big"){
+        const std::string bulk = "$" + std::to_string(Resp_Connection::MAX_BULK) + "\r\n"
+                               + std::string(Resp_Connection::MAX_BULK, 'x') + "\r\n";
+        std::string request = "*20\r\n$4\r\nMSET\r\n";
+        for (std::size_t i = 0; i < Resp_Connection::MAX_REQUEST / Resp_Connection::MAX_BULK; i++) request += bulk;
+        REQUIRE(connection_run(conn, request) == "-ERR Protocol error: too big request\r\n");
+        REQUIRE(conn.closing());
+    }
+}
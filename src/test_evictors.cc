@@ -1,8 +1,18 @@
 #include "fifo_evictor.hh"
 #include "lru_evictor.hh"
+#include "intrusive_lru_evictor.hh"
+#include "clock_evictor.hh"
+#include "s3fifo_evictor.hh"
+#include "tinylfu_evictor.hh"
+#include "arc_evictor.hh"
+#include "gdsf_evictor.hh"
+#include "sampled_lru_evictor.hh"
+#include "slru_evictor.hh"
 #include "catch.hpp"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 using size_type = uint32_t;
 /*
  * Some basic unit tests for a FIFO evictor
@@ -50,6 +60,31 @@ TEST_CASE("fifo"){
         fifo->touch_key(key_1);
         REQUIRE(fifo->evict() == key_1);
     }
+
+    // Test: touching a queued key again doesn't queue it twice
+    SECTION("Touch Queues Once"){
+        fifo->touch_key(key_1);
+        fifo->touch_key(key_1);
+        fifo->touch_key(key_2);
+        fifo->touch_key(key_1);
+        REQUIRE(fifo->evict() == key_1);
+        REQUIRE(fifo->evict() == key_2);
+        REQUIRE(fifo->evict() == "");
+    }
+
+    // Test: an erased key leaves the queue, and erasing twice is harmless
+    SECTION("Erase"){
+        fifo->touch_key(key_1);
+        fifo->touch_key(key_2);
+        fifo->touch_key(key_3);
+        fifo->erase_key(key_2);
+        fifo->erase_key(key_2);
+        REQUIRE(fifo->evict() == key_1);
+        REQUIRE(fifo->evict() == key_3);
+        fifo->touch_key(key_2);
+        REQUIRE(fifo->evict() == key_2);
+        REQUIRE(fifo->evict() == "");
+    }
     delete fifo;
 }
 
@@ -101,4 +136,528 @@ TEST_CASE("lru"){
       lru.touch_key(key_1);
       REQUIRE(lru.evict() == key_2);
     }
+    // Test: erased keys, first, middle or last, are never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+      lru.erase_key(key_1);
+      lru.erase_key(key_3);
+      lru.erase_key(key_3);
+      lru.erase_key(key_4);
+      REQUIRE(lru.evict() == key_2);
+      REQUIRE(lru.evict() == "");
+      lru.touch_key(key_3);
+      REQUIRE(lru.evict() == key_3);
+    }
+}
+
+/*
+ * Some basic unit tests for an intrusive LRU evictor, which works on the
+ * hooks of items rather than on keys.
+ */
+
+TEST_CASE("intrusive lru"){
+    // Expected behavior: same order as the lru evictor, with hooks standing
+    // in for keys; an empty evictor returns nullptr from evict_item()
+    Intrusive_LRU_Evictor lru;
+    Evictor_Hook hooks[4];
+    for (auto& hook : hooks) lru.touch_item(hook, "", 1);
+
+    // Test: the first item touched is evicted first if no other touches are made
+    SECTION("Evict One Item"){
+        REQUIRE(lru.evict_item() == &hooks[0]);
+        REQUIRE(lru.evict_item() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 4; i++) lru.evict_item();
+        REQUIRE(lru.evict_item() == nullptr);
+        REQUIRE(lru.evict() == "");
+    }
+    // Test: touching an item moves it to the back, even when it is last already
+    SECTION("Touch Moves To Back"){
+        lru.touch_item(hooks[0], "", 1);
+        lru.touch_item(hooks[3], "", 1);
+        REQUIRE(lru.evict_item() == &hooks[1]);
+        REQUIRE(lru.evict_item() == &hooks[2]);
+        REQUIRE(lru.evict_item() == &hooks[0]);
+        REQUIRE(lru.evict_item() == &hooks[3]);
+    }
+    // Test: of the items a filter takes, the least recent goes, and the others stay in order
+    SECTION("Evict Accepted"){
+        auto odd = [&hooks](const Evictor_Hook& hook) { return (&hook - hooks) % 2 == 1; };
+        REQUIRE(lru.evict_item_if(odd) == &hooks[1]);
+        REQUIRE(lru.evict_item_if(odd) == &hooks[3]);
+        REQUIRE(lru.evict_item_if(odd) == nullptr);
+        REQUIRE(lru.evict_item() == &hooks[0]);
+        REQUIRE(lru.evict_item() == &hooks[2]);
+    }
+    // Test: erased items are unlinked and never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+        lru.erase_item(hooks[1], "");
+        lru.erase_item(hooks[1], "");
+        REQUIRE(hooks[1].next_ == nullptr);
+        REQUIRE(lru.evict_item() == &hooks[0]);
+        REQUIRE(lru.evict_item() == &hooks[2]);
+        lru.touch_item(hooks[1], "", 1);
+        REQUIRE(lru.evict_item() == &hooks[3]);
+        REQUIRE(lru.evict_item() == &hooks[1]);
+    }
+}
+
+/*
+ * Some basic unit tests for a CLOCK evictor.
+ */
+
+TEST_CASE("clock"){
+    // Expected behavior: items are evicted in the order they were first
+    // touched, except that an item touched again since the hand last passed
+    // it is skipped once
+    Clock_Evictor clock;
+    Evictor_Hook hooks[4];
+    for (auto& hook : hooks) clock.touch_item(hook, "", 1);
+
+    // Test: without further touches, items go in insertion order
+    SECTION("Evict In Order"){
+        REQUIRE(clock.evict_item() == &hooks[0]);
+        REQUIRE(clock.evict_item() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 4; i++) clock.evict_item();
+        REQUIRE(clock.evict_item() == nullptr);
+    }
+    // Test: a touched item gets a second chance, but only one
+    SECTION("Second Chance"){
+        clock.touch_item(hooks[0], "", 1);
+        REQUIRE(clock.evict_item() == &hooks[1]);
+        REQUIRE(clock.evict_item() == &hooks[2]);
+        REQUIRE(clock.evict_item() == &hooks[3]);
+        REQUIRE(clock.evict_item() == &hooks[0]);
+    }
+    // Test: when every item was touched, the hand clears them all and comes back to the first
+    SECTION("All Referenced"){
+        for (auto& hook : hooks) clock.touch_item(hook, "", 1);
+        REQUIRE(clock.evict_item() == &hooks[0]);
+        REQUIRE(clock.evict_item() == &hooks[1]);
+    }
+    // Test: of the items a filter takes, a touched one gets its second chance
+    SECTION("Evict Accepted"){
+        auto odd = [&hooks](const Evictor_Hook& hook) { return (&hook - hooks) % 2 == 1; };
+        clock.touch_item(hooks[1], "", 1);
+        REQUIRE(clock.evict_item_if(odd) == &hooks[3]);
+        REQUIRE(clock.evict_item_if(odd) == &hooks[1]);
+        REQUIRE(clock.evict_item_if(odd) == nullptr);
+        REQUIRE(clock.evict_item() == &hooks[0]);
+    }
+    // Test: erased items are never evicted, and their slot is reused
+    SECTION("Erase"){
+        Evictor_Hook extra;
+        clock.erase_item(hooks[1], "");
+        clock.erase_item(hooks[1], "");
+        clock.touch_item(extra, "", 1);
+        REQUIRE(extra.meta_ == 2);
+        REQUIRE(clock.evict_item() == &hooks[0]);
+        REQUIRE(clock.evict_item() == &extra);
+        REQUIRE(clock.evict_item() == &hooks[2]);
+    }
+    // Test: the slot array grows past its initial size
+    SECTION("Many Items"){
+        std::vector<Evictor_Hook> more(1000);
+        for (auto& hook : more) clock.touch_item(hook, "", 1);
+        for (auto& hook : hooks) clock.touch_item(hook, "", 1);
+        REQUIRE(clock.evict_item() == &more[0]);
+    }
+}
+
+/*
+ * Some basic unit tests for an S3-FIFO evictor.
+ */
+
+TEST_CASE("s3fifo"){
+    // Expected behavior: new items leave in insertion order unless read
+    // again; read items and recently evicted keys coming back are kept longer
+    S3_Fifo_Evictor s3fifo;
+    Evictor_Hook hooks[10];
+    for (int i = 0; i < 10; i++) s3fifo.touch_item(hooks[i], "key" + std::to_string(i), 1);
+
+    // Test: without reads, items go in insertion order
+    SECTION("Evict In Order"){
+        REQUIRE(s3fifo.evict_item() == &hooks[0]);
+        REQUIRE(s3fifo.evict_item() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 10; i++) s3fifo.evict_item();
+        REQUIRE(s3fifo.evict_item() == nullptr);
+    }
+    // Test: an item read on probation moves to the main queue and outlives the others
+    SECTION("Read Items Survive"){
+        s3fifo.touch_item(hooks[0], "key0", 1);
+        for (int i = 1; i < 10; i++) REQUIRE(s3fifo.evict_item() == &hooks[i]);
+        REQUIRE(s3fifo.evict_item() == &hooks[0]);
+    }
+    // Test: a key evicted from the small queue comes back straight into the main queue
+    SECTION("Ghost Hit"){
+        Evictor_Hook again;
+        REQUIRE(s3fifo.evict_item() == &hooks[0]);
+        s3fifo.touch_item(again, "key0", 1);
+        for (int i = 1; i < 10; i++) REQUIRE(s3fifo.evict_item() == &hooks[i]);
+        REQUIRE(s3fifo.evict_item() == &again);
+    }
+    // Test: erased items are never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+        s3fifo.erase_item(hooks[0], "key0");
+        s3fifo.erase_item(hooks[0], "key0");
+        REQUIRE(s3fifo.evict_item() == &hooks[1]);
+    }
+    // Test: a key overwritten while in the main queue goes back to the main queue
+    SECTION("Overwrite Keeps Main"){
+        Evictor_Hook again;
+        s3fifo.touch_item(hooks[0], "key0", 1);
+        REQUIRE(s3fifo.evict_item() == &hooks[1]);
+        s3fifo.erase_item(hooks[0], "key0");
+        s3fifo.touch_item(again, "key0", 1);
+        for (int i = 2; i < 10; i++) REQUIRE(s3fifo.evict_item() == &hooks[i]);
+        REQUIRE(s3fifo.evict_item() == &again);
+    }
+}
+
+/*
+ * Some basic unit tests for the TinyLFU admission policy and its sketch.
+ */
+
+TEST_CASE("tinylfu"){
+    // Expected behavior: the sketch never underestimates a key's recent
+    // accesses (up to 15), and halves them all periodically; the evictor
+    // admits every new key to its window, and only keeps the window's
+    // candidates more frequent than the next victim
+    SECTION("Sketch Counts"){
+        Frequency_Sketch sketch(1000);
+        for (int i = 0; i < 7; i++) sketch.increment(key_hash("hot"));
+        for (int i = 0; i < 20; i++) sketch.increment(key_hash("hotter"));
+        REQUIRE(sketch.frequency(key_hash("hot")) >= 7);
+        REQUIRE(sketch.frequency(key_hash("hotter")) == 15);
+        REQUIRE(sketch.frequency(key_hash("cold")) <= 1);
+        REQUIRE(sketch.bytes() < 1000);
+    }
+    // Test: counts halve once the sketch has seen one access per counter
+    SECTION("Sketch Ages"){
+        // other keys can only raise hot's estimate, so a drop means a halving
+        Frequency_Sketch sketch(64);
+        for (int i = 0; i < 8; i++) sketch.increment(key_hash("hot"));
+        const unsigned before = sketch.frequency(key_hash("hot"));
+        bool dropped = false;
+        for (int i = 0; i < 640 && !dropped; i++) {
+            sketch.increment(key_hash("key" + std::to_string(i)));
+            dropped = sketch.frequency(key_hash("hot")) < before;
+        }
+        REQUIRE(dropped);
+    }
+    // Test: every new key is admitted to the window; the candidate the full
+    // window pushes out replaces the victim only if it is more frequent
+    SECTION("Admission"){
+        TinyLFU_Evictor tlfu(new Intrusive_LRU_Evictor(), 0.0);
+        Evictor_Hook hot, cold, warm, fresh;
+        REQUIRE(tlfu.admit("anything"));
+        tlfu.insert_item(hot, "hot", 1);
+        tlfu.insert_item(cold, "cold", 1);
+        tlfu.insert_item(warm, "warm", 1);
+        for (int i = 0; i < 5; i++) tlfu.touch_item(hot, "hot", 1);
+        for (int i = 0; i < 2; i++) tlfu.touch_item(warm, "warm", 1);
+        REQUIRE(tlfu.evict_item() == &cold);
+        tlfu.erase_item(cold, "cold");
+        tlfu.insert_item(fresh, "fresh", 1);
+        REQUIRE(tlfu.evict_item() == &fresh);
+        tlfu.erase_item(fresh, "fresh");
+        REQUIRE(tlfu.evict_item() == &hot);
+    }
+    // Test: new items wait in the window, older ones move on to the wrapped
+    // evictor, a candidate loses a tie with the victim, and erased items
+    // leave either
+    SECTION("Window"){
+        TinyLFU_Evictor tlfu(new Intrusive_LRU_Evictor(), 0.0);
+        Evictor_Hook hooks[4];
+        for (int i = 0; i < 4; i++) tlfu.insert_item(hooks[i], "key" + std::to_string(i), 1);
+        REQUIRE(tlfu.evict_item() == &hooks[3]);
+        tlfu.erase_item(hooks[3], "key3");
+        tlfu.erase_item(hooks[1], "key1");
+        REQUIRE(tlfu.evict_item() == &hooks[0]);
+        tlfu.erase_item(hooks[0], "key0");
+        REQUIRE(tlfu.evict_item() == &hooks[2]);
+        tlfu.erase_item(hooks[2], "key2");
+        REQUIRE(tlfu.evict_item() == nullptr);
+    }
+}
+
+/*
+ * Some basic unit tests for an ARC evictor.
+ */
+
+TEST_CASE("arc"){
+    // Expected behavior: items seen once leave in insertion order before
+    // items seen twice; keys coming back from the ghost lists are kept as
+    // frequent, and the target size of T1 grows on B1 hits and shrinks on B2 hits
+    ARC_Evictor arc;
+    Evictor_Hook hooks[10];
+    for (int i = 0; i < 10; i++) arc.insert_item(hooks[i], "key" + std::to_string(i), 1);
+
+    // Test: without reads, items go in insertion order
+    SECTION("Evict In Order"){
+        REQUIRE(arc.evict_item() == &hooks[0]);
+        REQUIRE(arc.evict_item() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 10; i++) arc.evict_item();
+        REQUIRE(arc.evict_item() == nullptr);
+    }
+    // Test: a read item moves to T2 and outlives the others
+    SECTION("Read Items Survive"){
+        arc.touch_item(hooks[0], "key0", 1);
+        for (int i = 1; i < 10; i++) REQUIRE(arc.evict_item() == &hooks[i]);
+        REQUIRE(arc.evict_item() == &hooks[0]);
+    }
+    // Test: a key evicted from T1 comes back into T2 and makes T1's target grow
+    SECTION("Ghost Hit"){
+        Evictor_Hook again;
+        REQUIRE(arc.evict_item() == &hooks[0]);
+        REQUIRE(arc.target() == 0);
+        arc.insert_item(again, "key0", 1);
+        REQUIRE(arc.target() == 1);
+        for (int i = 1; i < 9; i++) REQUIRE(arc.evict_item() == &hooks[i]);
+        // T1 is down to its target, so T2 goes next
+        REQUIRE(arc.evict_item() == &again);
+        REQUIRE(arc.evict_item() == &hooks[9]);
+    }
+    // Test: making room for a key in B2, T1 gives up an item when it is at
+    // its target once the B2 hit lowers it
+    SECTION("B2 Hit At Target"){
+        Evictor_Hook again;
+        REQUIRE(arc.evict_item() == &hooks[0]);
+        REQUIRE(arc.evict_item() == &hooks[1]);
+        arc.insert_item(hooks[0], "key0", 1);
+        arc.insert_item(hooks[1], "key1", 1);
+        REQUIRE(arc.target() == 2);
+        for (int i = 2; i < 9; i++) arc.erase_item(hooks[i], "key" + std::to_string(i));
+        // |T1| = 1 is within its target, so key0 goes from T2 into B2
+        REQUIRE(arc.evict_item() == &hooks[0]);
+        // the B2 hit lowers the target to 1 = |T1|
+        REQUIRE(arc.admit("key0"));
+        REQUIRE(arc.evict_item() == &hooks[9]);
+        arc.insert_item(again, "key0", 1);
+        REQUIRE(arc.target() == 1);
+        REQUIRE(arc.evict_item() == &hooks[1]);
+        REQUIRE(arc.evict_item() == &again);
+    }
+    // Test: erased items are never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+        arc.erase_item(hooks[0], "key0");
+        arc.erase_item(hooks[0], "key0");
+        REQUIRE(arc.evict_item() == &hooks[1]);
+    }
+    // Test: a scan of new keys doesn't push out the items read twice
+    SECTION("Scan Resistance"){
+        for (int i = 0; i < 5; i++) arc.touch_item(hooks[i], "key" + std::to_string(i), 1);
+        Evictor_Hook scan[20];
+        for (int i = 0; i < 20; i++)
+        {
+            Evictor_Hook* victim = arc.evict_item();
+            REQUIRE(victim != nullptr);
+            for (int j = 0; j < 5; j++) REQUIRE(victim != &hooks[j]);
+            arc.insert_item(scan[i], "scan" + std::to_string(i), 1);
+        }
+    }
+}
+
+/*
+ * Some basic unit tests for a GDSF evictor.
+ */
+
+TEST_CASE("gdsf"){
+    // Expected behavior: of items read as often, the largest leave first;
+    // reads keep an item longer, and the clock rises to each victim's
+    // priority so that new items outrank old ones
+    GDSF_Evictor gdsf;
+    Evictor_Hook hooks[10];
+    for (int i = 0; i < 10; i++) gdsf.insert_item(hooks[i], "key" + std::to_string(i), (i + 1) * 10);
+
+    // Test: without reads, items go from the largest to the smallest
+    SECTION("Largest First"){
+        REQUIRE(gdsf.evict_item() == &hooks[9]);
+        REQUIRE(gdsf.evict_item() == &hooks[8]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 10; i++) gdsf.evict_item();
+        REQUIRE(gdsf.evict_item() == nullptr);
+    }
+    // Test: a large item read often enough outlives the small ones
+    SECTION("Frequency Counts"){
+        for (int i = 0; i < 19; i++) gdsf.touch_item(hooks[9], "key9", 100);
+        for (int i = 8; i >= 0; i--) REQUIRE(gdsf.evict_item() == &hooks[i]);
+        REQUIRE(gdsf.evict_item() == &hooks[9]);
+    }
+    // Test: after an eviction, a new item as large as the victim outranks
+    // the old items that are a little smaller
+    SECTION("Clock Ages"){
+        Evictor_Hook fresh;
+        REQUIRE(gdsf.evict_item() == &hooks[9]);
+        REQUIRE(gdsf.clock() == Approx(0.01));
+        gdsf.insert_item(fresh, "fresh", 100);
+        REQUIRE(gdsf.evict_item() == &hooks[8]);
+    }
+    // Test: of the items a filter takes, the one of lowest priority goes
+    SECTION("Evict Accepted"){
+        auto small = [&hooks](const Evictor_Hook& hook) { return &hook - hooks < 5; };
+        REQUIRE(gdsf.evict_item_if(small) == &hooks[4]);
+        REQUIRE(gdsf.evict_item_if(small) == &hooks[3]);
+        REQUIRE(gdsf.evict_item() == &hooks[9]);
+    }
+    // Test: erased items are never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+        gdsf.erase_item(hooks[9], "key9");
+        gdsf.erase_item(hooks[9], "key9");
+        gdsf.erase_item(hooks[3], "key3");
+        for (int i = 8; i >= 0; i--)
+        {
+            if (i != 3) REQUIRE(gdsf.evict_item() == &hooks[i]);
+        }
+        REQUIRE(gdsf.evict_item() == nullptr);
+    }
+}
+
+/*
+ * Some basic unit tests for a sampled LRU evictor, fed by a sampler that
+ * goes over a list of items in turn instead of a cache.
+ */
+
+TEST_CASE("sampled lru"){
+    // Expected behavior: sampling every item gives exact LRU; erased items
+    // are never handed back; and candidates that lose stay in the pool
+    Sampled_LRU_Evictor lru(10);
+    Evictor_Hook hooks[10];
+    std::vector<Evictor_Hook*> items;
+    for (int i = 0; i < 10; i++)
+    {
+        lru.insert_item(hooks[i], "", 1);
+        items.push_back(&hooks[i]);
+    }
+    std::size_t next = 0;
+    lru.set_sampler([&](uint64_t) -> Evictor_Hook* {
+        return items.empty() ? nullptr : items[next++ % items.size()];
+    });
+    // evict the way the cache does, dropping the victim from the items
+    auto evict = [&]() {
+        Evictor_Hook* hook = lru.evict_item();
+        if (hook != nullptr)
+        {
+            items.erase(std::find(items.begin(), items.end(), hook));
+            lru.erase_item(*hook, "");
+        }
+        return hook;
+    };
+
+    // Test: without a sampler there is nothing to evict
+    SECTION("No Sampler"){
+        Sampled_LRU_Evictor unsampled;
+        Evictor_Hook hook;
+        unsampled.insert_item(hook, "", 1);
+        REQUIRE(unsampled.evict_item() == nullptr);
+    }
+    // Test: without reads, items go in insertion order
+    SECTION("Evict Least Recent"){
+        REQUIRE(evict() == &hooks[0]);
+        REQUIRE(evict() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when the sampler finds nothing
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 10; i++) evict();
+        REQUIRE(evict() == nullptr);
+    }
+    // Test: a read item outlives the others
+    SECTION("Touched Items Survive"){
+        lru.touch_item(hooks[0], "", 1);
+        for (int i = 1; i < 10; i++) REQUIRE(evict() == &hooks[i]);
+        REQUIRE(evict() == &hooks[0]);
+    }
+    // Test: a batch holds the least recent items, as many as the bytes need,
+    // and no item twice
+    SECTION("Batch"){
+        auto batch = lru.evict_batch(25, [](const Evictor_Hook&) -> std::size_t { return 10; });
+        REQUIRE(batch.size() == 3);
+        for (int i = 0; i < 3; i++) REQUIRE(batch[i] == &hooks[i]);
+    }
+    // Test: erased items are never evicted, even once in the pool
+    SECTION("Erase"){
+        REQUIRE(evict() == &hooks[0]);
+        items.erase(std::find(items.begin(), items.end(), &hooks[1]));
+        lru.erase_item(hooks[1], "");
+        REQUIRE(evict() == &hooks[2]);
+    }
+    // Test: a candidate seen by an earlier call still beats newer samples
+    SECTION("Pool Carries Candidates"){
+        Sampled_LRU_Evictor pooled(2);
+        Evictor_Hook more[10];
+        for (auto& hook : more) pooled.insert_item(hook, "", 1);
+        const int order[] = {0, 1, 8, 9};
+        std::size_t pos = 0;
+        pooled.set_sampler([&](uint64_t) { return &more[order[pos++ % 4]]; });
+        REQUIRE(pooled.evict_item() == &more[0]);
+        REQUIRE(pooled.evict_item() == &more[1]);
+    }
+}
+
+/*
+ * Some basic unit tests for a segmented LRU evictor.
+ */
+
+TEST_CASE("slru"){
+    // Expected behavior: items read once leave in insertion order before
+    // any item read twice; the protected segment overflows back into
+    // probation, most recent end first
+    SLRU_Evictor slru(0.8);
+    Evictor_Hook hooks[10];
+    for (int i = 0; i < 10; i++) slru.insert_item(hooks[i], "key" + std::to_string(i), 1);
+
+    // Test: without reads, items go in insertion order
+    SECTION("Evict In Order"){
+        REQUIRE(slru.evict_item() == &hooks[0]);
+        REQUIRE(slru.evict_item() == &hooks[1]);
+    }
+    // Test: evictor returns nullptr when there is nothing to evict
+    SECTION("Evict On Empty"){
+        for (int i = 0; i < 10; i++) slru.evict_item();
+        REQUIRE(slru.evict_item() == nullptr);
+    }
+    // Test: an item read again is protected and outlives the others
+    SECTION("Read Items Protected"){
+        slru.touch_item(hooks[0], "key0", 1);
+        for (int i = 1; i < 10; i++) REQUIRE(slru.evict_item() == &hooks[i]);
+        REQUIRE(slru.evict_item() == &hooks[0]);
+    }
+    // Test: past its share, the protected segment demotes its least recent
+    // item to the most recent end of probation
+    SECTION("Demote Overflow"){
+        for (int i = 0; i < 9; i++) slru.touch_item(hooks[i], "key" + std::to_string(i), 1);
+        REQUIRE(slru.evict_item() == &hooks[9]);
+        REQUIRE(slru.evict_item() == &hooks[0]);
+        for (int i = 1; i < 9; i++) REQUIRE(slru.evict_item() == &hooks[i]);
+    }
+    // Test: with no protected share, reads just move items to the back
+    SECTION("No Protected Share"){
+        SLRU_Evictor lru(0);
+        Evictor_Hook more[3];
+        for (auto& hook : more) lru.insert_item(hook, "", 1);
+        lru.touch_item(more[0], "", 1);
+        REQUIRE(lru.evict_item() == &more[1]);
+        REQUIRE(lru.evict_item() == &more[2]);
+        REQUIRE(lru.evict_item() == &more[0]);
+    }
+    // Test: erased items are never evicted, and erasing twice is harmless
+    SECTION("Erase"){
+        slru.touch_item(hooks[1], "key1", 1);
+        slru.erase_item(hooks[0], "key0");
+        slru.erase_item(hooks[0], "key0");
+        slru.erase_item(hooks[1], "key1");
+        REQUIRE(slru.evict_item() == &hooks[2]);
+    }
 }
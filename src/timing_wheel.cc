@@ -0,0 +1,112 @@
+/*
+ * Implementation of the timing wheel declared in timing_wheel.hh.
+ * Slots are doubly linked lists of items. An item remembers its slot, so it
+ * can be unlinked without searching.
+ */
+
+#include "timing_wheel.hh"
+#include <cassert>
+#include <algorithm>
+
+// tick at which an item comes due: the first one at or after its expiry
+static uint64_t
+due_tick(const Item* item)
+{
+  return (item->expires_ + Timing_Wheel::TICK_MS - 1) / Timing_Wheel::TICK_MS;
+}
+
+// Link an item into the slot covering its due tick (but no earlier than
+// the given one), at the lowest level whose span reaches it. Items due
+// beyond the top level wait in its furthest slot and are placed again when
+// it cascades.
+void
+Timing_Wheel::place(Item* item, uint64_t earliest)
+{
+  uint64_t due = std::max(due_tick(item), earliest);
+  unsigned level = 0;
+  while (level < LEVELS - 1 && (due - current_) >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+  {
+    level++;
+  }
+  const uint64_t span = uint64_t(1) << (SLOT_BITS * LEVELS);
+  if (due - current_ >= span) due = current_ + span - 1;
+  const uint32_t slot = level * SLOTS + ((due >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+  item->wheel_slot_ = slot;
+  item->wheel_prev_ = nullptr;
+  item->wheel_next_ = slots_[slot];
+  if (slots_[slot] != nullptr) slots_[slot]->wheel_prev_ = item;
+  slots_[slot] = item;
+}
+
+void
+Timing_Wheel::unlink(Item* item)
+{
+  if (item->wheel_prev_ != nullptr) item->wheel_prev_->wheel_next_ = item->wheel_next_;
+  else slots_[item->wheel_slot_] = item->wheel_next_;
+  if (item->wheel_next_ != nullptr) item->wheel_next_->wheel_prev_ = item->wheel_prev_;
+  item->wheel_slot_ = Item::NO_SLOT;
+  item->wheel_prev_ = item->wheel_next_ = nullptr;
+}
+
+void
+Timing_Wheel::schedule(Item* item)
+{
+  assert(item->expires_ != 0);
+  if (item->wheel_slot_ != Item::NO_SLOT) unlink(item);
+  else size_++;
+  place(item, current_ + 1);
+}
+
+void
+Timing_Wheel::cancel(Item* item)
+{
+  if (item->wheel_slot_ == Item::NO_SLOT) return;
+  unlink(item);
+  size_--;
+}
+
+void
+Timing_Wheel::clear()
+{
+  for (auto& head : slots_)
+  {
+    while (head != nullptr) unlink(head);
+  }
+  size_ = 0;
+}
+
+// Advance by one tick: cascade the higher level slots that now come into
+// range, then detach the level 0 slot of the new tick and return its items
+// as a list linked through wheel_next_.
+Item*
+Timing_Wheel::tick()
+{
+  current_++;
+  for (unsigned level = 1; level < LEVELS; level++)
+  {
+    // a level cascades whenever all the levels below it wrap around
+    if ((current_ & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) break;
+    const uint32_t slot = level * SLOTS + ((current_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+    Item* item = slots_[slot];
+    slots_[slot] = nullptr;
+    while (item != nullptr)
+    {
+      Item* next = item->wheel_next_;
+      // items due on this very tick land in the level 0 slot detached below
+      place(item, current_);
+      item = next;
+    }
+  }
+
+  const uint32_t slot = current_ & (SLOTS - 1);
+  Item* due = slots_[slot];
+  slots_[slot] = nullptr;
+  for (Item* item = due; item != nullptr; item = item->wheel_next_)
+  {
+    item->wheel_slot_ = Item::NO_SLOT;
+    item->wheel_prev_ = nullptr;
+    size_--;
+  }
+  return due;
+}
@@ -0,0 +1,68 @@
+/*
+ * Declarations for a hierarchical timing wheel, used by the cache to find
+ * items whose TTL has run out without scanning the whole table.
+ * Level 0 has one slot per tick. Each higher level has slots 64 times as
+ * wide, and its slots are cascaded down one level each time the level below
+ * wraps around. Scheduling and cancelling an item is O(1), and every tick
+ * does O(1) amortized work per item expiring.
+ * The wheel doesn't own its items; they are linked in through their
+ * wheel_* fields (see cache_item.hh).
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "cache_item.hh"
+
+class Timing_Wheel {
+  public:
+    static const uint64_t TICK_MS = 100;
+
+  private:
+    static const unsigned LEVELS = 4;
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS = 1 << SLOT_BITS;
+
+    Item* slots_[LEVELS * SLOTS] = {};
+    uint64_t current_ = 0;       // last tick processed
+    std::size_t size_ = 0;       // items scheduled
+
+    void place(Item* item, uint64_t earliest);
+    void unlink(Item* item);
+    Item* tick();
+
+  public:
+    Timing_Wheel() = default;
+    Timing_Wheel(const Timing_Wheel&) = delete;
+    Timing_Wheel& operator=(const Timing_Wheel&) = delete;
+
+    // Schedule an item to come due once item->expires_ (in ms) has passed
+    void schedule(Item* item);
+
+    // Take an item off the wheel, if it is on it
+    void cancel(Item* item);
+
+    // Forget every item
+    void clear();
+
+    std::size_t size() const { return size_; }
+
+    // Move the wheel forward to now (in ms), calling expire(item) on every
+    // item that comes due. Items are off the wheel when expire sees them.
+    template <class F>
+    void advance(uint64_t now, F expire)
+    {
+      const uint64_t target = now / TICK_MS;
+      if (size_ == 0 && current_ < target) current_ = target;
+      while (current_ < target)
+      {
+        for (Item* item = tick(); item != nullptr; )
+        {
+          Item* next = item->wheel_next_;
+          item->wheel_next_ = nullptr;
+          expire(item);
+          item = next;
+        }
+      }
+    }
+};
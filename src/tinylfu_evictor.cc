@@ -0,0 +1,277 @@
+/*
+ * Implementation of a TinyLFU_Evictor according to the declarations in tinylfu_evictor.hh
+ * The window is a plain list of the new items with their keys, since it
+ * only holds a small share of them and their hooks belong to the wrapped
+ * evictor once they leave it.
+ */
+
+#include "tinylfu_evictor.hh"
+#include <algorithm>
+#include <cassert>
+
+static const unsigned MIN_INDEX_BITS = 6;
+static const uint64_t SEEDS[4] = {0x97CB3127A9C5E1D3ull, 0xB492B66FBE98F273ull,
+                                  0x9AE16A3B2F90404Full, 0xCBF29CE484222325ull};
+
+Frequency_Sketch::Frequency_Sketch(std::size_t nitems)
+{
+  ensure_capacity(nitems);
+}
+
+void
+Frequency_Sketch::ensure_capacity(std::size_t nitems)
+{
+  unsigned bits = MIN_INDEX_BITS;
+  while ((std::size_t(1) << bits) < nitems) bits++;
+  if (bits <= index_bits_) return;
+  index_bits_ = bits;
+  table_.assign((std::size_t(1) << bits) / 16, 0);
+  additions_ = 0;
+  sample_size_ = std::size_t(1) << bits;
+}
+
+// counter used by the i-th of the key's four hash functions
+std::size_t
+Frequency_Sketch::index(uint32_t hash, unsigned i) const
+{
+  return ((uint64_t(hash) + SEEDS[i]) * 0x9E3779B97F4A7C15ull) >> (64 - index_bits_);
+}
+
+void
+Frequency_Sketch::increment(uint32_t hash)
+{
+  bool added = false;
+  for (unsigned i = 0; i < 4; i++)
+  {
+    const std::size_t idx = index(hash, i);
+    const unsigned shift = (idx & 15) * 4;
+    if (((table_[idx >> 4] >> shift) & 0xF) < 15)
+    {
+      table_[idx >> 4] += uint64_t(1) << shift;
+      added = true;
+    }
+  }
+  if (added && ++additions_ >= sample_size_) halve();
+}
+
+unsigned
+Frequency_Sketch::frequency(uint32_t hash) const
+{
+  unsigned res = 15;
+  for (unsigned i = 0; i < 4; i++)
+  {
+    const std::size_t idx = index(hash, i);
+    res = std::min(res, unsigned((table_[idx >> 4] >> ((idx & 15) * 4)) & 0xF));
+  }
+  return res;
+}
+
+// halve every counter at once, dropping the low bit of each
+void
+Frequency_Sketch::halve()
+{
+  for (auto& word : table_) word = (word >> 1) & 0x7777777777777777ull;
+  additions_ /= 2;
+}
+
+
+TinyLFU_Evictor::TinyLFU_Evictor(Evictor* main, double window_ratio)
+  : main_(main), window_ratio_(window_ratio)
+{
+  assert(main_ != nullptr);
+  assert(window_ratio_ >= 0 && window_ratio_ < 1);
+}
+
+// items the window holds at most, at least one
+std::size_t
+TinyLFU_Evictor::window_budget() const
+{
+  return std::max<std::size_t>(1, window_ratio_ * (window_.size() + main_size_));
+}
+
+// hand the window's oldest item over to the wrapped evictor
+void
+TinyLFU_Evictor::promote_oldest()
+{
+  auto& oldest = window_.back();
+  in_window_.erase(oldest.hook_);
+  main_->insert_item(*oldest.hook_, oldest.key_, oldest.size_);
+  main_size_++;
+  window_.pop_back();
+}
+
+// Hand the oldest items of the window over to the wrapped evictor until
+// the window is back within its share. These only overflow the window
+// while the cache isn't evicting, so no victim is needed to make room.
+void
+TinyLFU_Evictor::flush_window()
+{
+  while (window_.size() > window_budget()) promote_oldest();
+}
+
+// take the wrapped evictor's next victim, if there is one and none is held
+bool
+TinyLFU_Evictor::hold_victim()
+{
+  if (held_) return true;
+  Evictor_Hook* hook = main_->evict_item();
+  if (hook != nullptr)
+  {
+    held_hook_ = hook;
+    held_hash_ = hook->key_hash_;
+    held_ = true;
+    return true;
+  }
+  key_type key = main_->evict();
+  if (key == "") return false;
+  held_hook_ = nullptr;
+  held_key_ = std::move(key);
+  held_hash_ = key_hash(held_key_);
+  held_ = true;
+  return true;
+}
+
+void
+TinyLFU_Evictor::touch_key(const key_type& key)
+{
+  sketch_.increment(key_hash(key));
+  main_->touch_key(key);
+}
+
+const key_type
+TinyLFU_Evictor::evict()
+{
+  if (held_ && held_hook_ == nullptr)
+  {
+    held_ = false;
+    return std::move(held_key_);
+  }
+  if (held_) return "";
+  return main_->evict();
+}
+
+void
+TinyLFU_Evictor::touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size)
+{
+  sketch_.increment(hook.key_hash_);
+  if (held_ && (held_hook_ == &hook || (held_hook_ == nullptr && held_key_ == key)))
+  {
+    // a victim read after all goes back to the wrapped evictor
+    held_ = false;
+    main_->insert_item(hook, key, size);
+    return;
+  }
+  auto it = in_window_.find(&hook);
+  if (it != in_window_.end())
+  {
+    it->second->size_ = size;
+    window_.splice(window_.begin(), window_, it->second);
+    return;
+  }
+  main_->touch_item(hook, key, size);
+}
+
+void
+TinyLFU_Evictor::insert_item(Evictor_Hook& hook, const key_type& key, std::size_t size)
+{
+  const uint32_t hash = key_hash(key);
+  hook.key_hash_ = hash;
+  sketch_.increment(hash);
+  window_.push_front(Window_Item{&hook, key, size});
+  in_window_[&hook] = window_.begin();
+  sketch_.ensure_capacity(window_.size() + main_size_);
+  flush_window();
+}
+
+void
+TinyLFU_Evictor::erase_item(Evictor_Hook& hook, const key_type& key)
+{
+  auto victim = std::find(evicted_.begin(), evicted_.end(), &hook);
+  if (victim != evicted_.end())
+  {
+    *victim = evicted_.back();
+    evicted_.pop_back();
+    return;
+  }
+  if (held_ && held_hook_ == &hook)
+  {
+    held_ = false;
+  }
+  else
+  {
+    auto it = in_window_.find(&hook);
+    if (it != in_window_.end())
+    {
+      window_.erase(it->second);
+      in_window_.erase(it);
+      return;
+    }
+    main_->erase_item(hook, key);
+  }
+  if (main_size_ > 0) main_size_--;
+}
+
+// A window entry is a list node and a map entry, and owns a copy of the key
+std::size_t
+TinyLFU_Evictor::item_overhead(std::size_t key_len) const
+{
+  const std::size_t list_node = 2 * sizeof(void*) + sizeof(Window_Item) + key_copy_size(key_len);
+  const std::size_t map_entry = sizeof(void*) + sizeof(Evictor_Hook*) + sizeof(decltype(window_)::iterator)
+                              + sizeof(void*);
+  return std::max(list_node + map_entry, main_->item_overhead(key_len));
+}
+
+// The item the next set brings in is about to push the window's oldest
+// item out when the window is full, so that candidate is weighed against
+// the victim right away. Ties keep the victim, which has already proven
+// itself in the wrapped evictor.
+Evictor_Hook*
+TinyLFU_Evictor::evict_item()
+{
+  flush_window();
+  const bool duel = !window_.empty() && window_.size() >= window_budget();
+  if (hold_victim())
+  {
+    if (duel && sketch_.frequency(window_.back().hook_->key_hash_) <= sketch_.frequency(held_hash_))
+    {
+      Evictor_Hook* hook = window_.back().hook_;
+      in_window_.erase(hook);
+      window_.pop_back();
+      evicted_.push_back(hook);
+      return hook;
+    }
+    if (duel) promote_oldest();
+    if (held_hook_ == nullptr) return nullptr;   // the cache asks evict() for the key
+    held_ = false;
+    return held_hook_;
+  }
+  if (window_.empty()) return nullptr;
+  Evictor_Hook* hook = window_.back().hook_;
+  in_window_.erase(hook);
+  window_.pop_back();
+  evicted_.push_back(hook);
+  return hook;
+}
+
+Evictor_Hook*
+TinyLFU_Evictor::evict_item_if(const Evictor_Filter& accept)
+{
+  flush_window();
+  if (held_ && held_hook_ != nullptr && accept(*held_hook_))
+  {
+    held_ = false;
+    return held_hook_;
+  }
+  Evictor_Hook* hook = main_->evict_item_if(accept);
+  if (hook != nullptr) return hook;
+  for (auto it = window_.rbegin(); it != window_.rend(); ++it)
+  {
+    if (!accept(*it->hook_)) continue;
+    hook = it->hook_;
+    in_window_.erase(hook);
+    window_.erase(std::next(it).base());
+    evicted_.push_back(hook);
+    return hook;
+  }
+  return nullptr;
+}
@@ -0,0 +1,121 @@
+/*
+ * Declarations for a W-TinyLFU admission policy, which wraps another
+ * evictor according to the pattern in evictor.hh, for use in a cache
+ * according to the pattern in cache.hh
+ * Every new item enters a small LRU window, so that a burst of new keys
+ * can build up a history before it has to compete. Once the cache is
+ * full, each eviction weighs the item the full window pushes out against
+ * the wrapped evictor's next victim: the candidate joins the wrapped
+ * evictor only if the frequency sketch estimates it more popular than the
+ * victim, and is evicted otherwise.
+ */
+
+#pragma once
+#include "evictor.hh"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Count-min sketch of key frequencies, with four 4-bit counters per key
+// spread over a single table. Once it has counted as many accesses as it
+// has counters, every counter is halved, so that old popularity fades.
+// The table has about one counter per item tracked, half a byte each; with
+// four counters bumped per access, a longer sample would saturate them.
+class Frequency_Sketch {
+  private:
+    std::vector<uint64_t> table_;     // 16 counters per word
+    unsigned index_bits_ = 0;         // log2 of the number of counters
+    std::size_t additions_ = 0;
+    std::size_t sample_size_ = 0;
+
+    std::size_t index(uint32_t hash, unsigned i) const;
+    void halve();
+  public:
+    explicit Frequency_Sketch(std::size_t nitems = 0);
+
+    // Resize for nitems items if the table is smaller, forgetting all counts
+    void ensure_capacity(std::size_t nitems);
+
+    // Count an access to the key with this hash
+    void increment(uint32_t hash);
+
+    // Estimated number of recent accesses (0 to 15)
+    unsigned frequency(uint32_t hash) const;
+
+    std::size_t bytes() const { return table_.size() * sizeof(uint64_t); }
+};
+
+class TinyLFU_Evictor : public Evictor {
+  private:
+    std::unique_ptr<Evictor> main_;
+    Frequency_Sketch sketch_;
+    const double window_ratio_;
+
+    // window of new items, most recent first, with the key and size each
+    // one is handed to the wrapped evictor with
+    struct Window_Item {
+      Evictor_Hook* hook_;
+      key_type key_;
+      std::size_t size_;
+    };
+    std::list<Window_Item> window_;
+    std::unordered_map<Evictor_Hook*, decltype(window_)::iterator> in_window_;
+    std::size_t main_size_ = 0;       // items given to the wrapped evictor
+
+    // The wrapped evictor's next victim, taken out of it to be weighed
+    // against the window's candidates. It is still in the cache until
+    // evicted; a touch hands it back. Key-based evictors give a key
+    // instead of a hook.
+    Evictor_Hook* held_hook_ = nullptr;
+    key_type held_key_;
+    uint32_t held_hash_ = 0;
+    bool held_ = false;
+
+    // window items returned by evict_item, which the cache then erases
+    // (several of them when evicting a batch)
+    std::vector<Evictor_Hook*> evicted_;
+
+    std::size_t window_budget() const;
+    void flush_window();
+    void promote_oldest();
+    bool hold_victim();
+  public:
+    // main: the evictor that new items join when they leave the window
+    // (owned by the TinyLFU_Evictor).
+    // window_ratio: share of the tracked items kept in the window.
+    explicit TinyLFU_Evictor(Evictor* main, double window_ratio = 0.01);
+    ~TinyLFU_Evictor() = default;
+    TinyLFU_Evictor(const TinyLFU_Evictor&) = delete;
+    TinyLFU_Evictor& operator=(const TinyLFU_Evictor&) = delete;
+
+    void touch_key(const key_type& key) override;
+    const key_type evict() override;
+
+    // counts the access, and touches the item where it is tracked
+    void touch_item(Evictor_Hook& hook, const key_type& key, std::size_t size) override;
+
+    // counts the access, and puts a new item at the front of the window
+    void insert_item(Evictor_Hook& hook, const key_type& key, std::size_t size) override;
+
+    void erase_item(Evictor_Hook& hook, const key_type& key) override;
+
+    // once the window is full, returns the loser of its oldest item and the
+    // wrapped evictor's next victim, handing the winner to the wrapped
+    // evictor; otherwise returns that victim (or the window's oldest item
+    // if the wrapped evictor has none)
+    Evictor_Hook* evict_item() override;
+
+    // the same for the accepted items: the held victim, the wrapped
+    // evictor's choice, or the window's oldest accepted item
+    Evictor_Hook* evict_item_if(const Evictor_Filter& accept) override;
+
+    // the larger of a window entry and what the wrapped evictor spends, as
+    // an item is tracked by one or the other
+    std::size_t item_overhead(std::size_t key_len) const override;
+
+    const Frequency_Sketch& sketch() const { return sketch_; }
+};
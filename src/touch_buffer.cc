@@ -0,0 +1,31 @@
+/*
+ * Implementation of the touch buffer declared in touch_buffer.hh.
+ * A writer may only claim a slot the drainer is done with: it checks the
+ * ring's room against head_, which the drainer only moves past slots it
+ * has emptied.
+ */
+
+#include "touch_buffer.hh"
+
+// Ring of the calling thread: threads get rings in turn as they first
+// record a touch, so up to STRIPES threads never share one.
+unsigned
+Touch_Buffer::stripe()
+{
+  static std::atomic<unsigned> next_stripe{0};
+  thread_local const unsigned stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+  return stripe;
+}
+
+bool
+Touch_Buffer::record(Item* item)
+{
+  Ring& ring = rings_[stripe()];
+  uint64_t tail = ring.tail_.load(std::memory_order_relaxed);
+  do
+  {
+    if (tail - ring.head_.load(std::memory_order_acquire) >= RING_SIZE) return false;
+  } while (!ring.tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed));
+  ring.slots_[tail % RING_SIZE].store(item, std::memory_order_release);
+  return true;
+}
@@ -0,0 +1,65 @@
+/*
+ * Declarations for the buffer of touches a cache shard defers, so that a
+ * get doesn't have to update its evictor right away.
+ * As in Caffeine's read buffers, every thread records its touches into one
+ * of several lock-free rings, picked once per thread, so that threads
+ * reading the same items don't write to the same memory. Whoever holds
+ * the evictor drains the rings into it in batches. A touch that finds its
+ * ring full is dropped: the evictor only loses a little recency.
+ * The buffer doesn't own its items; the cache must drain it before it
+ * removes any item that may be in it.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "cache_item.hh"
+
+class Touch_Buffer {
+  public:
+    static constexpr unsigned STRIPES = 16;
+    static constexpr unsigned RING_SIZE = 64;
+
+  private:
+    // A ring written by any number of threads (usually one) and drained by
+    // one at a time. Writers claim a slot by moving tail_ on, then fill it.
+    struct alignas(64) Ring {
+      std::atomic<uint64_t> head_{0};     // next slot to drain
+      std::atomic<uint64_t> tail_{0};     // next slot to claim
+      std::atomic<Item*> slots_[RING_SIZE] = {};
+    };
+
+    Ring rings_[STRIPES];
+
+    static unsigned stripe();
+
+  public:
+    Touch_Buffer() = default;
+    Touch_Buffer(const Touch_Buffer&) = delete;
+    Touch_Buffer& operator=(const Touch_Buffer&) = delete;
+
+    // Record a touch of an item in the calling thread's ring. Returns false,
+    // dropping the touch, if the ring is full.
+    bool record(Item* item);
+
+    // Call touch(item) on every recorded touch, oldest first within each
+    // ring, and empty the rings. Only one thread may drain at a time; a
+    // touch being recorded meanwhile may be left for the next drain.
+    template <class F>
+    void drain(F touch)
+    {
+      for (Ring& ring : rings_)
+      {
+        uint64_t head = ring.head_.load(std::memory_order_relaxed);
+        const uint64_t tail = ring.tail_.load(std::memory_order_acquire);
+        for (; head != tail; head++)
+        {
+          Item* item = ring.slots_[head % RING_SIZE].exchange(nullptr, std::memory_order_acquire);
+          if (item == nullptr) break;    // claimed, but not filled yet
+          touch(item);
+        }
+        ring.head_.store(head, std::memory_order_release);
+      }
+    }
+};